@@ -0,0 +1,71 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include "World.hpp"
+
+// Bounding volume hierarchy over entity bounds. Built top down with the
+// surface area heuristic, after that moved entities are refit in place by
+// walking up from their leaf. Refitting keeps the tree correct but not
+// optimal, rebuild it once many entities have moved.
+class Bvh {
+  public:
+    struct Item {
+        EntityId entity;
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+
+  private:
+    // Leaves have count > 0 and hold items [first, first + count), inner
+    // nodes have count == 0 and their children at first and first + 1
+    struct Node {
+        glm::vec3 min;
+        uint32_t first;
+        glm::vec3 max;
+        uint32_t count;
+        uint32_t parent;
+    };
+
+    static constexpr uint32_t MAX_LEAF_SIZE = 4;
+    static constexpr uint32_t BIN_COUNT = 16;
+    static constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+
+    std::vector<Node> nodes;
+    std::vector<Item> items;
+    std::vector<uint32_t> leafOf; // Leaf node of each item
+    std::vector<uint32_t> itemOf; // Item index by entity id
+    size_t updates = 0;
+
+    void subdivide(uint32_t nodeIndex);
+    void fit(Node& node) const;
+
+  public:
+    // Replaces the tree with one over the given items
+    void Build(std::vector<Item> newItems);
+    // Rebuilds over the current items and their current bounds
+    void Rebuild();
+    void Clear();
+
+    inline bool Contains(EntityId entity) const {
+        return entity < itemOf.size() && itemOf[entity] != INVALID_INDEX;
+    }
+    inline size_t GetSize() const { return items.size(); }
+    // Number of Update calls since the last build
+    inline size_t GetUpdateCount() const { return updates; }
+
+    // Moves the bounds of an entity in the tree, it must be in it
+    void Update(EntityId entity, const glm::vec3& min, const glm::vec3& max);
+
+    // Appends every entity whose bounds overlap the box
+    void QueryBox(const glm::vec3& min, const glm::vec3& max,
+                  std::vector<EntityId>& out) const;
+    // Appends every entity whose bounds are not fully outside one of the
+    // planes. Planes are (normal, distance) with the normal pointing in.
+    void QueryFrustum(const glm::vec4 planes[6],
+                      std::vector<EntityId>& out) const;
+    // Finds the closest bounds hit by the ray within maxDistance. The
+    // direction does not have to be normalized, distance is in its units.
+    bool Raycast(const glm::vec3& origin, const glm::vec3& direction,
+                 float maxDistance, EntityId& hit, float& distance) const;
+};
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "Renderer.hpp"
+#include "FrameSnapshot.hpp"
 #include <glm/glm.hpp>
+#include <cstdint>
 
 class Camera {
   private:
@@ -17,6 +19,11 @@ class Camera {
     float farPlane;
     Renderer& renderer;
 
+    // Changes whenever view or projection do, unique across cameras
+    uint64_t version = 0;
+    // Aspect ratio the projection was computed for
+    float aspectRatio = 0.0f;
+
     void SetProjection(float fov, float nearPlane, float farPlane);
 
   public:
@@ -34,8 +41,14 @@ class Camera {
     void SetNearPlane(float nearPlane);
     void SetFarPlane(float farPlane);
 
+    // Recomputes the projection if the aspect ratio changed
     void SetProjection();
     void SetViewTransform(bgfx::ViewId viewId = 0);
+    // Copies the view and projection into the snapshot, unless it already
+    // has this version of them
+    void Capture(FrameSnapshot& snapshot) const;
+
+    inline uint64_t GetVersion() const { return version; }
 
     void LookAt(const glm::vec3& target);
 };
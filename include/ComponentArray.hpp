@@ -0,0 +1,84 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Sparse set of components keyed by a small integer handle. The components
+// are kept packed in a dense array, removing one moves the last component
+// into its place, so iterating GetData never skips holes.
+//
+// Writers can also mark a component as changed. The changed handles are kept
+// in a list until ClearChanged, so later stages only visit what changed. The
+// list can hold handles that were removed since, check Has. Marking is not
+// thread safe, same as Add and Remove.
+template <typename T> class ComponentArray {
+  public:
+    static constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+
+  private:
+    std::vector<T> dense;
+    std::vector<uint32_t> owners; // Handle of each dense component
+    std::vector<uint32_t> sparse; // Dense index of each handle
+    std::vector<uint32_t> changed;
+    std::vector<bool> changedFlags; // By handle, set while in changed
+
+  public:
+    T& Add(uint32_t handle, T component = T()) {
+        if (handle >= sparse.size()) {
+            sparse.resize(handle + 1, INVALID_INDEX);
+        }
+        if (sparse[handle] != INVALID_INDEX) {
+            return dense[sparse[handle]] = std::move(component);
+        }
+        sparse[handle] = (uint32_t)dense.size();
+        dense.push_back(std::move(component));
+        owners.push_back(handle);
+        return dense.back();
+    }
+
+    void Remove(uint32_t handle) {
+        if (!Has(handle)) {
+            return;
+        }
+        uint32_t index = sparse[handle];
+        uint32_t last = (uint32_t)dense.size() - 1;
+        if (index != last) {
+            dense[index] = std::move(dense[last]);
+            owners[index] = owners[last];
+            sparse[owners[index]] = index;
+        }
+        dense.pop_back();
+        owners.pop_back();
+        sparse[handle] = INVALID_INDEX;
+    }
+
+    void MarkChanged(uint32_t handle) {
+        if (handle >= changedFlags.size()) {
+            changedFlags.resize(handle + 1, false);
+        }
+        if (!changedFlags[handle]) {
+            changedFlags[handle] = true;
+            changed.push_back(handle);
+        }
+    }
+    inline const std::vector<uint32_t>& GetChanged() const { return changed; }
+    void ClearChanged() {
+        for (uint32_t handle : changed) {
+            changedFlags[handle] = false;
+        }
+        changed.clear();
+    }
+
+    inline bool Has(uint32_t handle) const {
+        return handle < sparse.size() && sparse[handle] != INVALID_INDEX;
+    }
+    // The handle must have a component.
+    inline T& Get(uint32_t handle) { return dense[sparse[handle]]; }
+    inline const T& Get(uint32_t handle) const { return dense[sparse[handle]]; }
+
+    inline std::vector<T>& GetData() { return dense; }
+    inline const std::vector<T>& GetData() const { return dense; }
+    inline const std::vector<uint32_t>& GetOwners() const { return owners; }
+    inline size_t Size() const { return dense.size(); }
+};
@@ -0,0 +1,74 @@
+#pragma once
+#include <Jolt/Jolt.h>
+#include <Jolt/Physics/Body/BodyID.h>
+#include <bgfx/bgfx.h>
+#include <glm/glm.hpp>
+#include <cfloat>
+#include <cstdint>
+#include "Enums.hpp"
+
+// Components of the scene entities in World::Get(). Every Primitive and
+// MeshEntity has a Transform, RenderMesh, MaterialRef and Bounds.
+//
+// Writers of a Transform mark it changed in the world, so the stages after
+// them only visit the entities that moved this frame.
+
+struct Transform {
+    glm::mat4 matrix = glm::mat4(1.0f);
+};
+
+// Axis aligned box of the mesh, in model space and in world space. The world
+// box is refreshed from the Transform by the UpdateBounds system.
+struct Bounds {
+    glm::vec3 localMin = glm::vec3(0.0f);
+    glm::vec3 localMax = glm::vec3(0.0f);
+    glm::vec3 min = glm::vec3(0.0f);
+    glm::vec3 max = glm::vec3(0.0f);
+
+    // Transforms the eight corners of the local box
+    void Update(const glm::mat4& transform) {
+        min = glm::vec3(FLT_MAX);
+        max = glm::vec3(-FLT_MAX);
+        for (int i = 0; i < 8; i++) {
+            glm::vec3 corner((i & 1) ? localMax.x : localMin.x,
+                             (i & 2) ? localMax.y : localMin.y,
+                             (i & 4) ? localMax.z : localMin.z);
+            glm::vec3 world = glm::vec3(transform * glm::vec4(corner, 1.0f));
+            min = glm::min(min, world);
+            max = glm::max(max, world);
+        }
+    }
+};
+
+// Only one of the vertex buffers is valid. Vertices that are never updated
+// go in a static buffer.
+struct RenderMesh {
+    bgfx::VertexBufferHandle staticVbh = BGFX_INVALID_HANDLE;
+    bgfx::DynamicVertexBufferHandle vbh = BGFX_INVALID_HANDLE;
+    bgfx::IndexBufferHandle ibh = BGFX_INVALID_HANDLE;
+};
+
+struct MaterialRef {
+    uint64_t materialId = 0;
+};
+
+// Only bodies that can move have one, static bodies never need syncing.
+struct RigidBody {
+    JPH::BodyID bodyID;
+};
+
+// A light on an entity of its own, see SceneManager::AddLight. Directional
+// lights only use the direction and color, and only the first one is drawn.
+struct Light {
+    LightType type = LightType::Point;
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+    glm::vec3 color = glm::vec3(1.0f);
+    float intensity = 1.0f;
+    // Point and spot lights fade out to nothing at this distance
+    float range = 10.0f;
+    // Spot lights are full strength inside the inner angle and fade out
+    // towards the outer one, in degrees from the direction
+    float innerAngle = 20.0f;
+    float outerAngle = 30.0f;
+};
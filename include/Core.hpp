@@ -1,23 +1,30 @@
 #pragma once
 
 #include "Enums.hpp"
+#include "EventDispatcher.hpp"
+#include "Events.hpp"
+#include "InputRecorder.hpp"
 #include "Renderer.hpp"
 #include "bx/timer.h"
 #include <SDL_events.h>
 #include <functional>
+#include <vector>
 
 class Core {
   private:
     SDL_Event event;
     bool quit = false;
-    const uint8_t* keyboardState = nullptr;
+    uint8_t* keyboardState = nullptr;
     uint8_t* lastKeyboardState = nullptr;
     bool keyboardActive = false;
     Renderer* renderer = nullptr;
+    InputRecorder* inputRecorder = nullptr;
 
     int64_t lastTime = bx::getHPCounter();
     int64_t now = bx::getHPCounter();
     int64_t freq = bx::getHPFrequency();
+    // Measured once per frame by BeginFrame
+    double deltaTime = 0.0;
 
     std::function<void(Keycode, KeyState)> keyEventCallback;
     std::function<void(int, int, int, int)> mouseMoveEventCallback;
@@ -27,23 +34,41 @@ class Core {
     std::function<void(double)> physicsStepCallback;
     std::function<void(double)> updateCallback;
     std::function<void()> WindowMinimized;
+    // Listeners that forward queued input events to the callbacks above
+    std::vector<EventHandle> inputListeners;
+    // Listeners added with AddKeyPressListener, pressed keys are only posted
+    // while there are any
+    std::vector<EventHandle> keyPressListeners;
+
+    void handleEvent(const SDL_Event& event);
+    void applyInputEvent(const InputEvent& event);
 
   public:
     Core();
-    Core(Core&&) = default;
-    Core(const Core&) = default;
-    Core& operator=(Core&&) = default;
-    Core& operator=(const Core&) = default;
+    // The input listeners registered by Init point back at this object
+    Core(Core&&) = delete;
+    Core(const Core&) = delete;
+    Core& operator=(Core&&) = delete;
+    Core& operator=(const Core&) = delete;
     ~Core();
 
     inline bool IsQuit() { return quit; }
     inline void SetQuit(bool q) { quit = q; }
     inline void SetRenderer(Renderer* renderer) { this->renderer = renderer; }
+    // While the recorder is playing back, live input is ignored and the
+    // recorded input and delta times are used instead.
+    inline void SetInputRecorder(InputRecorder* recorder) {
+        inputRecorder = recorder;
+    }
 
     bool Init();
     bool Shutdown();
 
     void SetKeyEventCallback(std::function<void(Keycode, KeyState)> callback);
+    // The key callback only gets releases. Listeners added here get the
+    // KeyEvents of pressed and released keys.
+    EventHandle AddKeyPressListener(std::function<void(const KeyEvent&)> fn);
+    void RemoveKeyPressListener(EventHandle handle);
     void
     SetMouseMoveEventCallback(std::function<void(int, int, int, int)> callback);
     void SetMouseButtonEventCallback(
@@ -56,7 +81,11 @@ class Core {
     }
 
     void EventLoop();
-    double GetDeltaTime();
+    // Measures the time since the last call, or takes it from the recording
+    // when playing back. Call once per frame, after EventLoop.
+    void BeginFrame();
+    // Time of the current frame, the same value for every caller
+    inline double GetDeltaTime() const { return deltaTime; }
     void CallKeyboardEvent();
     void CallPhysicsStep(double deltaTime);
     void CallUpdate(double deltaTime);
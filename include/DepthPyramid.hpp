@@ -0,0 +1,48 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+// Hierarchical depth buffer on the CPU. Level 0 is a depth buffer read back
+// from the GPU, already reduced to the farthest depth of each block of
+// BLOCK_SIZE by BLOCK_SIZE pixels. Every level above keeps the farthest depth
+// of 2x2 texels of the one below, so a box can be tested against a handful of
+// texels whatever its size on screen.
+//
+// The depth is from an earlier frame. Boxes are projected with the view
+// projection of that frame, so a moving camera can keep something hidden for
+// the few frames the readback lags behind.
+class DepthPyramid {
+  private:
+    struct Level {
+        uint32_t width;
+        uint32_t height;
+        std::vector<float> depth;
+    };
+
+    std::vector<Level> levels;
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    // Size of the screen the depth was drawn at
+    float screenWidth = 0.0f;
+    float screenHeight = 0.0f;
+    bool homogeneousDepth = false;
+    bool originBottomLeft = false;
+
+  public:
+    // Pixels the depth shader reduces into one texel, per side
+    static constexpr uint32_t BLOCK_SIZE = 8;
+
+    // Builds the levels from depth of width * height texels, rows in texture
+    // order. The depth was drawn with viewProjection at screenWidth *
+    // screenHeight pixels.
+    void Build(const float* depth, uint32_t width, uint32_t height,
+               uint32_t screenWidth, uint32_t screenHeight,
+               const glm::mat4& viewProjection);
+    void Clear();
+    inline bool IsEmpty() const { return levels.empty(); }
+
+    // True when the box is behind the depth everywhere it covers on screen.
+    // Boxes crossing the near plane or outside the screen are never occluded,
+    // leave those to frustum culling.
+    bool IsOccluded(const glm::vec3& min, const glm::vec3& max) const;
+};
@@ -8,29 +8,64 @@
 #include "Enums.hpp"
 #include "PhysicsCore.hpp"
 #include "Texture.hpp"
+#include "World.hpp"
+#include "Components.hpp"
 #include <glm/ext/matrix_transform.hpp>
 
+// Concrete type of an entity, checked instead of using dynamic_cast.
+enum class EntityKind { Primitive, Mesh };
+
+// The transform, buffers and material are components of an entity in
+// World::Get(), this object only keeps the cold data and the entity id.
 class Entity {
   protected:
+    EntityKind kind;
     RigidBodyType bodyType = RigidBodyType::Static;
-    glm::vec3 position;
+    EntityId entity = INVALID_ENTITY;
     glm::vec3 rotation;
     glm::vec3 size;
-    glm::mat4 transform;
-    uint64_t materialId = 0;
-
-    bgfx::DynamicVertexBufferHandle vbh;
-    bgfx::IndexBufferHandle ibh;
 
     JPH::BodyID bodyID;
     JPH::BodyInterface* bodyInterface = nullptr;
 
+    inline const glm::mat4& transform() const {
+        return World::Get().Get<Transform>(entity).matrix;
+    }
+    // Write access, marks the transform changed for this frame
+    inline glm::mat4& editTransform() {
+        World& world = World::Get();
+        world.MarkChanged<Transform>(entity);
+        return world.Get<Transform>(entity).matrix;
+    }
+    inline RenderMesh& renderMesh() const {
+        return World::Get().Get<RenderMesh>(entity);
+    }
+    // Call after bodyID changes so the physics sync moves the right body
+    void syncRigidBody();
+    // Uploads the mesh into static buffers. Meshes start out static, the
+    // driver does no update bookkeeping for them.
+    void createBuffers(const bgfx::Memory* vertices,
+                       const bgfx::Memory* indices,
+                       const bgfx::VertexLayout& layout,
+                       uint16_t indexFlags = BGFX_BUFFER_NONE);
+    // Replaces the mesh from UpdateMesh. The vertices move to a dynamic
+    // buffer, later updates write into it instead of creating a new one.
+    void updateBuffers(const bgfx::Memory* vertices,
+                       const bgfx::Memory* indices,
+                       const bgfx::VertexLayout& layout,
+                       uint16_t indexFlags = BGFX_BUFFER_NONE);
+    void destroyBuffers();
+    // Call before the buffers take the vertex memory. The bounds changed, so
+    // everything cached from the layout is rebuilt too.
+    void setLocalBounds(const bgfx::Memory* vertices,
+                        const bgfx::VertexLayout& layout);
+
     void QuaternionRotate(glm::mat4& result, const glm::vec3& axis,
                           float angle);
     void Delete();
 
   public:
-    Entity(RigidBodyType bodyType, PhysicsCore& physicsCore,
+    Entity(EntityKind kind, RigidBodyType bodyType, PhysicsCore& physicsCore,
            bgfx::VertexLayout& layout, uint64_t materialId,
            glm::vec3 position = glm::vec3(0.0f),
            glm::vec3 rotation = glm::vec3(0.0f),
@@ -41,34 +76,43 @@ class Entity {
     Entity& operator=(const Entity&) = delete;
     virtual ~Entity();
 
-    inline void SetVertexBuffer() { bgfx::setVertexBuffer(0, vbh); }
-    inline void SetIndexBuffer() { bgfx::setIndexBuffer(ibh); }
+    inline void SetVertexBuffer() {
+        const RenderMesh& mesh = renderMesh();
+        if (bgfx::isValid(mesh.staticVbh)) {
+            bgfx::setVertexBuffer(0, mesh.staticVbh);
+        } else {
+            bgfx::setVertexBuffer(0, mesh.vbh);
+        }
+    }
+    inline void SetIndexBuffer() { bgfx::setIndexBuffer(renderMesh().ibh); }
     inline void SetTransform(const glm::mat4& transform) {
-        this->transform = transform;
-        this->position = glm::vec3(transform[3]);
-        this->rotation = glm::vec3(transform[2]);
-        this->size =
-            glm::vec3(transform[0][0], transform[1][1], transform[2][2]);
+        editTransform() = transform;
     }
 
-    inline void ApplyTransform() { bgfx::setTransform(&transform[0][0]); }
+    inline void ApplyTransform() {
+        bgfx::setTransform(&transform()[0][0]);
+    }
 
-    uint64_t GetMaterialId() const { return materialId; }
+    uint64_t GetMaterialId() const {
+        return World::Get().Get<MaterialRef>(entity).materialId;
+    }
 
     inline void SetMaterialId(uint64_t materialId) {
-        this->materialId = materialId;
+        World& world = World::Get();
+        world.Get<MaterialRef>(entity).materialId = materialId;
+        world.MarkLayoutChanged();
     }
 
     inline void SetPosition(glm::vec3 position) {
-        this->position = position;
-        transform = glm::translate(glm::mat4(1.0f), position);
+        editTransform() = glm::translate(glm::mat4(1.0f), position);
     }
     inline void AddPosition(glm::vec3 position) {
-        this->position += position;
+        glm::mat4& transform = editTransform();
         transform = glm::translate(transform, position);
     }
     inline void SetScale(glm::vec3 scale) {
         this->size = scale;
+        glm::mat4& transform = editTransform();
         transform = glm::scale(transform, scale);
     }
 
@@ -76,21 +120,27 @@ class Entity {
                                                     JPH::EActivation::Activate);
 
     void AddImpulse(glm::vec3 impulse);
+    void SetLinearVelocity(glm::vec3 velocity);
 
     void SetRotation(glm::vec3 rotation);
     void AddRotation(glm::vec3 rotation);
 
     inline void SetSize(glm::vec3 size) {
         this->size = size;
+        glm::mat4& transform = editTransform();
         transform = glm::scale(transform, size);
     }
 
+    inline EntityKind GetKind() const { return kind; }
+    inline EntityId GetEntityId() const { return entity; }
     inline JPH::BodyID GetBodyID() const { return bodyID; }
     inline RigidBodyType GetBodyType() const { return bodyType; }
-    inline glm::vec3 GetPosition() const { return position; }
+    inline glm::vec3 GetPosition() const {
+        return glm::vec3(transform()[3]);
+    }
     inline glm::vec3 GetRotation() const { return rotation; }
     inline glm::vec3 GetSize() const { return size; }
-    inline glm::mat4 GetTransform() const { return transform; }
+    inline glm::mat4 GetTransform() const { return transform(); }
 
     virtual void UpdateMesh(PhysicsCore& physicsCore,
                             bgfx::VertexLayout& layout) = 0;
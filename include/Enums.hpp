@@ -10,6 +10,8 @@ enum class RigidBodyType { Static, Dynamic, Kinematic };
 
 enum class ColliderType { Box, Sphere, Capsule, Plane, Mesh };
 
+enum class LightType { Directional, Point, Spot };
+
 enum class Keycode {
     UNKNOWN = SDLK_UNKNOWN,
     RETURN = SDL_SCANCODE_RETURN,
@@ -0,0 +1,178 @@
+#pragma once
+#include "EventDispatcher.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Points in the frame where queued events are delivered.
+enum class FramePhase : uint8_t { PrePhysics, PostPhysics, PreRender, Count };
+
+// How events of one type are combined while they wait for delivery.
+enum class Coalesce : uint8_t {
+    None,  // Every event is delivered
+    Latest // Only the most recent event is delivered
+};
+
+// Queues events in a fixed size ring buffer per event type and hands them to
+// the EventDispatcher in batches when their frame phase is flushed. This
+// bounds how much work a burst of events can cause in a single frame. When a
+// queue is full the oldest event is dropped.
+class EventBus {
+  private:
+    struct QueueBase {
+        FramePhase phase = FramePhase::PrePhysics;
+        virtual ~QueueBase() = default;
+        virtual void Deliver() = 0;
+        virtual void Clear() = 0;
+    };
+
+    template <typename Event> struct Queue : QueueBase {
+        std::vector<Event> ring;
+        size_t head = 0;
+        size_t size = 0;
+        size_t dropped = 0;
+        Coalesce coalesce = Coalesce::None;
+        std::function<void(const Event&)> onDrop;
+
+        void Push(const Event& event) {
+            if (coalesce == Coalesce::Latest && size > 0) {
+                Event& last = ring[(head + size - 1) % ring.size()];
+                if (onDrop) {
+                    onDrop(last);
+                }
+                last = event;
+                return;
+            }
+            if (size == ring.size()) {
+                if (onDrop) {
+                    onDrop(ring[head]);
+                }
+                head = (head + 1) % ring.size();
+                size--;
+                dropped++;
+            }
+            ring[(head + size) % ring.size()] = event;
+            size++;
+        }
+
+        void Deliver() override {
+            // Events queued by the listeners wait for the next flush
+            size_t count = size;
+            for (size_t i = 0; i < count; i++) {
+                Event event = ring[head];
+                head = (head + 1) % ring.size();
+                size--;
+                EventDispatcher::Get().DispatchEvent(event);
+            }
+        }
+
+        void Clear() override {
+            while (size > 0) {
+                if (onDrop) {
+                    onDrop(ring[head]);
+                }
+                head = (head + 1) % ring.size();
+                size--;
+            }
+            head = 0;
+        }
+    };
+
+    EventBus() = default;
+    // By event type id. Flush scans all of them, there are only a handful.
+    std::vector<std::unique_ptr<QueueBase>> m_queues;
+
+    template <typename Event> Queue<Event>& queue() {
+        const EventTypeId type = EventDispatcher::TypeId<Event>();
+        if (type >= m_queues.size()) {
+            m_queues.resize(type + 1);
+        }
+        if (!m_queues[type]) {
+            auto q = std::make_unique<Queue<Event>>();
+            q->ring.resize(DEFAULT_CAPACITY);
+            m_queues[type] = std::move(q);
+        }
+        return static_cast<Queue<Event>&>(*m_queues[type]);
+    }
+
+  public:
+    static constexpr size_t DEFAULT_CAPACITY = 256;
+
+    static EventBus& Get() {
+        static EventBus instance;
+        return instance;
+    }
+    EventBus(const EventBus&) = delete;
+    EventBus& operator=(const EventBus&) = delete;
+
+    // Sets when and how events of a type are delivered. Queued events are
+    // kept, unless they no longer fit in the new capacity.
+    template <typename Event>
+    void SetDelivery(FramePhase phase, Coalesce coalesce = Coalesce::None,
+                     size_t capacity = DEFAULT_CAPACITY) {
+        Queue<Event>& q = queue<Event>();
+        q.phase = phase;
+        q.coalesce = coalesce;
+
+        if (capacity == 0) {
+            capacity = 1;
+        }
+        if (capacity != q.ring.size()) {
+            std::vector<Event> ring(capacity);
+            while (q.size > capacity) {
+                if (q.onDrop) {
+                    q.onDrop(q.ring[q.head]);
+                }
+                q.head = (q.head + 1) % q.ring.size();
+                q.size--;
+            }
+            for (size_t i = 0; i < q.size; i++) {
+                ring[i] = q.ring[(q.head + i) % q.ring.size()];
+            }
+            q.ring = std::move(ring);
+            q.head = 0;
+        }
+    }
+
+    // Called for events that are dropped or coalesced away without being
+    // delivered, so events holding resources can release them.
+    template <typename Event>
+    void SetDropHandler(std::function<void(const Event&)> handler) {
+        queue<Event>().onDrop = std::move(handler);
+    }
+
+    // Queues an event for delivery in its frame phase.
+    template <typename Event> void Post(const Event& event) {
+        queue<Event>().Push(event);
+    }
+
+    // Delivers everything queued for the phase, one event type at a time.
+    // Listeners may post new event types or change a delivery, which can
+    // grow m_queues, so it is walked by index.
+    void Flush(FramePhase phase) {
+        const size_t count = m_queues.size();
+        for (size_t i = 0; i < count; i++) {
+            QueueBase* q = m_queues[i].get();
+            if (q && q->phase == phase) {
+                q->Deliver();
+            }
+        }
+    }
+
+    template <typename Event> size_t GetDroppedCount() {
+        return queue<Event>().dropped;
+    }
+
+    // Drops everything queued for one event type.
+    template <typename Event> void Clear() { queue<Event>().Clear(); }
+
+    void Clear() {
+        for (auto& q : m_queues) {
+            if (q) {
+                q->Clear();
+            }
+        }
+    }
+};
@@ -1,22 +1,129 @@
 #pragma once
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <functional>
-#include <string>
-#include <unordered_map>
+#include <memory>
 #include <vector>
-#include <any>
-#include <iostream>
+
+using EventTypeId = uint32_t;
 
 struct EventHandle {
-    size_t id;        // Unique ID for the listener
-    std::string type; // Type of event the listener is interested in
+    size_t id = 0;        // Unique ID for the listener, 0 is never used
+    EventTypeId type = 0; // Type of event the listener is interested in
 };
 
+// Dispatches plain structs to the listeners registered for that struct type.
+// Each event type gets its own contiguous listener array, found through a
+// template instead of a string lookup, so dispatching does not allocate.
+// Listeners may add or remove listeners while an event is being dispatched.
 class EventDispatcher {
+  private:
+    struct ChannelBase {
+        virtual ~ChannelBase() = default;
+        virtual void Remove(size_t id) = 0;
+        virtual void Clear() = 0;
+    };
+
+    template <typename Event> struct Channel : ChannelBase {
+        struct Entry {
+            size_t id;
+            std::function<void(const Event&)> listener;
+            bool alive;
+        };
+
+        std::vector<Entry> listeners;
+        // Listeners added during a dispatch, moved in once it is done
+        std::vector<Entry> pending;
+        int dispatchDepth = 0;
+        bool needsCompact = false;
+
+        void Dispatch(const Event& event) {
+            dispatchDepth++;
+            const size_t count = listeners.size();
+            for (size_t i = 0; i < count; i++) {
+                if (listeners[i].alive) {
+                    listeners[i].listener(event);
+                }
+            }
+            dispatchDepth--;
+            if (dispatchDepth == 0) {
+                flush();
+            }
+        }
+
+        void Remove(size_t id) override {
+            for (auto& entry : listeners) {
+                if (entry.id == id && entry.alive) {
+                    // Leave the slot in place while dispatching so indices
+                    // stay valid, it is compacted afterwards
+                    entry.alive = false;
+                    needsCompact = true;
+                    break;
+                }
+            }
+            pending.erase(std::remove_if(pending.begin(), pending.end(),
+                                         [id](const Entry& entry) {
+                                             return entry.id == id;
+                                         }),
+                          pending.end());
+            if (dispatchDepth == 0) {
+                flush();
+            }
+        }
+
+        void Clear() override {
+            for (auto& entry : listeners) {
+                entry.alive = false;
+            }
+            needsCompact = !listeners.empty();
+            pending.clear();
+            if (dispatchDepth == 0) {
+                flush();
+            }
+        }
+
+        void flush() {
+            if (needsCompact) {
+                listeners.erase(std::remove_if(listeners.begin(),
+                                               listeners.end(),
+                                               [](const Entry& entry) {
+                                                   return !entry.alive;
+                                               }),
+                                listeners.end());
+                needsCompact = false;
+            }
+            if (!pending.empty()) {
+                std::move(pending.begin(), pending.end(),
+                          std::back_inserter(listeners));
+                pending.clear();
+            }
+        }
+    };
+
+    EventDispatcher() = default;
+    std::vector<std::unique_ptr<ChannelBase>> m_channels;
+    size_t _nextListenerId = 1;
+
+    static EventTypeId nextTypeId() {
+        static EventTypeId next = 0;
+        return next++;
+    }
+
+    template <typename Event> Channel<Event>& channel() {
+        const EventTypeId type = TypeId<Event>();
+        if (type >= m_channels.size()) {
+            m_channels.resize(type + 1);
+        }
+        if (!m_channels[type]) {
+            m_channels[type] = std::make_unique<Channel<Event>>();
+        }
+        return static_cast<Channel<Event>&>(*m_channels[type]);
+    }
 
   public:
-    using Listener = std::function<void(const std::any&)>;
+    template <typename Event>
+    using Listener = std::function<void(const Event&)>;
 
     static EventDispatcher& Get() {
         static EventDispatcher instance; // Guaranteed to be destroyed.
@@ -26,42 +133,42 @@ class EventDispatcher {
     EventDispatcher(const EventDispatcher&) = delete;
     EventDispatcher& operator=(const EventDispatcher&) = delete;
 
-    EventHandle AddListener(std::string event, Listener listener) {
+    // Unique ID of an event type, assigned the first time it is used.
+    template <typename Event> static EventTypeId TypeId() {
+        static const EventTypeId id = nextTypeId();
+        return id;
+    }
+
+    template <typename Event>
+    EventHandle AddListener(Listener<Event> listener) {
+        Channel<Event>& c = channel<Event>();
         size_t id = _nextListenerId++;
-        m_listeners[event].emplace_back(id, listener);
-        return {id, event};
+        auto& target = c.dispatchDepth > 0 ? c.pending : c.listeners;
+        target.push_back({id, std::move(listener), true});
+        return {id, TypeId<Event>()};
     };
 
-    void DispatchEvent(std::string event, const std::any& payload) {
-        auto it = m_listeners.find(event);
-        if (it != m_listeners.end()) {
-            for (const auto& pair : it->second) {
-                std::cout << "Dispatching event: " << event << std::endl;
-                std::any_cast<Listener>(pair.second)(payload);
-                std::cout << "Event dispatched" << std::endl;
-            }
+    template <typename Event> void DispatchEvent(const Event& event) {
+        const EventTypeId type = TypeId<Event>();
+        if (type >= m_channels.size() || !m_channels[type]) {
+            return;
         }
+        static_cast<Channel<Event>&>(*m_channels[type]).Dispatch(event);
     };
 
-    void DispatchEvent(std::string event) { DispatchEvent(event, std::any{}); };
-
     void RemoveListener(EventHandle handle) {
-        auto it = m_listeners.find(handle.type);
-        if (it != m_listeners.end()) {
-            auto& listeners = it->second;
-            listeners.erase(std::remove_if(listeners.begin(), listeners.end(),
-                                           [handle](const auto& pair) {
-                                               return pair.first == handle.id;
-                                           }),
-                            listeners.end());
+        if (handle.id == 0 || handle.type >= m_channels.size() ||
+            !m_channels[handle.type]) {
+            return;
         }
+        m_channels[handle.type]->Remove(handle.id);
     };
 
-    void RemoveAllListeners() { m_listeners.clear(); };
-
-  private:
-    EventDispatcher() = default;
-    std::unordered_map<std::string, std::vector<std::pair<size_t, std::any>>>
-        m_listeners;
-    size_t _nextListenerId = 0;
+    void RemoveAllListeners() {
+        for (auto& c : m_channels) {
+            if (c) {
+                c->Clear();
+            }
+        }
+    };
 };
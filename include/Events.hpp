@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Enums.hpp"
+#include <cstdint>
+
+// Payloads sent through the EventDispatcher and EventBus.
+
+struct KeyEvent {
+    Keycode keycode;
+    KeyState state;
+};
+
+struct MouseMoveEvent {
+    int x;
+    int y;
+    int xrel;
+    int yrel;
+};
+
+struct MouseButtonEvent {
+    int x;
+    int y;
+    MouseButton button;
+    KeyState state;
+};
+
+struct MouseWheelEvent {
+    int x;
+    int y;
+};
+
+// Sent when a script spawns a primitive into the scene.
+struct SpawnEvent {
+    PrimitiveType type;
+    uint64_t entityId;
+};
@@ -0,0 +1,69 @@
+#pragma once
+#include <bgfx/bgfx.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include "Vertex.hpp"
+
+// One entity to draw in the geometry pass. Only one of the vertex buffers is
+// valid, like in RenderMesh.
+struct DrawItem {
+    glm::mat4 transform;
+    bgfx::VertexBufferHandle staticVbh;
+    bgfx::DynamicVertexBufferHandle vbh;
+    bgfx::IndexBufferHandle ibh;
+    bgfx::TextureHandle albedo;
+    bgfx::TextureHandle normal;
+    // Roughness and specular, like Material
+    glm::vec4 material;
+};
+
+// Geometry made for a single frame, like debug shapes or particles. Streamed
+// to the GPU through transient buffers, which bgfx frees after the frame.
+struct ProceduralDraw {
+    glm::mat4 transform = glm::mat4(1.0f);
+    std::vector<Vertex> vertices;
+    std::vector<uint16_t> indices;
+    bgfx::TextureHandle albedo = BGFX_INVALID_HANDLE;
+    bgfx::TextureHandle normal = BGFX_INVALID_HANDLE;
+    glm::vec4 material = glm::vec4(0.7f, 0.2f, 0.0f, 0.0f);
+};
+
+// A point or spot light laid out like the lighting shader reads it. Point
+// lights get a cone that covers everything.
+struct LightItem {
+    glm::vec4 positionRange;
+    glm::vec4 colorCosInner;
+    glm::vec4 directionCosOuter;
+};
+
+// Everything the renderer needs to draw a frame, copied out of the scene so
+// the next frame can be simulated while this one is submitted.
+//
+// Snapshots are reused frame after frame. Only what changed since the
+// snapshot was last captured into is copied again.
+struct FrameSnapshot {
+    float view[16];
+    float projection[16];
+    float nearPlane = 0.1f;
+    float farPlane = 100.0f;
+    std::vector<DrawItem> draws;
+    // Indices into draws that passed culling, the only ones drawn
+    std::vector<uint32_t> visible;
+    // Cleared by Renderer::Present once drawn, so fill it every frame
+    std::vector<ProceduralDraw> procedural;
+    // Filled every frame, there are few enough lights
+    std::vector<LightItem> lights;
+    // Towards the directional light, color is zero without one
+    glm::vec3 sunDirection = glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::vec3 sunColor = glm::vec3(0.0f);
+
+    // Camera::GetVersion of the view and projection
+    uint64_t cameraVersion = UINT64_MAX;
+    // World::GetLayoutVersion the draws were built for
+    uint64_t layoutVersion = UINT64_MAX;
+    // Index into draws by entity id
+    std::vector<uint32_t> drawOf;
+    // Entities that moved while the other snapshot was captured
+    std::vector<uint32_t> pending;
+};
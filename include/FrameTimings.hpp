@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Collects wall clock frame times and prints a summary, used to compare
+// benchmark runs made from the same input recording.
+class FrameTimings {
+  private:
+    std::vector<float> frameTimes; // Milliseconds
+    int64_t frameStart = 0;
+
+  public:
+    FrameTimings() = default;
+    ~FrameTimings() = default;
+
+    void BeginFrame();
+    void EndFrame();
+    void Clear();
+    void Report() const;
+
+    inline size_t GetFrameCount() const { return frameTimes.size(); }
+};
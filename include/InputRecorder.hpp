@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Enums.hpp"
+#include "EventDispatcher.hpp"
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+enum class InputEventType : uint8_t {
+    KeyDown,
+    KeyUp,
+    MouseMove,
+    MouseButton,
+    MouseWheel,
+    Spawn
+};
+
+// A single input event as seen by Core. Only the fields used by the type are
+// written to disk.
+struct InputEvent {
+    InputEventType type;
+    uint16_t code = 0; // Scancode, mouse button or primitive type
+    uint8_t state = 0; // KeyState for mouse buttons
+    int32_t x = 0;
+    int32_t y = 0;
+    int32_t xrel = 0;
+    int32_t yrel = 0;
+    uint64_t entityId = 0; // Spawned entity
+};
+
+// Records the input and delta time of every frame to a compact binary file and
+// plays it back. Spawns made by scripts are recorded as markers, on playback
+// they are checked against the recording so diverging runs are reported.
+class InputRecorder {
+  public:
+    enum class Mode { Off, Record, Playback };
+
+  private:
+    Mode mode = Mode::Off;
+    std::fstream file;
+    uint64_t frameIndex = 0;
+    bool diverged = false;
+
+    double deltaTime = 0.0;
+    std::vector<InputEvent> events;
+    std::vector<InputEvent> spawns;
+    EventHandle spawnListener;
+
+    void writeFrame();
+    bool readFrame();
+    void onSpawn(PrimitiveType type, uint64_t entityId);
+
+  public:
+    InputRecorder() = default;
+    InputRecorder(const InputRecorder&) = delete;
+    InputRecorder& operator=(const InputRecorder&) = delete;
+    ~InputRecorder();
+
+    bool Open(const std::string& path, Mode mode);
+    void Close();
+
+    // Playback: loads the next frame, returns false once the recording ends.
+    bool BeginFrame();
+    // Record: writes the frame to disk. Playback: checks the spawns.
+    void EndFrame();
+
+    void RecordEvent(const InputEvent& event);
+    void RecordDeltaTime(double deltaTime);
+
+    inline Mode GetMode() const { return mode; }
+    inline bool IsRecording() const { return mode == Mode::Record; }
+    inline bool IsPlaying() const { return mode == Mode::Playback; }
+    inline bool HasDiverged() const { return diverged; }
+    inline uint64_t GetFrameIndex() const { return frameIndex; }
+    inline double GetFrameDeltaTime() const { return deltaTime; }
+    inline const std::vector<InputEvent>& GetFrameEvents() const {
+        return events;
+    }
+};
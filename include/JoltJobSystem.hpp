@@ -0,0 +1,27 @@
+#pragma once
+#include <Jolt/Jolt.h>
+#include <Jolt/Core/JobSystemWithBarrier.h>
+#include "TaskSystem.hpp"
+
+// Runs the jobs of the physics step on the engine TaskSystem, so Jolt shares
+// the workers with everything else instead of keeping its own threads.
+class JoltJobSystem : public JPH::JobSystemWithBarrier {
+  private:
+    TaskSystem& tasks;
+    int maxConcurrency;
+
+  protected:
+    void QueueJob(Job* job) override;
+    void QueueJobs(Job** jobs, JPH::uint count) override;
+    void FreeJob(Job* job) override;
+
+  public:
+    // maxConcurrency is the number of threads Jolt splits its work for
+    JoltJobSystem(TaskSystem& tasks, JPH::uint maxBarriers,
+                  int maxConcurrency);
+
+    int GetMaxConcurrency() const override { return maxConcurrency; }
+    JobHandle CreateJob(const char* name, JPH::ColorArg color,
+                        const JobFunction& function,
+                        JPH::uint32 numDependencies = 0) override;
+};
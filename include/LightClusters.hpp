@@ -0,0 +1,61 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include "FrameSnapshot.hpp"
+
+// Assigns point and spot lights to clusters, the view frustum cut into
+// CLUSTER_X * CLUSTER_Y screen tiles and CLUSTER_Z depth slices. The slices
+// grow exponentially with distance, like the precision of the depth buffer.
+// The lighting shader finds the cluster of each pixel and only shades the
+// lights listed for it.
+//
+// The results are laid out for float textures:
+// - Lights: MAX_LIGHTS x 3 RGBA32F, one LightItem member per row
+// - Clusters: CLUSTER_X * CLUSTER_Y x CLUSTER_Z RG32F, the offset and count
+//   of the cluster's lights in the index list
+// - Indices: INDEX_WIDTH wide R32F, as many rows as the list needs
+class LightClusters {
+  public:
+    static constexpr uint32_t CLUSTER_X = 16;
+    static constexpr uint32_t CLUSTER_Y = 9;
+    static constexpr uint32_t CLUSTER_Z = 24;
+    static constexpr uint32_t MAX_LIGHTS = 1024;
+    static constexpr uint32_t INDEX_WIDTH = 1024;
+    static constexpr uint32_t INDEX_HEIGHT = 256;
+
+  private:
+    // Clusters a light touches, inclusive
+    struct Range {
+        uint32_t minX, maxX;
+        uint32_t minY, maxY;
+        uint32_t minZ, maxZ;
+    };
+
+    std::vector<float> lights;
+    std::vector<float> clusters;
+    std::vector<float> indices;
+    std::vector<Range> ranges;
+    std::vector<uint32_t> counts;
+    uint32_t lightCount = 0;
+    uint32_t indexCount = 0;
+
+    uint32_t slice(float depth, float nearPlane, float farPlane) const;
+
+  public:
+    LightClusters();
+
+    // Lights past MAX_LIGHTS, or past the room in the index list, are left
+    // out with a warning
+    void Build(const std::vector<LightItem>& items, const float view[16],
+               const float projection[16], float nearPlane, float farPlane);
+
+    inline const std::vector<float>& GetLights() const { return lights; }
+    inline const std::vector<float>& GetClusters() const { return clusters; }
+    // Padded to whole rows of INDEX_WIDTH
+    inline const std::vector<float>& GetIndices() const { return indices; }
+    inline uint32_t GetLightCount() const { return lightCount; }
+    inline uint32_t GetIndexRows() const {
+        return (indexCount + INDEX_WIDTH - 1) / INDEX_WIDTH;
+    }
+};
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class LuaProfiler;
+
+// lua_Alloc implementation that serves small blocks from per size class free
+// lists carved out of large chunks, so the many short lived strings, tables
+// and closures Lua creates do not go through malloc. Larger blocks fall back
+// to realloc. Allocations are reported to the profiler, if any, so they can be
+// accounted to the script or task that made them.
+class LuaAllocator {
+  public:
+    static constexpr size_t NUM_CLASSES = 8;
+    static constexpr size_t MAX_SMALL_SIZE = 256;
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+  private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    FreeBlock* freeLists[NUM_CLASSES] = {};
+    char* bumpPtr[NUM_CLASSES] = {};
+    char* bumpEnd[NUM_CLASSES] = {};
+    std::vector<void*> chunks;
+    LuaProfiler* profiler;
+
+    size_t liveBytes = 0;
+    size_t peakBytes = 0;
+    size_t pooledBytes = 0; // Live bytes served from the pools
+
+    void* allocSmall(size_t sizeClass);
+    void freeSmall(void* ptr, size_t sizeClass);
+    void* allocate(size_t size);
+    void deallocate(void* ptr, size_t size);
+
+  public:
+    explicit LuaAllocator(LuaProfiler* profiler = nullptr)
+        : profiler(profiler) {}
+    LuaAllocator(const LuaAllocator&) = delete;
+    LuaAllocator& operator=(const LuaAllocator&) = delete;
+    ~LuaAllocator();
+
+    // Passed to lua_newstate with the allocator as ud.
+    static void* Alloc(void* ud, void* ptr, size_t osize, size_t nsize);
+
+    inline size_t GetLiveBytes() const { return liveBytes; }
+    inline size_t GetPeakBytes() const { return peakBytes; }
+    inline size_t GetPooledBytes() const { return pooledBytes; }
+    inline size_t GetChunkBytes() const { return chunks.size() * CHUNK_SIZE; }
+};
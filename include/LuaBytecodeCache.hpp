@@ -0,0 +1,26 @@
+#pragma once
+#include <lua.hpp>
+#include <string>
+
+// Caches compiled Lua chunks on disk so scripts are only parsed when they
+// change. Entries are keyed by the script path and validated against its
+// modification time, size and a hash of its contents.
+class LuaBytecodeCache {
+  public:
+    LuaBytecodeCache(std::string directory = ".loonar-cache");
+    ~LuaBytecodeCache() = default;
+
+    // Pushes the compiled chunk for the script, like luaL_loadfile. Uses the
+    // cached bytecode when it is up to date, otherwise compiles the source and
+    // refreshes the cache entry.
+    int Load(lua_State* L, const std::string& path) const;
+
+    inline void SetEnabled(bool enabled) { this->enabled = enabled; }
+    inline bool IsEnabled() const { return enabled; }
+
+  private:
+    std::string directory;
+    bool enabled = true;
+
+    std::string entryPath(const std::string& path) const;
+};
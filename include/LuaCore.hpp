@@ -1,7 +1,13 @@
 #pragma once
 #include <lua.hpp>
 #include <string>
+#include "LuaSceneService.hpp"
 #include "LuaWindowService.hpp"
+#include "EventDispatcher.hpp"
+#include "LuaBytecodeCache.hpp"
+#include "LuaScheduler.hpp"
+#include "LuaAllocator.hpp"
+#include "LuaProfiler.hpp"
 #include <sol/sol.hpp>
 
 // The Lua core helps with functions and utility surrounding lua.
@@ -14,25 +20,58 @@ class LuaCore {
 
     // Prepares and runs the specified Lua script.
     void Run(std::string path) const;
+    // Disconnects the signal handlers and cancels the tasks the script
+    // started on its last run, then runs it again in the same state. Scene
+    // objects it created are kept, the global IsReloading is true while it
+    // runs.
+    void Reload(std::string path);
     // Sets a global variable in the Lua state. Currently only works with
     // strings.FIXME
     void SetGlobal(std::string name, std::string value) const;
     std::string GetGlobal(std::string name) const;
 
+    // Queues a LuaSignal send without any arguments, the callbacks run when
+    // the PreRender phase is flushed.
     void FireSignal(LuaSignal* signal) const;
 
+    inline LuaBytecodeCache& GetBytecodeCache() { return bytecodeCache; }
+
+    // Resumes the scheduled Lua tasks, called once per frame.
+    void Update(double deltaTime);
+    inline LuaScheduler& GetScheduler() { return scheduler; }
+
+    // Switches the collector to incremental mode, parameters left at 0 keep
+    // their current value. See collectgarbage("incremental") in the manual.
+    void SetIncrementalGC(int pause = 0, int stepMul = 0,
+                          int stepSize = 0) const;
+    // Switches the collector to generational mode, parameters left at 0 keep
+    // their current value.
+    void SetGenerationalGC(int minorMul = 0, int majorMul = 0) const;
+    // Performs a collector step of about kilobytes of work in every Update,
+    // spreading the collection over frames. 0 disables the extra steps.
+    inline void SetGCStepPerFrame(int kilobytes) { gcStepKB = kilobytes; }
+    inline const LuaAllocator& GetAllocator() const { return allocator; }
+
     inline static const std::string Version = "0.1.3";
 
     // LuaService Instances
     LuaWindowService WindowService;
+    LuaSceneService SceneService;
 
   private:
     static const struct luaL_Reg overrides[];
 
-    void prepare(std::string path) const;
+    bool prepare(std::string path) const;
+    void disconnectScript(const std::string& path);
     void pcall(int narg, int nres, int errfunc) const;
     void registerGlobalFunction(lua_CFunction func, std::string luaFName) const;
     void overrideLuaLibFunctions() const;
 
+    // Declared before L so it outlives the state
+    LuaAllocator allocator;
     lua_State* L;
+    int gcStepKB = 0;
+    EventHandle signalListener;
+    LuaBytecodeCache bytecodeCache;
+    LuaScheduler scheduler;
 };
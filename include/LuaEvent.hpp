@@ -1,9 +1,9 @@
 #pragma once
 #include "EventDispatcher.hpp"
-#include "LuaExporter.hpp"
-#include <SDL_events.h>
+#include "LuaUtil.hpp"
+#include "LuaProfiler.hpp"
 #include <lua.hpp>
-#include <string>
+#include <iostream>
 #include "LuaDebug.hpp"
 #include "lauxlib.h"
 #include "lua.h"
@@ -11,26 +11,27 @@
 // Lua Event is the class that will be used to create events in Lua
 //  It can be used to create events that can be triggered from C++
 //  and can be connected to Lua functions or create custom ones for gameplay
-//  logic
+//  logic. Event is the C++ event struct sent through the EventDispatcher.
 
-class LuaEvent {
+template <typename Event> class LuaEvent {
   public:
-    LuaEvent(std::string eventName) : m_eventName(eventName) {};
+    LuaEvent() {};
     ~LuaEvent() { std::cout << "LuaEvent destroyed" << std::endl; };
 
     static int luaConnect(lua_State* L) {
         LuaDebug::PrintStack(L);
-        LuaEvent* self =
-            MetatableRegistry::Get().check_userdata<LuaEvent>(L, 1);
+        LuaUtil::Get().CheckUserdata<LuaEvent<Event>>(L, 1);
         luaL_checktype(L, 2, LUA_TFUNCTION);
         lua_pushvalue(L, 2); // Copy the function to the top of the stack
 
         // Store it in the registry (it pops it from the stack)
         int ref = luaL_ref(L, LUA_REGISTRYINDEX);
 
-        // Add it as a listener
-        EventHandle handle = EventDispatcher::Get().AddListener(
-            self->m_eventName, [L, ref](const std::any& payload) {
+        // Add it as a listener, accounted to whoever connected it
+        LuaProfiler::OwnerId owner = LuaProfiler::Get().GetCurrentOwner();
+        EventHandle handle = EventDispatcher::Get().AddListener<Event>(
+            [L, ref, owner](const Event& payload) {
+                LuaProfiler::Scope scope(owner, LuaCallKind::Event);
                 // Push it onto the stack
                 lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
 
@@ -44,23 +45,25 @@ class LuaEvent {
             });
 
         lua_pushinteger(L, handle.id);
-        lua_pushstring(L, self->m_eventName.c_str());
+        lua_pushinteger(L, handle.type);
+        lua_pushinteger(L, ref);
         lua_pushcclosure(
             L,
             [](lua_State* L) -> int {
                 // Get first upvalue "id"
                 size_t id = lua_tointeger(L, lua_upvalueindex(1));
-                // Get second upvalue "eventName"
-                std::string eventName = lua_tostring(L, lua_upvalueindex(2));
-                EventHandle handle{id, eventName};
-                EventDispatcher::Get().RemoveListener(handle);
+                // Get second upvalue "type"
+                EventTypeId type = lua_tointeger(L, lua_upvalueindex(2));
+                EventDispatcher::Get().RemoveListener(EventHandle{id, type});
+                // Get third upvalue "ref" and release the function
+                luaL_unref(L, LUA_REGISTRYINDEX,
+                           lua_tointeger(L, lua_upvalueindex(3)));
                 return 0;
             },
-            2); // 2 upvalues: id and eventName
+            3); // 3 upvalues: id, type and ref
 
+        // Let a script reload remove the connections it made
+        LuaUtil::Get().TrackConnection(L, -1);
         return 1;
     };
-
-  private:
-    std::string m_eventName;
-};
\ No newline at end of file
+};
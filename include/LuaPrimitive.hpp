@@ -11,20 +11,35 @@ class LuaPrimitive {
   public:
     LuaPrimitive(PrimitiveType type);
     LuaPrimitive(PrimitiveType type, LuaMaterial* material);
+    // Wraps an entity that is already in the scene
+    LuaPrimitive(SceneRef<Entity> ref);
     ~LuaPrimitive();
 
     PrimitiveType GetType();
     void SetType(PrimitiveType type);
     void SetPosition(LuaVector3& position);
     LuaVector3 GetPosition();
+    inline Entity* GetEntity() { return m_ref.data; }
 
     static int luaGetType(lua_State* L);
     static int luaSetType(lua_State* L);
     static int luaGetPosition(lua_State* L);
     static int luaSetPosition(lua_State* L);
+    static int luaGetPositionXYZ(lua_State* L);
+    static int luaSetPositionXYZ(lua_State* L);
     static int luaDestroy(lua_State* L);
     static int luaNew(lua_State* L);
 
+    // Bulk functions on the Primitive class table
+    static int luaSpawnMany(lua_State* L);
+    static int luaSetPositions(lua_State* L);
+    static int luaSetVelocities(lua_State* L);
+    static int luaGetPositions(lua_State* L);
+
   private:
     SceneRef<Entity> m_ref;
 };
+
+// Primitive types as numbered on the Lua side
+int PrimitiveTypeToInt(PrimitiveType type);
+PrimitiveType IntToPrimitiveType(int type);
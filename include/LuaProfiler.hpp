@@ -0,0 +1,110 @@
+#pragma once
+#include <lua.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class LuaAllocator;
+
+// What kind of callback a sampled Lua call was made from.
+enum class LuaCallKind { Script, Signal, Event, Task, Count };
+
+// Accounts CPU time and allocations of the main Lua state to the script that
+// owns the running code. Code run by a script owns its signal and event
+// connections and the tasks it spawns, so their cost is added to the script.
+// Times are inclusive, a signal sent from a script counts for both.
+// Only the thread that created the profiler is accounted, scopes entered on
+// other threads do nothing.
+class LuaProfiler {
+  public:
+    using OwnerId = uint32_t;
+    // Everything run outside of a script, like library setup
+    static constexpr OwnerId ENGINE_OWNER = 0;
+
+    struct CallStats {
+        uint64_t calls = 0;
+        int64_t ticks = 0;
+        int64_t maxTicks = 0;
+    };
+    struct OwnerStats {
+        std::string name;
+        CallStats calls[(size_t)LuaCallKind::Count];
+        size_t bytesAllocated = 0;
+        size_t allocations = 0;
+    };
+
+    // Makes owner the current owner for its lifetime and samples the time
+    // spent in it.
+    class Scope {
+      private:
+        OwnerId owner;
+        OwnerId previous;
+        LuaCallKind kind;
+        int64_t start;
+        bool active;
+
+      public:
+        Scope(OwnerId owner, LuaCallKind kind);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+  private:
+    LuaProfiler();
+
+    std::vector<OwnerStats> owners;
+    std::unordered_map<std::string, OwnerId> ownerIds;
+    OwnerId current = ENGINE_OWNER;
+    std::thread::id mainThread;
+    bool enabled = true;
+    const LuaAllocator* allocator = nullptr;
+    double reportInterval = 0.0; // Seconds, 0 disables the periodic report
+    double sinceReport = 0.0;
+
+    static int luaReport(lua_State* L);
+    static int luaGetStats(lua_State* L);
+    static int luaReset(lua_State* L);
+
+  public:
+    static LuaProfiler& Get() {
+        static LuaProfiler instance;
+        return instance;
+    }
+    LuaProfiler(const LuaProfiler&) = delete;
+    LuaProfiler& operator=(const LuaProfiler&) = delete;
+
+    // Registers the global Profiler table in the state.
+    void Init(lua_State* L);
+
+    // Returns the id for the owner name, adding it if it is new.
+    OwnerId GetOwner(const std::string& name);
+    inline OwnerId GetCurrentOwner() const {
+        return std::this_thread::get_id() == mainThread ? current
+                                                        : ENGINE_OWNER;
+    }
+
+    inline void RecordAllocation(size_t bytes) {
+        OwnerStats& stats = owners[current];
+        stats.bytesAllocated += bytes;
+        stats.allocations++;
+    }
+    void RecordCall(OwnerId owner, LuaCallKind kind, int64_t ticks);
+
+    // Prints the stats since the last report when the interval has passed.
+    void Update(double deltaTime);
+    void Report() const;
+    // Clears the counters, owners are kept.
+    void Reset();
+
+    inline const std::vector<OwnerStats>& GetStats() const { return owners; }
+    inline void SetAllocator(const LuaAllocator* allocator) {
+        this->allocator = allocator;
+    }
+    inline void SetEnabled(bool enabled) { this->enabled = enabled; }
+    inline bool IsEnabled() const { return enabled; }
+    inline void SetReportInterval(double seconds) { reportInterval = seconds; }
+};
@@ -0,0 +1,55 @@
+#pragma once
+#include <lua.hpp>
+#include <cfloat>
+#include <glm/glm.hpp>
+#include "LuaPrimitive.hpp"
+#include "LuaType.hpp"
+#include "LuaVector3.hpp"
+#include "SceneManager.hpp"
+
+// Spatial queries against the scene. Both test the entity bounds, not their
+// triangles.
+class LuaSceneService {
+
+  public:
+    LuaSceneService() = default;
+    ~LuaSceneService() = default;
+
+    // Scene:QueryBox(min, max) returns an array of the primitives whose
+    // bounds overlap the box
+    static int luaQueryBox(lua_State* L) {
+        LuaUtil::Get().CheckUserdata<LuaSceneService>(L, 1);
+        glm::vec3 min = LuaUtil::Get().CheckUserdata<LuaVector3>(L, 2)->Get();
+        glm::vec3 max = LuaUtil::Get().CheckUserdata<LuaVector3>(L, 3)->Get();
+        auto refs = SceneManager::Get().QueryBox(min, max);
+        lua_createtable(L, (int)refs.size(), 0);
+        for (size_t i = 0; i < refs.size(); i++) {
+            LuaUtil::Get().CreateAndPush<LuaPrimitive>(L, refs[i]);
+            lua_rawseti(L, -2, (lua_Integer)i + 1);
+        }
+        return 1;
+    }
+
+    // Scene:Raycast(origin, direction, maxDistance?) returns the closest
+    // primitive hit and the distance to it, or nil
+    static int luaRaycast(lua_State* L) {
+        LuaUtil::Get().CheckUserdata<LuaSceneService>(L, 1);
+        glm::vec3 origin =
+            LuaUtil::Get().CheckUserdata<LuaVector3>(L, 2)->Get();
+        glm::vec3 direction =
+            LuaUtil::Get().CheckUserdata<LuaVector3>(L, 3)->Get();
+        float maxDistance = (float)luaL_optnumber(L, 4, FLT_MAX);
+        luaL_argcheck(L, glm::dot(direction, direction) > 0.0f, 3,
+                      "direction must not be zero");
+        float distance;
+        auto ref = SceneManager::Get().Raycast(
+            origin, glm::normalize(direction), maxDistance, distance);
+        if (!ref.data) {
+            lua_pushnil(L);
+            return 1;
+        }
+        LuaUtil::Get().CreateAndPush<LuaPrimitive>(L, ref);
+        lua_pushnumber(L, distance);
+        return 2;
+    }
+};
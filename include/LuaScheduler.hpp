@@ -0,0 +1,66 @@
+#pragma once
+#include <lua.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "LuaProfiler.hpp"
+
+// Runs Lua coroutines for the task library: task.spawn, task.defer and
+// task.wait. Tasks are resumed from Update once per frame until the frame
+// budget is used up, whatever is left over runs on the next frame. A single
+// resume is never interrupted, so the budget only bounds work between yields.
+class LuaScheduler {
+  private:
+    struct Task {
+        int ref = LUA_NOREF;      // Keeps the thread alive in the registry
+        lua_State* thread = nullptr;
+        int nargs = 0;            // Values on the thread stack for the resume
+        double waitStart = 0.0;
+        // The script that spawned the task, its time and allocations are
+        // accounted to it
+        LuaProfiler::OwnerId owner = LuaProfiler::ENGINE_OWNER;
+    };
+    struct Sleeper {
+        double wakeTime;
+        uint64_t order; // Keeps tasks waking at the same time in FIFO order
+        Task task;
+    };
+
+    lua_State* L = nullptr;
+    double time = 0.0;
+    double frameBudget = 0.002; // Seconds
+    uint64_t sleepOrder = 0;
+
+    std::deque<Task> ready;
+    std::vector<Sleeper> sleeping; // Min heap on wakeTime
+
+    static int luaSpawn(lua_State* L);
+    static int luaDefer(lua_State* L);
+    static int luaWait(lua_State* L);
+
+    Task createTask(lua_State* L);
+    void resume(Task task, lua_State* from);
+    void release(Task& task);
+
+  public:
+    LuaScheduler() = default;
+    LuaScheduler(const LuaScheduler&) = delete;
+    LuaScheduler& operator=(const LuaScheduler&) = delete;
+    ~LuaScheduler() = default;
+
+    // Registers the global task table in the state.
+    void Init(lua_State* L);
+
+    // Advances the scheduler clock and resumes the tasks that are due.
+    void Update(double deltaTime);
+
+    // Drops the waiting tasks spawned by owner, they are never resumed again.
+    void CancelOwner(LuaProfiler::OwnerId owner);
+
+    inline void SetFrameBudget(double seconds) { frameBudget = seconds; }
+    inline double GetFrameBudget() const { return frameBudget; }
+    inline size_t GetTaskCount() const {
+        return ready.size() + sleeping.size();
+    }
+};
@@ -4,7 +4,18 @@
 #include <lua.hpp>
 #include "LuaDebug.hpp"
 #include "LuaType.hpp"
-#include <set>
+#include "EventBus.hpp"
+#include "LuaProfiler.hpp"
+#include <map>
+
+// A LuaSignal send waiting on the EventBus. The arguments, with the signal
+// first, are kept in a registry table until delivery.
+struct LuaSignalEvent {
+    // Always the main thread, a coroutine that sent the signal may have
+    // been collected by the time it is delivered
+    lua_State* L = nullptr;
+    int argsRef = LUA_NOREF;
+};
 
 class LuaSignal {
   public:
@@ -16,48 +27,48 @@ class LuaSignal {
         // Store the function in the registry (it pops it from the stack)
         size_t ref = luaL_ref(L, LUA_REGISTRYINDEX);
 
-        auto pair = self->m_callbacksRefs.insert(ref);
+        // The callback is accounted to whoever connected it
+        auto pair = self->m_callbacksRefs.emplace(
+            ref, LuaProfiler::Get().GetCurrentOwner());
         if (!pair.second) {
             std::cerr << "Error: Callback already exists." << std::endl;
             luaL_unref(L, LUA_REGISTRYINDEX, ref); // Unref the function
             return 0;
         }
 
-        // Push a function that allows removing the callback
-        lua_pushcfunction(L, [](lua_State* L) -> int {
-            // Get the ref from closure
-            int ref = lua_tointeger(L, lua_upvalueindex(1));
-
-            // Get self from closure
-            LuaSignal* self =
-                static_cast<LuaSignal*>(lua_touserdata(L, lua_upvalueindex(2)));
-
-            // Remove from callbacks set
-            if (self && self->m_callbacksRefs.erase(ref) > 0) {
-                // Unref the function in registry
-                luaL_unref(L, LUA_REGISTRYINDEX, ref);
-            }
-
-            return 0;
-        });
-
-        // Push ref and self as upvalues for the disconnection function
+        // Push a function that allows removing the callback. It holds on to
+        // the signal so it stays valid for as long as the function exists.
         lua_pushinteger(L, ref);
-        lua_pushlightuserdata(L, self);
-        lua_pushcclosure(L, lua_tocfunction(L, -3), 2);
-
-        // Remove the raw C function we used to create the closure
-        lua_remove(L, -2);
+        lua_pushvalue(L, 1);
+        lua_pushcclosure(L, luaDisconnect, 2);
 
+        // Let a script reload remove the connections it made
+        LuaUtil::Get().TrackConnection(L, -1);
         return 1;
     }
 
+    static int luaDisconnect(lua_State* L) {
+        // Get the ref and self from the closure
+        int ref = lua_tointeger(L, lua_upvalueindex(1));
+        LuaSignal* self =
+            LuaUtil::Get().CheckUserdata<LuaSignal>(L, lua_upvalueindex(2));
+
+        // Remove from callbacks set
+        if (self && self->m_callbacksRefs.erase(ref) > 0) {
+            // Unref the function in registry
+            luaL_unref(L, LUA_REGISTRYINDEX, ref);
+        }
+        return 0;
+    }
+
     static int luaSend(lua_State* L) {
         LuaSignal* self = LuaUtil::Get().CheckUserdata<LuaSignal>(L, 1);
         int n_args = lua_gettop(L) - 1; // Subtract 1 for self
 
         // Process each callback one at a time
-        for (size_t ref : self->m_callbacksRefs) {
+        for (auto [ref, owner] : self->m_callbacksRefs) {
+            LuaProfiler::Scope scope(owner, LuaCallKind::Signal);
+
             // Get the function from the registry
             lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
 
@@ -76,11 +87,53 @@ class LuaSignal {
         return 0;
     }
 
+    // Like Send, but the callbacks run when the EventBus flushes the phase
+    // LuaSignalEvent is delivered in instead of right away.
+    static int luaSendDeferred(lua_State* L) {
+        LuaUtil::Get().CheckUserdata<LuaSignal>(L, 1);
+        int n = lua_gettop(L);
+        lua_createtable(L, n, 0);
+        for (int i = 1; i <= n; i++) {
+            lua_pushvalue(L, i);
+            lua_rawseti(L, -2, i);
+        }
+        int ref = luaL_ref(L, LUA_REGISTRYINDEX);
+        lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+        lua_State* mainThread = lua_tothread(L, -1);
+        lua_pop(L, 1);
+        EventBus::Get().Post(LuaSignalEvent{mainThread, ref});
+        return 0;
+    }
+
+    static void Deliver(const LuaSignalEvent& event) {
+        lua_State* L = event.L;
+        lua_pushcfunction(L, luaSend);
+        lua_rawgeti(L, LUA_REGISTRYINDEX, event.argsRef);
+        int args = lua_gettop(L);
+        int n = (int)lua_rawlen(L, args);
+        for (int i = 1; i <= n; i++) {
+            lua_rawgeti(L, args, i);
+        }
+        lua_remove(L, args);
+        luaL_unref(L, LUA_REGISTRYINDEX, event.argsRef);
+
+        if (lua_pcall(L, n, 0, 0) != LUA_OK) {
+            std::cerr << "Error sending deferred signal: "
+                      << lua_tostring(L, -1) << std::endl;
+            lua_pop(L, 1);
+        }
+    }
+
+    static void Release(const LuaSignalEvent& event) {
+        luaL_unref(event.L, LUA_REGISTRYINDEX, event.argsRef);
+    }
+
     static int luaNew(lua_State* L) {
         LuaUtil::Get().CreateAndPush<LuaSignal>(L);
         return 1;
     }
 
   private:
-    std::set<size_t> m_callbacksRefs;
+    // Callback refs and the profiler owner that connected them
+    std::map<size_t, LuaProfiler::OwnerId> m_callbacksRefs;
 };
\ No newline at end of file
@@ -3,6 +3,8 @@
 #include <iostream>
 #include <ostream>
 #include <string>
+#include <utility>
+#include <vector>
 #include "LuaUtil.hpp"
 #include "LuaDebug.hpp"
 
@@ -36,18 +38,30 @@ template <typename T> class LuaType {
         lua_pop(L, 1); // Pop the metatable off the stack
         return *this;
     }
+    // Adds a function to the class table, called as Name.Function(...)
+    LuaType& AddStaticFunction(std::string name, lua_CFunction func) {
+        staticFunctions.emplace_back(std::move(name), func);
+        return *this;
+    }
+    // Getters are called with self, setters with self and the new value.
+    // Either may be nullptr.
     LuaType& AddProperty(std::string name, lua_CFunction getter,
                          lua_CFunction setter) {
         push_metatable();
-        lua_getfield(L, -1, "__get");
-        lua_pushcfunction(L, getter);
-        lua_setfield(L, -2, name.c_str());
-        lua_pop(L, 1); // Pop __get off the stack
+        if (getter != nullptr) {
+            lua_getfield(L, -1, "__get");
+            lua_pushcfunction(L, getter);
+            lua_setfield(L, -2, name.c_str());
+            lua_pop(L, 1); // Pop __get off the stack
+        }
 
-        lua_getfield(L, -1, "__set");
-        lua_pushcfunction(L, setter);
-        lua_setfield(L, -2, name.c_str());
-        lua_pop(L, 2); // Pop __set and the metatable off the stack
+        if (setter != nullptr) {
+            lua_getfield(L, -1, "__set");
+            lua_pushcfunction(L, setter);
+            lua_setfield(L, -2, name.c_str());
+            lua_pop(L, 1); // Pop __set off the stack
+        }
+        lua_pop(L, 1); // Pop the metatable off the stack
         return *this;
     }
 
@@ -64,6 +78,11 @@ template <typename T> class LuaType {
         lua_pushcfunction(L, constructor);
         lua_setfield(L, -2, "new"); // Set the constructor function
 
+        for (const auto& [name, func] : staticFunctions) {
+            lua_pushcfunction(L, func);
+            lua_setfield(L, -2, name.c_str());
+        }
+
         lua_setglobal(L, metatable_name); // Set the class table as a global
     };
     void MakeSingleton(T* instance) {
@@ -77,6 +96,7 @@ template <typename T> class LuaType {
   private:
     lua_State* L;
     const char* metatable_name;
+    std::vector<std::pair<std::string, lua_CFunction>> staticFunctions;
     void push_metatable() {
         luaL_getmetatable(L, metatable_name);
         if (lua_isnil(L, -1)) {
@@ -85,85 +105,53 @@ template <typename T> class LuaType {
             lua_pop(L, 1);
         }
     }
+    // The __get and __methods tables are captured as upvalues of __index, so
+    // a lookup never has to find the metatable by name.
     void allow_getters() {
         push_metatable();
-        lua_CFunction fn = LuaType<T>::__index_wrapper();
-        lua_pushcfunction(L, fn);
-        lua_setfield(L, -2, "__index"); // Pop the metatable off the stack
-        lua_pop(L, 1);
+        lua_getfield(L, -1, "__get");
+        lua_getfield(L, -2, "__methods");
+        lua_pushcclosure(L, LuaType<T>::__index, 2);
+        lua_setfield(L, -2, "__index");
+        lua_pop(L, 1); // Pop the metatable off the stack
     }
     void allow_setters() {
         push_metatable();
-        lua_CFunction fn = LuaType<T>::__newindex_wrapper();
-        lua_pushcfunction(L, fn);
-        lua_setfield(L, -2, "__newindex"); // Pop the metatable off the stack
-        lua_pop(L, 1);
+        lua_getfield(L, -1, "__set");
+        lua_pushcclosure(L, LuaType<T>::__newindex, 1);
+        lua_setfield(L, -2, "__newindex");
+        lua_pop(L, 1); // Pop the metatable off the stack
     }
 
-    static lua_CFunction __index_wrapper() {
-        return [](lua_State* L) -> int {
-            T* obj = LuaUtil::Get().CheckUserdata<T>(L, 1);
-            const char* index = luaL_checkstring(L, 2);
-            lua_pop(L, 1); // Pop the key off the stack
-
-            const char* mtName = LuaUtil::Get().GetTypeName<T>();
-            luaL_getmetatable(L, mtName);
-
-            lua_getfield(L, -1, "__get");
-            lua_getfield(L, -1, index);
-            if (lua_isnil(L, -1)) {
-                // We have no getter function, check __methods
-                lua_pop(L, 2); // Pop nil and __get
-                lua_getfield(L, -1, "__methods");
-                lua_getfield(L, -1, index);
-                return 1;
-            }
-
-            // We have the getter function on the top of the stack, we need to
-            // call it with self as the first argument and no other arguments
-            auto getter = lua_tocfunction(L, -1);
-            lua_pop(
-                L,
-                3); // Pop the function, __get and the metatable off the stack
-            lua_pushcfunction(L, getter);
-            lua_insert(L, -2); // Move the getter one step down
-            if (lua_pcall(L, 1, 1, 0) != LUA_OK) {
-                const char* error = lua_tostring(L, -1);
-                std::cerr << "Error in __index: " << error << std::endl;
-                lua_pop(L, 1); // Pop the error message off the stack
-                return 0;
-            }
-            return 1;
-        };
+    // Only called for userdata with this metatable, so self is not checked
+    // here. The getter checks it as usual.
+    static int __index(lua_State* L) {
+        lua_settop(L, 2);
+        lua_pushvalue(L, 2);
+        if (lua_rawget(L, lua_upvalueindex(1)) != LUA_TNIL) {
+            // Call the getter directly with self as the only argument, errors
+            // propagate to the script like any other call
+            lua_CFunction getter = lua_tocfunction(L, -1);
+            lua_settop(L, 1);
+            return getter(L);
+        }
+        lua_pop(L, 1); // Pop nil, leaving the key on top
+        lua_rawget(L, lua_upvalueindex(2));
+        return 1;
     }
 
-    static lua_CFunction __newindex_wrapper() {
-
-        return [](lua_State* L) -> int {
-            T* obj = LuaUtil::Get().CheckUserdata<T>(L, 1);
-            const char* index = luaL_checkstring(L, 2);
-            lua_pop(L, 1); // Pop the key off the stack
-
-            const char* mtName = LuaUtil::Get().GetTypeName<T>();
-            luaL_getmetatable(L, mtName);
-            lua_getfield(L, -1, "__set");
-            lua_getfield(L, -1, index);
-            if (lua_isnil(L, -1)) {
-                return 0;
-            }
-
-            auto setter = lua_tocfunction(L, -1);
-            lua_pop(
-                L,
-                3); // Pop the function, __set and the metatable off the stack
-            lua_pushcfunction(L, setter);
-            lua_insert(L, -2); // Move the setter one step down
-            if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
-                const char* error = lua_tostring(L, -1);
-                std::cerr << "Error in __newindex: " << error << std::endl;
-                lua_pop(L, 1); // Pop the error message off the stack
-            }
+    static int __newindex(lua_State* L) {
+        lua_settop(L, 3);
+        lua_pushvalue(L, 2);
+        if (lua_rawget(L, lua_upvalueindex(1)) == LUA_TNIL) {
             return 0;
-        };
+        }
+
+        // Call the setter with self and the value
+        lua_CFunction setter = lua_tocfunction(L, -1);
+        lua_settop(L, 3);
+        lua_remove(L, 2); // Remove the key
+        setter(L);
+        return 0;
     }
 };
\ No newline at end of file
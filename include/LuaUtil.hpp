@@ -1,11 +1,22 @@
+#pragma once
 #include "LuaDebug.hpp"
 #include <iostream>
 #include <typeindex>
 #include <string>
 #include <stdexcept>
+#include <type_traits>
 #include <unordered_map>
 #include <lua.hpp>
 
+// Name and metadata of a registered type, resolved at compile time through the
+// template instead of a type_index lookup on every call.
+template <typename T> struct LuaTypeInfo {
+    static inline std::string name;
+    static inline bool registered = false;
+    static inline bool is_reference_type = false;
+    static inline bool auto_gc = true;
+};
+
 class LuaUtil {
   private:
     // Private constructor prevents external instantiation
@@ -19,7 +30,6 @@ class LuaUtil {
             false;           // Whether this is typically passed by reference
         bool auto_gc = true; // Whether Lua should automatically GC this
     };
-    std::unordered_map<std::type_index, TypeMetadata> m_typeMetadata;
 
     // Setup a metatable with common metamethods (for no only __gc)
     template <typename T> void setup_metatable(lua_State* L) {
@@ -29,8 +39,12 @@ class LuaUtil {
 
         // Create metatable if it doesn't exist
         if (luaL_newmetatable(L, metatable_name)) {
-            // Set __gc if auto_gc is true
-            if (metadata.auto_gc) {
+            // Set __gc if auto_gc is true. Value types with a trivial
+            // destructor have nothing to clean up, skipping the finalizer
+            // keeps them cheap for the collector.
+            bool trivial = !metadata.is_reference_type &&
+                           std::is_trivially_destructible_v<T>;
+            if (metadata.auto_gc && !trivial) {
                 lua_pushstring(L, "__gc");
                 lua_pushcfunction(L, create_gc_function<T>());
                 lua_settable(L, -3);
@@ -85,14 +99,11 @@ class LuaUtil {
     }
 
     template <typename T> TypeMetadata get_type_metadata() const {
-        auto type_index = std::type_index(typeid(T));
-        auto it = m_typeMetadata.find(type_index);
-        if (it != m_typeMetadata.end()) {
-            return it->second;
-        } else {
+        if (!LuaTypeInfo<T>::registered) {
             throw std::runtime_error("Type metadata not found for type " +
-                                     std::string(type_index.name()));
+                                     std::string(typeid(T).name()));
         }
+        return {LuaTypeInfo<T>::is_reference_type, LuaTypeInfo<T>::auto_gc};
     }
 
   public:
@@ -111,10 +122,10 @@ class LuaUtil {
         m_typeRegistry[type_idx] = name;
 
         // Store some metadata about the type
-        TypeMetadata metadata;
-        metadata.is_reference_type = is_reference_type;
-        metadata.auto_gc = auto_gc;
-        m_typeMetadata[type_idx] = metadata;
+        LuaTypeInfo<T>::name = name;
+        LuaTypeInfo<T>::is_reference_type = is_reference_type;
+        LuaTypeInfo<T>::auto_gc = auto_gc;
+        LuaTypeInfo<T>::registered = true;
 
         // Register the metatable in Lua
         setup_metatable<T>(L);
@@ -133,15 +144,16 @@ class LuaUtil {
 
     // Get the metatable name for a C++ type
     template <typename T> const char* GetTypeName() const {
-        auto type_index = std::type_index(typeid(T));
-        return GetTypeName(type_index);
+        if (!LuaTypeInfo<T>::registered) {
+            throw std::runtime_error("Could not find metatable for type " +
+                                     std::string(typeid(T).name()));
+        }
+        return LuaTypeInfo<T>::name.c_str();
     }
 
     // Create an new instance of a registered type and push to Lua stack
     template <typename T, typename... Args>
     T* CreateAndPush(lua_State* L, Args&&... args) {
-        std::type_index type_index(typeid(T));
-
         // Check if we have metadata for this type
         bool is_reference = get_type_metadata<T>().is_reference_type;
 
@@ -169,11 +181,10 @@ class LuaUtil {
     // Helper to check if a userdata is of a specific type
     template <typename T> T* CheckUserdata(lua_State* L, int index) const {
         // Get metatable name for this type
-        const char* metatable_name = GetTypeName<T>();
+        const char* metatable_name = LuaTypeInfo<T>::name.c_str();
 
         // Check if reference type
-        bool is_reference = get_type_metadata<T>().is_reference_type;
-        if (is_reference) {
+        if (LuaTypeInfo<T>::is_reference_type) {
             // If reference type, we're storing a pointer to T
             T** ptr =
                 static_cast<T**>(luaL_checkudata(L, index, metatable_name));
@@ -203,6 +214,41 @@ class LuaUtil {
         return *userdata;
     }
 
+    // Registry keys used to remember which script made which connections, so
+    // they can be disconnected when the script is reloaded.
+    static constexpr const char* CURRENT_SCRIPT_KEY = "loonar.script";
+    static constexpr const char* CONNECTIONS_KEY = "loonar.connections";
+
+    // Records the disconnect function at index against the script currently
+    // being run. Does nothing outside of a script run.
+    void TrackConnection(lua_State* L, int index) {
+        index = lua_absindex(L, index);
+        if (lua_getfield(L, LUA_REGISTRYINDEX, CURRENT_SCRIPT_KEY) !=
+            LUA_TSTRING) {
+            lua_pop(L, 1);
+            return;
+        }
+        if (lua_getfield(L, LUA_REGISTRYINDEX, CONNECTIONS_KEY) !=
+            LUA_TTABLE) {
+            lua_pop(L, 1);
+            lua_newtable(L);
+            lua_pushvalue(L, -1);
+            lua_setfield(L, LUA_REGISTRYINDEX, CONNECTIONS_KEY);
+        }
+        // Stack: script, connections
+        lua_pushvalue(L, -2);
+        if (lua_rawget(L, -2) != LUA_TTABLE) {
+            lua_pop(L, 1);
+            lua_newtable(L);
+            lua_pushvalue(L, -3);
+            lua_pushvalue(L, -2);
+            lua_rawset(L, -4);
+        }
+        lua_pushvalue(L, index);
+        lua_rawseti(L, -2, (lua_Integer)lua_rawlen(L, -2) + 1);
+        lua_pop(L, 3); // Pop the script list, connections and script
+    }
+
     void PushLibraryMetatable(lua_State* L) {
         const char* library_metatable_name = "Library";
         if (!luaL_getmetatable(L, library_metatable_name)) {
@@ -7,7 +7,8 @@ class LuaVector3 {
     LuaVector3();
     LuaVector3(glm::vec3 vec);
     LuaVector3(float x, float y, float z);
-    ~LuaVector3();
+    // Kept trivial so Vector3 userdata does not need a __gc finalizer
+    ~LuaVector3() = default;
 
     float GetX() const;
     float GetY() const;
@@ -29,6 +30,11 @@ class LuaVector3 {
     static int luaDot(lua_State* L);
     static int luaCross(lua_State* L);
     static int luaNormalize(lua_State* L);
+    static int luaUnpack(lua_State* L);
+    static int luaSet(lua_State* L);
+    static int luaAddInPlace(lua_State* L);
+    static int luaSubInPlace(lua_State* L);
+    static int luaScaleInPlace(lua_State* L);
     static int luaNew(lua_State* L);
     static int lua__add(lua_State* L);
     static int lua__sub(lua_State* L);
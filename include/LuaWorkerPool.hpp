@@ -0,0 +1,137 @@
+#pragma once
+#include <lua.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Enums.hpp"
+#include "LuaAllocator.hpp"
+#include "LuaScheduler.hpp"
+#include "TaskSystem.hpp"
+
+// A scene change recorded by a worker script, applied on the main thread at
+// the next sync point.
+struct SceneCommand {
+    enum class Type { Spawn, SetPosition, SetVelocity, AddImpulse, Destroy };
+    Type type;
+    uint64_t entityId = 0;
+    glm::vec3 value = glm::vec3(0.0f);
+    PrimitiveType primitive = PrimitiveType::Cube;
+};
+
+// Entity positions as of the last sync point, read by the worker scripts
+// while the main thread carries on with the next frame.
+struct SceneSnapshot {
+    std::unordered_map<uint64_t, glm::vec3> positions;
+};
+
+// A value sent over a signal. Only plain values can move between states.
+struct LuaMessageValue {
+    int type = LUA_TNIL;
+    bool boolean = false;
+    bool isInteger = false;
+    lua_Integer integer = 0;
+    lua_Number number = 0.0;
+    std::string string;
+};
+
+struct LuaMessage {
+    std::string signal;
+    std::vector<LuaMessageValue> args;
+};
+
+// An isolated Lua state with its own allocator and task scheduler. Scripts in
+// it can read the scene snapshot, record scene commands and talk to the other
+// workers through named signals, but share nothing else.
+class LuaWorker {
+  private:
+    // Declared before L so it outlives the state
+    LuaAllocator allocator;
+    lua_State* L;
+    LuaScheduler scheduler;
+    size_t index;
+    const SceneSnapshot* snapshot;
+
+    std::vector<SceneCommand> commands;
+    std::vector<LuaMessage> outbox;
+
+    static LuaWorker* getWorker(lua_State* L);
+    static int luaSpawn(lua_State* L);
+    static int luaGetEntities(lua_State* L);
+    static int luaGetPosition(lua_State* L);
+    static int luaSetPosition(lua_State* L);
+    static int luaSetVelocity(lua_State* L);
+    static int luaAddImpulse(lua_State* L);
+    static int luaDestroy(lua_State* L);
+    static int luaNewSignal(lua_State* L);
+    static int luaSend(lua_State* L);
+    static int luaOnReceive(lua_State* L);
+    static int luaDisconnect(lua_State* L);
+    static int luaPrint(lua_State* L);
+
+    void pushCommand(lua_State* L, SceneCommand::Type type);
+    void deliver(const LuaMessage& message);
+
+  public:
+    LuaWorker(size_t index, const SceneSnapshot& snapshot);
+    LuaWorker(const LuaWorker&) = delete;
+    LuaWorker& operator=(const LuaWorker&) = delete;
+    ~LuaWorker();
+
+    // Runs a script in this worker's state. Only call while the pool is not
+    // running.
+    bool Run(const std::string& path);
+    // Delivers the signal messages and resumes the due tasks.
+    void Update(double deltaTime, const std::vector<LuaMessage>& messages);
+
+    inline std::vector<SceneCommand>& GetCommands() { return commands; }
+    inline std::vector<LuaMessage>& GetOutbox() { return outbox; }
+    inline const LuaAllocator& GetAllocator() const { return allocator; }
+    inline LuaScheduler& GetScheduler() { return scheduler; }
+};
+
+// Runs scripts that do not share state in separate Lua states, updated as
+// tasks on the TaskSystem. Each frame the main thread calls Sync, which waits
+// for the workers, applies their scene commands, routes signal messages and
+// takes a new scene snapshot, then Kick to start the next update. The workers
+// run while the main thread renders and steps physics.
+class LuaWorkerPool {
+  private:
+    std::vector<std::unique_ptr<LuaWorker>> workers;
+    // Update of each worker started by the last Kick
+    std::vector<TaskHandle> updates;
+    size_t nextWorker = 0;
+
+    SceneSnapshot snapshot;
+    // Sent during the last update, delivered to every worker in the next
+    std::vector<LuaMessage> messages;
+
+    void applyCommands(std::vector<SceneCommand>& commands);
+    void takeSnapshot();
+
+  public:
+    LuaWorkerPool() = default;
+    LuaWorkerPool(const LuaWorkerPool&) = delete;
+    LuaWorkerPool& operator=(const LuaWorkerPool&) = delete;
+    ~LuaWorkerPool();
+
+    // Creates count workers, each with its own state.
+    void Init(size_t count);
+    void Shutdown();
+
+    // Runs the script on the next worker in turn. Scripts are spread evenly,
+    // so scripts that need to share globals belong in the main LuaCore.
+    bool AddScript(const std::string& path);
+
+    // Starts updating all workers on the task system.
+    void Kick(double deltaTime);
+    // Waits for the workers and applies what they did. Must be called
+    // between two Kicks, and before anything else touches the workers.
+    void Sync();
+
+    inline size_t GetWorkerCount() const { return workers.size(); }
+    inline LuaWorker& GetWorker(size_t index) { return *workers[index]; }
+};
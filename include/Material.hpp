@@ -2,11 +2,15 @@
 
 #include <cstdint>
 #include <glm/glm.hpp>
+#include "World.hpp"
 
 class Material {
   private:
     uint64_t albedoId;
     uint64_t normalId;
+    // Packed into the spare G-buffer channels, both in [0, 1]
+    float roughness = 0.7f;
+    float specular = 0.2f;
 
   public:
     Material(uint64_t albedoId, uint64_t normalId)
@@ -19,4 +23,17 @@ class Material {
 
     inline uint64_t GetAlbedoId() const { return albedoId; }
     inline uint64_t GetNormalId() const { return normalId; }
+    inline float GetRoughness() const { return roughness; }
+    inline float GetSpecular() const { return specular; }
+
+    // The frame snapshot copies materials along with the draws, so these
+    // make it rebuild them
+    inline void SetRoughness(float roughness) {
+        this->roughness = glm::clamp(roughness, 0.0f, 1.0f);
+        World::Get().MarkLayoutChanged();
+    }
+    inline void SetSpecular(float specular) {
+        this->specular = glm::clamp(specular, 0.0f, 1.0f);
+        World::Get().MarkLayoutChanged();
+    }
 };
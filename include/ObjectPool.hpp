@@ -0,0 +1,96 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Stores objects of one type in fixed size chunks. Freed slots go on a free
+// list and are reused before the pool grows, so objects stay packed.
+// Pointers stay valid until the object is destroyed, chunks are never moved.
+template <typename T, size_t CHUNK_SIZE = 256> class ObjectPool {
+  private:
+    struct Slot {
+        alignas(T) unsigned char storage[sizeof(T)];
+        Slot* next = nullptr; // Free list link while the slot is unused
+        bool alive = false;
+    };
+
+    std::vector<std::unique_ptr<Slot[]>> chunks;
+    Slot* freeList = nullptr;
+    size_t count = 0;
+
+    void grow() {
+        chunks.push_back(std::make_unique<Slot[]>(CHUNK_SIZE));
+        Slot* chunk = chunks.back().get();
+        // Link the new slots in order so they are handed out front to back
+        for (size_t i = 0; i < CHUNK_SIZE - 1; i++) {
+            chunk[i].next = &chunk[i + 1];
+        }
+        chunk[CHUNK_SIZE - 1].next = freeList;
+        freeList = chunk;
+    }
+
+    static Slot* slotOf(T* object) { return reinterpret_cast<Slot*>(object); }
+
+  public:
+    ObjectPool() = default;
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+    ~ObjectPool() { Clear(); }
+
+    template <typename... Args> T* Create(Args&&... args) {
+        if (freeList == nullptr) {
+            grow();
+        }
+        Slot* slot = freeList;
+        T* object = new (slot->storage) T(std::forward<Args>(args)...);
+        freeList = slot->next;
+        slot->alive = true;
+        count++;
+        return object;
+    }
+
+    // The object must have been created by this pool.
+    void Destroy(T* object) {
+        if (object == nullptr) {
+            return;
+        }
+        Slot* slot = slotOf(object);
+        object->~T();
+        slot->alive = false;
+        slot->next = freeList;
+        freeList = slot;
+        count--;
+    }
+
+    bool Owns(const T* object) const {
+        auto address = reinterpret_cast<const unsigned char*>(object);
+        for (const auto& chunk : chunks) {
+            auto begin = reinterpret_cast<const unsigned char*>(chunk.get());
+            auto end =
+                reinterpret_cast<const unsigned char*>(chunk.get() + CHUNK_SIZE);
+            if (address >= begin && address < end) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Destroys every object and releases the chunks in one go.
+    void Clear() {
+        for (auto& chunk : chunks) {
+            for (size_t i = 0; i < CHUNK_SIZE; i++) {
+                if (chunk[i].alive) {
+                    reinterpret_cast<T*>(chunk[i].storage)->~T();
+                }
+            }
+        }
+        chunks.clear();
+        freeList = nullptr;
+        count = 0;
+    }
+
+    inline size_t GetCount() const { return count; }
+    inline size_t GetCapacity() const { return chunks.size() * CHUNK_SIZE; }
+};
@@ -7,10 +7,14 @@
 #include "Jolt/Physics/Collision/Shape/Shape.h"
 #include <Jolt/RegisterTypes.h>
 #include <Jolt/Core/TempAllocator.h>
-#include <Jolt/Core/JobSystemThreadPool.h>
+#include "JoltJobSystem.hpp"
 #include <Jolt/Physics/Body/Body.h>
 #include <Jolt/Physics/Body/BodyInterface.h>
 #include <Jolt/Physics/Collision/Shape/BoxShape.h>
+#include <Jolt/Physics/StateRecorder.h>
+#include <cstdint>
+#include <string>
+#include <vector>
 
 namespace Layers {
 static constexpr JPH::ObjectLayer NON_MOVING = 0;
@@ -86,9 +90,33 @@ class MyBodyActivationListener : public JPH::BodyActivationListener {
                                    JPH::uint64 inBodyUserData) override;
 };
 
+// Only saves the bodies flagged in changed, indexed by BodyID::GetIndex.
+// Bodies that did not change since a full snapshot keep their state from it,
+// so a delta snapshot is restored on top of that full snapshot.
+class DeltaStateFilter : public JPH::StateRecorderFilter {
+  private:
+    const std::vector<bool>& changed;
+
+  public:
+    explicit DeltaStateFilter(const std::vector<bool>& changed)
+        : changed(changed) {}
+    virtual bool ShouldSaveBody(const JPH::Body& inBody) const override;
+};
+
+// An in-memory copy of the simulation state at a given physics step.
+struct PhysicsSnapshot {
+    uint64_t step = 0;
+    bool delta = false;
+    std::string data;
+};
+
+// Number of workers Jolt plans its jobs for in deterministic mode, so the
+// job layout does not depend on the machine.
+static constexpr int DETERMINISTIC_WORKER_COUNT = 3;
+
 class PhysicsCore {
   private:
-    JPH::JobSystemThreadPool* jobSystem;
+    JPH::JobSystem* jobSystem;
     JPH::TempAllocatorImpl* tempAllocator;
     JPH::PhysicsSystem* physicsSystem;
     BPLayerInterfaceImpl* broadPhaseLayerInterface;
@@ -97,11 +125,21 @@ class PhysicsCore {
     JPH::BodyActivationListener* bodyActivationListener;
     JPH::ContactListener* contactListener;
 
+    uint64_t stepCount = 0;
+    bool deterministic = false;
+
+    // Bodies created between BeginBatch and EndBatch, added in bulk
+    bool batching = false;
+    JPH::BodyIDVector batchActivate;
+    JPH::BodyIDVector batchDontActivate;
+
+    void addBody(JPH::BodyID bodyID, JPH::EActivation activation);
+
   public:
     PhysicsCore();
     ~PhysicsCore();
 
-    void Init();
+    void Init(bool deterministic = false);
     void Update(float deltaTime);
     JPH::BodyID AddStaticBox(const JPH::Vec3& position,
                              const JPH::Vec3& halfExtent);
@@ -118,6 +156,13 @@ class PhysicsCore {
     JPH::BodyID AddDynamicCollider(const JPH::Vec3& position,
                                    const JPH::Ref<JPH::Shape> shape, float mass);
 
+    // Bodies created by the Add functions between these calls are added to
+    // the simulation together in EndBatch. They must not be removed before
+    // the batch ends.
+    void BeginBatch();
+    void EndBatch();
+    inline bool IsBatching() const { return batching; }
+
     inline JPH::BodyID RemoveBody(JPH::BodyID bodyID) {
         JPH::BodyInterface& bodyInterface = physicsSystem->GetBodyInterface();
         bodyInterface.RemoveBody(bodyID);
@@ -128,6 +173,24 @@ class PhysicsCore {
         return physicsSystem->GetBodyInterface();
     }
     inline JPH::PhysicsSystem& GetSystem() { return *physicsSystem; }
+    // Rigid bodies that are awake, only these moved in the last step
+    inline void GetActiveBodies(JPH::BodyIDVector& bodies) const {
+        physicsSystem->GetActiveBodies(JPH::EBodyType::RigidBody, bodies);
+    }
+    inline uint64_t GetStepCount() const { return stepCount; }
+    inline bool IsDeterministic() const { return deterministic; }
+
+    // Fast hash of the position, rotation and velocities of every body,
+    // visited in body ID order. Used to detect desyncs between runs.
+    uint64_t ComputeStateHash() const;
+
+    // Captures the whole simulation state.
+    PhysicsSnapshot SaveSnapshot() const;
+    // Captures the bodies flagged in changed, with the contacts and
+    // constraints. Must be restored on top of the full snapshot the other
+    // bodies are unchanged since.
+    PhysicsSnapshot SaveDeltaSnapshot(const std::vector<bool>& changed) const;
+    bool RestoreSnapshot(const PhysicsSnapshot& snapshot);
 
     void Shutdown();
 };
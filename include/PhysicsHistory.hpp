@@ -0,0 +1,43 @@
+#pragma once
+
+#include "PhysicsCore.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Rolling buffer of physics snapshots used for rollback. Every
+// keyframeInterval-th record is a full snapshot, the rest are deltas that only
+// hold the bodies that were awake at some record since the keyframe. A body
+// only moves while awake, so the others still match the keyframe.
+class PhysicsHistory {
+  private:
+    std::deque<PhysicsSnapshot> snapshots;
+    size_t capacity;
+    uint32_t keyframeInterval;
+    uint32_t sinceKeyframe = 0;
+
+    // Bodies awake at any record since the last keyframe, by body index
+    std::vector<bool> changed;
+    JPH::BodyIDVector activeBodies;
+
+    void markActiveBodies(const PhysicsCore& physicsCore);
+
+  public:
+    PhysicsHistory(size_t capacity = 120, uint32_t keyframeInterval = 30);
+    ~PhysicsHistory() = default;
+
+    // Records the current state of the simulation.
+    void Record(const PhysicsCore& physicsCore);
+
+    // Restores the simulation to the given step. Drops every snapshot recorded
+    // after it, since they are no longer part of the timeline.
+    bool Rewind(PhysicsCore& physicsCore, uint64_t step);
+
+    void Clear();
+
+    inline size_t GetSize() const { return snapshots.size(); }
+    inline uint64_t GetOldestStep() const {
+        return snapshots.empty() ? 0 : snapshots.front().step;
+    }
+};
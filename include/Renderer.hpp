@@ -6,6 +6,10 @@
 #include <bx/bx.h>
 #include <cstdint>
 #include <string>
+#include "DepthPyramid.hpp"
+#include "FrameSnapshot.hpp"
+#include "LightClusters.hpp"
+#include "TaskSystem.hpp"
 
 class Renderer {
   private:
@@ -13,12 +17,12 @@ class Renderer {
     uint32_t width, height;
     std::string title;
 
-    bgfx::ViewId currentView = 0;
     float identity[16];
 
     bgfx::ViewId geometryView = 0;
     bgfx::ViewId lightingView = 1;
     bgfx::ViewId combineView = 2;
+    bgfx::ViewId occlusionView = 3;
 
     bgfx::VertexLayout layout;
 
@@ -29,11 +33,18 @@ class Renderer {
     bgfx::ProgramHandle geometryProgram;
     bgfx::ProgramHandle lightingProgram;
     bgfx::ProgramHandle combineProgram;
+    bgfx::ProgramHandle depthProgram;
 
+    // Albedo and specular, octahedral normal and roughness, depth
     bgfx::TextureHandle texGbuffers[3];
+    // RGB10A2 where it can be rendered to, else RGBA16F
+    bgfx::TextureFormat::Enum normalFormat = bgfx::TextureFormat::RGB10A2;
     bgfx::FrameBufferHandle GBuffersFrameBuffer;
 
     bgfx::FrameBufferHandle lightingFrameBuffer;
+    // Looked up on the API thread for the encoder
+    bgfx::TextureHandle gbufferTextures[3];
+    bgfx::TextureHandle lightingTexture;
 
     bgfx::UniformHandle texColorUniform;
     bgfx::UniformHandle texNormalUniform;
@@ -42,10 +53,79 @@ class Renderer {
     bgfx::UniformHandle normalUniform;
     bgfx::UniformHandle depthUniform;
     bgfx::UniformHandle lightingUniform;
-
-    void BeginGeometry();
-    void BeginLighting();
-    void BeginCombine();
+    bgfx::UniformHandle depthSizeUniform;
+
+    // Clustered lighting, the light lists are built on the API thread and
+    // uploaded as textures the lighting pass looks them up in
+    LightClusters lightClusters;
+    bgfx::TextureHandle lightTexture;
+    bgfx::TextureHandle clusterTexture;
+    bgfx::TextureHandle lightIndexTexture;
+    bgfx::UniformHandle lightsUniform;
+    bgfx::UniformHandle clustersUniform;
+    bgfx::UniformHandle lightIndicesUniform;
+    bgfx::UniformHandle invViewProjUniform;
+    bgfx::UniformHandle cameraViewUniform;
+    bgfx::UniformHandle clusterSizeUniform;
+    bgfx::UniformHandle clusterParamsUniform;
+    bgfx::UniformHandle sunDirectionUniform;
+    bgfx::UniformHandle sunColorUniform;
+    bgfx::UniformHandle cameraPositionUniform;
+    bgfx::UniformHandle materialUniform;
+    // Uniform values for the encoder, set next to the light upload
+    glm::mat4 invViewProj;
+    glm::vec4 cameraPosition;
+    float clusterParams[4];
+
+    // The geometry depth is reduced on the GPU and read back a few frames
+    // later, the CPU builds the rest of the pyramid from it
+    bool occlusionSupported = false;
+    bool occlusionCulling = true;
+    bgfx::FrameBufferHandle occlusionFrameBuffer = BGFX_INVALID_HANDLE;
+    bgfx::TextureHandle occlusionReadback = BGFX_INVALID_HANDLE;
+    uint32_t occlusionWidth = 0, occlusionHeight = 0;
+    // Written by bgfx until the frame readTexture returned, so it is only
+    // resized between reads
+    std::vector<float> occlusionDepth;
+    bool occlusionPending = false;
+    uint32_t occlusionReadyFrame = 0;
+    // What the pending read was drawn with, the window may have been
+    // resized since
+    uint32_t occlusionReadWidth = 0, occlusionReadHeight = 0;
+    uint32_t occlusionScreenWidth = 0, occlusionScreenHeight = 0;
+    glm::mat4 occlusionViewProjection;
+    DepthPyramid depthPyramid;
+
+    // The frame loop captures into one snapshot while the other is drawn
+    FrameSnapshot snapshots[2];
+    size_t captureIndex = 0;
+    // Encodes the last presented snapshot, only used when multithreaded
+    TaskHandle encoding;
+    bool multithreaded = false;
+
+    // Buffers of the procedural draws of the snapshot being encoded
+    struct TransientDraw {
+        bgfx::TransientVertexBuffer vertices;
+        bgfx::TransientIndexBuffer indices;
+    };
+    std::vector<TransientDraw> transientDraws;
+
+    // View setup has to happen on the API thread, before encoding
+    void setupViews(const FrameSnapshot& snapshot);
+    // Transient buffers are only valid until the next bgfx::frame, so they
+    // are allocated on the API thread right before encoding
+    void allocateTransient(const FrameSnapshot& snapshot);
+    void encode(const FrameSnapshot& snapshot);
+    // Assigns the lights of the snapshot to clusters and uploads them
+    void uploadLights(const FrameSnapshot& snapshot);
+    void createOcclusionBuffers();
+    void destroyOcclusionBuffers();
+    // Reduces the depth of this frame and starts reading it back, unless a
+    // read is already in flight. Runs on the API thread.
+    void requestOcclusionDepth(const FrameSnapshot& snapshot);
+    // Builds the pyramid once the read finished, frame is what bgfx::frame
+    // returned
+    void collectOcclusionDepth(uint32_t frame);
 
   public:
     Renderer(std::string title, int width, int height);
@@ -55,7 +135,9 @@ class Renderer {
     Renderer& operator=(const Renderer&) = default;
     ~Renderer();
 
-    bool Init();
+    // Multithreaded lets bgfx render on its own thread and encodes the draw
+    // calls on the task system, overlapping them with the next frame.
+    bool Init(bool multithreaded = false);
     bool Shutdown();
     void RecreateFrameBuffers(int width, int height);
 
@@ -69,11 +151,29 @@ class Renderer {
         return static_cast<float>(width) / static_cast<float>(height);
     }
 
-    void SetTextureUniforms(bgfx::TextureHandle albedo,
-                            bgfx::TextureHandle normal);
-
-    void BeginPass(bgfx::ViewId view);
-    void EndPass();
+    // Fill this with the state of the frame that was just simulated.
+    inline FrameSnapshot& GetCaptureSnapshot() {
+        return snapshots[captureIndex];
+    }
+    // The snapshot the next frame is captured into. The same one when not
+    // multithreaded.
+    inline FrameSnapshot& GetNextCaptureSnapshot() {
+        return snapshots[multithreaded ? 1 - captureIndex : captureIndex];
+    }
+    // Draws the captured snapshot and advances bgfx to the next frame. When
+    // multithreaded, the snapshot is drawn while the caller simulates the
+    // next frame, so what is on screen lags one frame behind.
+    uint32_t Present();
+    // Waits until the last presented snapshot is encoded.
+    void WaitForEncoding();
+    inline bool IsMultithreaded() const { return multithreaded; }
+
+    // Depth of an earlier frame to cull hidden entities against. Empty when
+    // occlusion culling is off or not supported by the GPU.
+    inline const DepthPyramid& GetDepthPyramid() const {
+        return depthPyramid;
+    }
+    void SetOcclusionCulling(bool enabled);
 
     void SetTitle(std::string title);
 };
@@ -6,25 +6,63 @@
 #include <assimp/postprocess.h>
 #include <assimp/material.h>
 #include <cstdint>
+#include <map>
 #include <string>
+#include <tuple>
 #include <vector>
 
 class SceneImporter {
   private:
+    // Vertices and indices of an aiMesh, converted ahead of the node walk
+    struct MeshData {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+    };
+
+    // Material id and grid cell of a static batch
+    using BatchKey = std::tuple<uint64_t, int32_t, int32_t, int32_t>;
+
+    // Side of the grid cells static batches are split into, so every batch
+    // can still be culled on its own
+    static constexpr float BATCH_CHUNK_SIZE = 32.0f;
+
     SceneManager* sceneManager;
+    std::string scenePath;
     std::string workingDirectory;
     std::vector<SceneRef<Entity>> sceneRefs;
+    std::vector<MeshData> meshData; // Indexed like aiScene::mMeshes
+    // Indexed like aiScene::mMaterials, UINT64_MAX until it is created
+    std::vector<uint64_t> materialIds;
+    std::map<BatchKey, MeshData> batches;
+    uint32_t batchedMeshes = 0;
 
-    void processNode(aiNode* node, const aiScene* scene);
-    SceneRef<MeshContainer> processMesh(aiMesh* mesh, const aiScene* scene,
+    // Walks the node tree, parentTransform places the node in the scene
+    void processNode(aiNode* node, const aiScene* scene,
+                     const glm::mat4& parentTransform, bool batchStatic);
+    // Copy of the vertices moved into the space of transform
+    static std::vector<Vertex> toWorld(const std::vector<Vertex>& vertices,
+                                       const glm::mat4& transform);
+    static void readMesh(const aiMesh* mesh, MeshData& data);
+    SceneRef<MeshContainer> processMesh(uint32_t meshIndex,
+                                        const aiScene* scene,
                                         uint64_t& matId);
+    uint64_t processMaterial(uint32_t materialIndex, const aiScene* scene);
     uint64_t loadMaterialTextures(aiMaterial* mat, aiTextureType type);
+    // Appends the mesh, moved into world space, to the batch of its material
+    // and grid cell
+    void addToBatch(uint32_t meshIndex, const glm::mat4& transform,
+                    const aiScene* scene);
+    // Adds one static entity per batch
+    void flushBatches();
 
   public:
     SceneImporter() = default;
     ~SceneImporter() = default;
 
-    std::vector<SceneRef<Entity>> ImportScene(const std::string& path);
+    // With batchStatic, meshes that share a material are merged into a few
+    // large static entities instead of one entity per node.
+    std::vector<SceneRef<Entity>> ImportScene(const std::string& path,
+                                              bool batchStatic = true);
 
     inline void SetSceneManager(SceneManager* sceneManager) {
         this->sceneManager = sceneManager;
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Bvh.hpp"
 #include "Camera.hpp"
 #include "Collider.hpp"
 #include "Entity.hpp"
@@ -7,12 +8,15 @@
 #include "Material.hpp"
 #include "MeshContainer.hpp"
 #include "MeshEntity.hpp"
+#include "ObjectPool.hpp"
 #include "Primitive.hpp"
 #include "Renderer.hpp"
 #include "Texture.hpp"
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 // Forward declaration
 class SceneImporter;
@@ -22,6 +26,46 @@ template <typename T> struct SceneRef {
     T* data;
 };
 
+// Storage for the objects of one level. Everything a scene import creates
+// goes in its own arena, so unloading the level clears a handful of pools
+// instead of deleting every object on its own.
+struct SceneArena {
+    ObjectPool<Primitive> primitives;
+    ObjectPool<MeshEntity> meshEntities;
+    ObjectPool<Texture> textures;
+    ObjectPool<Material> materials;
+    ObjectPool<MeshContainer> meshes;
+    ObjectPool<Collider> colliders;
+    ObjectPool<Camera> cameras;
+
+    // Ids handed out for objects in this arena
+    std::vector<uint64_t> entityIds;
+    std::vector<uint64_t> textureIds;
+    std::vector<uint64_t> materialIds;
+    std::vector<uint64_t> meshIds;
+    std::vector<uint64_t> colliderIds;
+    std::vector<uint64_t> cameraIds;
+
+    // Other arenas using resources loaded into this one, it is only
+    // unloaded once they are gone
+    uint32_t users = 0;
+    // Arenas this one uses resources from, one entry per use
+    std::vector<SceneArena*> borrowed;
+
+    // Entities go first, their physics bodies and buffers are released
+    // before the resources they use
+    void Clear() {
+        primitives.Clear();
+        meshEntities.Clear();
+        textures.Clear();
+        materials.Clear();
+        meshes.Clear();
+        colliders.Clear();
+        cameras.Clear();
+    }
+    ~SceneArena() { Clear(); }
+};
+
 class SceneManager {
   private:
     std::unordered_map<uint64_t, Entity*> entities;
@@ -30,8 +74,45 @@ class SceneManager {
     std::unordered_map<uint64_t, Collider*> colliders;
     std::unordered_map<uint64_t, Camera*> cameras;
     std::unordered_map<uint64_t, Material*> materials;
-    std::unordered_map<std::string, uint32_t> loadedURIs;
+    // Resource id and the arena it was loaded into by path
+    struct LoadedURI {
+        uint64_t id;
+        SceneArena* arena;
+    };
+    std::unordered_map<std::string, LoadedURI> loadedURIs;
 
+    // Ids are never reused, so a stale id can not refer to a newer object
+    uint64_t nextEntityId = 0;
+    uint64_t nextTextureId = 0;
+    uint64_t nextMaterialId = 0;
+    uint64_t nextMeshId = 0;
+    uint64_t nextColliderId = 0;
+    uint64_t nextCameraId = 0;
+
+    // Arena 0 holds everything not loaded as part of a scene. Unloaded
+    // scenes leave a null entry.
+    std::vector<std::unique_ptr<SceneArena>> arenas;
+    SceneArena* currentArena = nullptr;
+    std::unordered_map<std::string, size_t> sceneArenas;
+
+    // Scene id of every entity by its World id, UINT64_MAX for none
+    std::vector<uint64_t> sceneIds;
+    // Render side trees over the entity bounds. The static one is rebuilt
+    // when the static entities change, the dynamic one is refit every frame
+    // and rebuilt once its entities moved around enough.
+    Bvh staticBvh;
+    Bvh dynamicBvh;
+    uint64_t bvhLayoutVersion = UINT64_MAX;
+    std::vector<EntityId> queryResults;
+
+    // Id of an already loaded resource, counting the current arena as one
+    // of its users
+    uint64_t shareURI(const LoadedURI& uri);
+    void indexEntity(uint64_t id, Entity* entity);
+    SceneRef<Entity> findEntity(EntityId entity);
+    void destroyEntity(Entity* entity);
+    template <typename T>
+    void destroyObject(ObjectPool<T> SceneArena::*pool, T* object);
 
     SceneImporter* sceneImporter;
     PhysicsCore* physicsCore;
@@ -39,6 +120,8 @@ class SceneManager {
     Renderer* renderer;
 
     uint64_t activeCameraId = 0;
+    // Reused by SyncTransformsFromPhysics
+    JPH::BodyIDVector activeBodies;
 
   public:
     SceneManager();
@@ -56,6 +139,11 @@ class SceneManager {
                                glm::vec3 rotation = glm::vec3(0.0f),
                                glm::vec3 size = glm::vec3(1.0f));
     SceneRef<Entity> UpdateEntity(uint64_t id, PrimitiveType type);
+    // Spawns one primitive per position, with all physics bodies added to
+    // the simulation in a single batch.
+    std::vector<SceneRef<Entity>>
+    AddEntities(PrimitiveType type, RigidBodyType bodyType, uint64_t materialId,
+                const std::vector<glm::vec3>& positions);
 
     SceneRef<Entity> AddEntity(MeshEntity meshEntity);
     SceneRef<Entity> AddEntity(uint64_t meshId, uint64_t colliderId,
@@ -70,7 +158,40 @@ class SceneManager {
     SceneRef<Entity> GetEntity(const uint64_t id);
     void RemoveEntity(const uint64_t id);
 
-    std::vector<SceneRef<Entity>> AddScene(const std::string& path);
+    // Imports a scene into its own arena. Resources already loaded by an
+    // earlier scene are shared and belong to that scene. See
+    // SceneImporter::ImportScene for batchStatic.
+    std::vector<SceneRef<Entity>> AddScene(const std::string& path,
+                                           bool batchStatic = true);
+    // Frees everything the scene import created in one go. Fails while
+    // other scenes still use textures or meshes it loaded.
+    bool UnloadScene(const std::string& path);
+
+    // Copies the physics body transforms over to the non-static entities.
+    // By default only the awake bodies are copied, sleeping ones did not
+    // move. Pass false after the physics state was replaced.
+    void SyncTransformsFromPhysics(bool activeOnly = true);
+    // Restores the physics state and moves the entities to match it.
+    // Entities added after the snapshot was saved are left as they are.
+    bool RestorePhysicsSnapshot(const PhysicsSnapshot& snapshot);
+
+    // Brings the trees up to date with the bounds of this frame. Call after
+    // the bounds are updated and before World::EndFrame.
+    void UpdateBvh();
+    // Entities whose bounds overlap the box
+    std::vector<SceneRef<Entity>> QueryBox(const glm::vec3& min,
+                                           const glm::vec3& max);
+    // Closest entity whose bounds the ray hits within maxDistance, the
+    // direction must be normalized. Null if nothing was hit.
+    SceneRef<Entity> Raycast(const glm::vec3& origin,
+                             const glm::vec3& direction, float maxDistance,
+                             float& distance);
+    // Appends the entities whose bounds are in the view frustum
+    void QueryFrustum(const glm::mat4& viewProjection,
+                      std::vector<EntityId>& out) const;
+    // Keeps only the draws of the snapshot that are in its view frustum and
+    // not hidden in the renderer's depth pyramid
+    void CullSnapshot(FrameSnapshot& snapshot);
 
     SceneRef<Texture> AddTexture(Texture texture);
     SceneRef<Texture> AddTexture(const std::string& filePath,
@@ -115,6 +236,13 @@ class SceneManager {
     void RemoveCamera(const uint64_t id);
     SceneRef<Camera> GetActiveCamera();
 
+    // Lights are entities with nothing but a Light component, they are not
+    // part of any scene arena
+    EntityId AddLight(const Light& light);
+    // Null if the entity is not a light
+    Light* GetLight(EntityId light);
+    void RemoveLight(EntityId light);
+
     Renderer& GetRenderer() { return *renderer; }
     inline void SetActiveCamera(const uint64_t id) { activeCameraId = id; }
 
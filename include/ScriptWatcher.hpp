@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Watches Lua scripts and script directories for changes. Uses inotify on
+// Linux and falls back to polling modification times elsewhere.
+class ScriptWatcher {
+  private:
+    struct WatchedDir {
+        std::string path;
+        bool allScripts; // Every .lua file in it, or only the listed ones
+    };
+
+    // Normalized path of a watched script to the path it is reported as
+    std::unordered_map<std::string, std::string> files;
+    std::vector<WatchedDir> dirs;
+
+    int inotifyFd = -1;
+    std::unordered_map<int, size_t> watchDescriptors;
+
+    // Polling fallback
+    std::unordered_map<std::string, std::filesystem::file_time_type> mtimes;
+    int64_t lastPoll = 0;
+
+    static std::string key(const std::filesystem::path& path);
+    void addDir(const std::string& path, bool allScripts);
+    void pollMTimes(std::vector<std::string>& changed);
+
+  public:
+    ScriptWatcher();
+    ScriptWatcher(const ScriptWatcher&) = delete;
+    ScriptWatcher& operator=(const ScriptWatcher&) = delete;
+    ~ScriptWatcher();
+
+    // Watches a single script or every script in a directory.
+    bool Watch(const std::string& path);
+
+    // Returns the scripts that changed since the last call, each once.
+    std::vector<std::string> Poll();
+};
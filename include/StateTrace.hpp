@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+// Per-step physics state hashes written to, or compared against, a file. Two
+// runs with the same input should produce the same trace, the first step where
+// they differ is where the simulation desynced.
+class StateTrace {
+  public:
+    enum class Mode { Off, Record, Compare };
+
+  private:
+    Mode mode = Mode::Off;
+    std::fstream file;
+    uint64_t checkedSteps = 0;
+    bool desynced = false;
+
+  public:
+    StateTrace() = default;
+    ~StateTrace();
+
+    bool Open(const std::string& path, Mode mode);
+    void Close();
+
+    // Records or checks the hash of the given step. Returns false on the first
+    // mismatch, later steps are not checked since they will all differ.
+    bool Step(uint64_t step, uint64_t hash);
+
+    inline Mode GetMode() const { return mode; }
+    inline bool IsDesynced() const { return desynced; }
+    inline uint64_t GetCheckedSteps() const { return checkedSteps; }
+};
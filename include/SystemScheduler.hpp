@@ -0,0 +1,57 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+#include "World.hpp"
+
+// Components a system reads and writes. Two systems conflict if one writes a
+// component the other reads or writes.
+struct SystemAccess {
+    std::vector<ComponentTypeId> reads;
+    std::vector<ComponentTypeId> writes;
+    // Runs on the thread calling Run, for systems that use bgfx or Lua
+    bool mainThread = false;
+};
+
+// Ids for a SystemAccess list. Also creates the storage of the types, so
+// systems never add pools to the world while running.
+template <typename... T>
+std::vector<ComponentTypeId> Components(World& world) {
+    (world.Register<T>(), ...);
+    return {World::TypeId<T>()...};
+}
+
+// Runs systems over a World, in parallel where their access allows it.
+// Systems are split into stages, a system goes in the first stage after
+// every earlier system it conflicts with, so conflicting systems keep the
+// order they were added in. The systems of a stage run at the same time on
+// the TaskSystem.
+class SystemScheduler {
+  public:
+    using System = std::function<void(World&, double)>;
+
+  private:
+    struct Entry {
+        std::string name;
+        SystemAccess access;
+        System system;
+    };
+
+    World& world;
+    std::vector<Entry> systems;
+    std::vector<std::vector<size_t>> stages;
+    bool dirty = false;
+
+    static bool conflicts(const SystemAccess& a, const SystemAccess& b);
+    void buildStages();
+
+  public:
+    explicit SystemScheduler(World& world);
+
+    void AddSystem(std::string name, SystemAccess access, System system);
+    // Runs every system once and returns when all of them are done.
+    void Run(double deltaTime);
+    void PrintStages();
+
+    inline size_t GetStageCount() const { return stages.size(); }
+};
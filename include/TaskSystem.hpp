@@ -0,0 +1,121 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Tasks of a higher priority are started first, on every worker.
+enum class TaskPriority { High, Normal, Low, Count };
+
+// A unit of work in the TaskSystem. Held through a TaskHandle, which can be
+// waited on or passed as a dependency of later tasks.
+class Task {
+  private:
+    friend class TaskSystem;
+
+    std::function<void()> function;
+    // Unfinished dependencies, plus one while the task is being submitted
+    std::atomic<int> pending{1};
+    std::atomic<bool> done{false};
+    std::mutex mutex; // Guards dependents against the task finishing
+    std::vector<std::shared_ptr<Task>> dependents;
+    TaskPriority priority = TaskPriority::Normal;
+    bool mainThread = false;
+
+  public:
+    inline bool IsDone() const { return done.load(std::memory_order_acquire); }
+};
+
+using TaskHandle = std::shared_ptr<Task>;
+
+// Engine wide worker pool. Physics, the system scheduler, the Lua workers and
+// scene loading all submit here, so the machine is never oversubscribed.
+//
+// Every worker has a queue per priority. Workers take their newest task
+// first and steal the oldest task of the others when they run dry. Tasks
+// submitted from outside the pool are spread over the workers. A task only
+// starts once all of its dependencies are done.
+//
+// Main thread tasks are kept apart and run by RunMainThreadTasks, or while the
+// main thread waits on a task.
+class TaskSystem {
+  private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<TaskHandle> queues[(size_t)TaskPriority::Count];
+        std::thread thread;
+    };
+
+    TaskSystem() = default;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    size_t threadCount = 0;
+    std::atomic<size_t> nextWorker{0};
+    std::atomic<size_t> queued{0};
+
+    std::mutex mainMutex;
+    std::deque<TaskHandle> mainQueue;
+    std::thread::id mainThread;
+
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void workerLoop(size_t index);
+    TaskHandle submit(TaskHandle task,
+                      const std::vector<TaskHandle>& dependencies);
+    void schedule(const TaskHandle& task);
+    // Pops a task from worker index, or steals one from the others. Pass
+    // SIZE_MAX from threads outside the pool.
+    TaskHandle pop(size_t index, bool takeLow);
+    bool runMainThreadTask();
+    void execute(const TaskHandle& task);
+
+  public:
+    static TaskSystem& Get() {
+        static TaskSystem instance;
+        return instance;
+    }
+    TaskSystem(const TaskSystem&) = delete;
+    TaskSystem& operator=(const TaskSystem&) = delete;
+
+    // Starts count workers, the calling thread becomes the main thread.
+    // With no workers the tasks run when they are waited on.
+    void Init(size_t count);
+    // Stops the workers. Tasks that did not start are dropped.
+    void Shutdown();
+
+    TaskHandle Submit(std::function<void()> function,
+                      TaskPriority priority = TaskPriority::Normal);
+    TaskHandle Submit(std::function<void()> function,
+                      const std::vector<TaskHandle>& dependencies,
+                      TaskPriority priority = TaskPriority::Normal);
+    // Runs on the main thread once the dependencies are done
+    TaskHandle SubmitMainThread(std::function<void()> function,
+                                const std::vector<TaskHandle>& dependencies =
+                                    {});
+
+    // Runs other tasks until the task is done. Low priority tasks are left
+    // to the workers when there are any, they are meant for long running
+    // work.
+    void Wait(const TaskHandle& task);
+    void Wait(const std::vector<TaskHandle>& tasks);
+    // Calls function(begin, end) on ranges of at most grain items and waits
+    // for all of them. The calling thread works on the ranges too.
+    void ParallelFor(size_t count, size_t grain,
+                     const std::function<void(size_t, size_t)>& function,
+                     TaskPriority priority = TaskPriority::Normal);
+
+    // Runs the main thread tasks that are ready. Call once per frame.
+    void RunMainThreadTasks();
+
+    inline size_t GetWorkerCount() const { return threadCount; }
+    inline bool IsMainThread() const {
+        return std::this_thread::get_id() == mainThread;
+    }
+};
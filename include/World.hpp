@@ -0,0 +1,179 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "ComponentArray.hpp"
+
+using EntityId = uint32_t;
+using ComponentTypeId = uint32_t;
+
+constexpr EntityId INVALID_ENTITY = UINT32_MAX;
+
+// Entities are plain ids, their data is kept in one packed ComponentArray per
+// component type. Systems walk those arrays instead of the Entity objects.
+//
+// Adding or removing components and entities is not thread safe. Systems run
+// by the SystemScheduler may only change the values of the components they
+// declared, everything structural happens between scheduler runs.
+class World {
+  private:
+    struct PoolBase {
+        virtual ~PoolBase() = default;
+        virtual void Remove(EntityId entity) = 0;
+        virtual void ClearChanged() = 0;
+    };
+
+    template <typename T> struct Pool : PoolBase {
+        ComponentArray<T> components;
+        void Remove(EntityId entity) override { components.Remove(entity); }
+        void ClearChanged() override { components.ClearChanged(); }
+    };
+
+    // Indexed by ComponentTypeId, null for types this world has not seen
+    std::vector<std::unique_ptr<PoolBase>> pools;
+    std::vector<bool> alive;
+    std::vector<EntityId> freeIds;
+    size_t count = 0;
+    // Bumped whenever entities or components are added or removed
+    uint64_t layoutVersion = 0;
+    uint64_t frame = 0;
+
+    static ComponentTypeId nextTypeId() {
+        static ComponentTypeId next = 0;
+        return next++;
+    }
+
+  public:
+    World() = default;
+    World(const World&) = delete;
+    World& operator=(const World&) = delete;
+
+    // The world the scene entities live in
+    static World& Get() {
+        static World instance;
+        return instance;
+    }
+
+    template <typename T> static ComponentTypeId TypeId() {
+        static const ComponentTypeId id = nextTypeId();
+        return id;
+    }
+
+    EntityId Create() {
+        EntityId entity;
+        if (!freeIds.empty()) {
+            entity = freeIds.back();
+            freeIds.pop_back();
+            alive[entity] = true;
+        } else {
+            entity = (EntityId)alive.size();
+            alive.push_back(true);
+        }
+        count++;
+        layoutVersion++;
+        return entity;
+    }
+
+    // Removes every component of the entity and recycles its id.
+    void Destroy(EntityId entity) {
+        if (!IsAlive(entity)) {
+            return;
+        }
+        for (auto& pool : pools) {
+            if (pool) {
+                pool->Remove(entity);
+            }
+        }
+        alive[entity] = false;
+        freeIds.push_back(entity);
+        count--;
+        layoutVersion++;
+    }
+
+    inline bool IsAlive(EntityId entity) const {
+        return entity < alive.size() && alive[entity];
+    }
+    inline size_t GetCount() const { return count; }
+    // One past the highest entity id handed out so far
+    inline size_t GetIdCount() const { return alive.size(); }
+    inline uint64_t GetLayoutVersion() const { return layoutVersion; }
+    // For changes that invalidate caches built from the layout, like a new
+    // material on an entity
+    inline void MarkLayoutChanged() { layoutVersion++; }
+    // Number of EndFrame calls so far
+    inline uint64_t GetFrame() const { return frame; }
+
+    template <typename T> inline void MarkChanged(EntityId entity) {
+        GetComponents<T>().MarkChanged(entity);
+    }
+    // Clears the changed lists of every component type. Call once all
+    // stages of the frame have seen them.
+    void EndFrame() {
+        for (auto& pool : pools) {
+            if (pool) {
+                pool->ClearChanged();
+            }
+        }
+        frame++;
+    }
+
+    // Creates the storage for T up front, so systems can look it up from
+    // several threads without the pool list changing under them.
+    template <typename T> ComponentArray<T>& Register() {
+        ComponentTypeId id = TypeId<T>();
+        if (id >= pools.size()) {
+            pools.resize(id + 1);
+        }
+        if (!pools[id]) {
+            pools[id] = std::make_unique<Pool<T>>();
+        }
+        return static_cast<Pool<T>*>(pools[id].get())->components;
+    }
+
+    template <typename T> inline ComponentArray<T>& GetComponents() {
+        return Register<T>();
+    }
+
+    template <typename T> T& Add(EntityId entity, T component = T()) {
+        layoutVersion++;
+        return Register<T>().Add(entity, std::move(component));
+    }
+
+    template <typename T> void Remove(EntityId entity) {
+        ComponentTypeId id = TypeId<T>();
+        if (id < pools.size() && pools[id]) {
+            pools[id]->Remove(entity);
+            layoutVersion++;
+        }
+    }
+
+    template <typename T> bool Has(EntityId entity) const {
+        ComponentTypeId id = TypeId<T>();
+        return id < pools.size() && pools[id] &&
+               static_cast<Pool<T>*>(pools[id].get())->components.Has(entity);
+    }
+
+    // The entity must have the component.
+    template <typename T> inline T& Get(EntityId entity) {
+        return GetComponents<T>().Get(entity);
+    }
+
+    // Calls fn(entity, T&, Rest&...) for every entity that has all of the
+    // components. Walks the dense array of T, so put the rarest one first.
+    template <typename T, typename... Rest, typename F> void Each(F&& fn) {
+        ComponentArray<T>& first = GetComponents<T>();
+        [[maybe_unused]] auto rest = std::tie(GetComponents<Rest>()...);
+        std::vector<T>& data = first.GetData();
+        const std::vector<uint32_t>& owners = first.GetOwners();
+        for (size_t i = 0; i < data.size(); i++) {
+            EntityId entity = owners[i];
+            if (!(std::get<ComponentArray<Rest>&>(rest).Has(entity) && ...)) {
+                continue;
+            }
+            fn(entity, data[i],
+               std::get<ComponentArray<Rest>&>(rest).Get(entity)...);
+        }
+    }
+};
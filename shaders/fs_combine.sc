@@ -2,16 +2,11 @@ $input v_texcoord0
 #include <bgfx_shader.sh>
 
 // Match the uniform names from C++ code
-SAMPLER2D(u_albedo, 0);
-SAMPLER2D(u_lighting, 1);
+SAMPLER2D(u_lighting, 0);
 
 void main() {
-    // Sample G-buffer
-    vec4 albedoData = texture2D(u_albedo, v_texcoord0);
-    vec4 lightingData = texture2D(u_lighting, v_texcoord0);
-    
-    // Combine albedo and lighting
-    vec3 finalColor = albedoData.rgb * lightingData.rgb;
+    // The lighting pass already applied the albedo
+    vec3 finalColor = texture2D(u_lighting, v_texcoord0).rgb;
     
     // Gamma correction for better visual results
     finalColor = pow(abs(finalColor), vec3_splat(1.0/2.2));
@@ -0,0 +1,22 @@
+$input v_texcoord0
+#include <bgfx_shader.sh>
+
+SAMPLER2D(u_depth, 0);
+// Size of the depth texture in xy, one over it in zw
+uniform vec4 u_depthSize;
+
+// Writes the farthest depth of the 8x8 pixel block this pixel covers, the
+// block size is DepthPyramid::BLOCK_SIZE
+void main() {
+    vec2 block = floor(gl_FragCoord.xy) * 8.0;
+    float depth = 0.0;
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 8; x++) {
+            vec2 texel = min(block + vec2(float(x), float(y)),
+                             u_depthSize.xy - 1.0) + 0.5;
+            depth = max(depth,
+                        texture2DLod(u_depth, texel * u_depthSize.zw, 0.0).x);
+        }
+    }
+    gl_FragColor = vec4(depth, 0.0, 0.0, 1.0);
+}
@@ -1,10 +1,14 @@
 $input v_texcoord0, v_normal, v_tangent
 
 #include <bgfx_shader.sh>
+#include <gbuffer.sh>
 
 SAMPLER2D(s_texColor, 0);
 SAMPLER2D(s_texNormal, 1);
 
+// Roughness in x, specular intensity in y
+uniform vec4 u_material;
+
 void main() {
     vec4 color = texture2D(s_texColor, v_texcoord0);
 
@@ -26,10 +30,8 @@ void main() {
     // Transform normal map from tangent space to world space
     vec3 normal = normalize(mul(TBN, normalMap));
 
-    // Pack normal into [0,1] range
-    vec3 packedNormal = normal * 0.5 + 0.5;
-
-    // Output to G-buffer
-    gl_FragData[0] = vec4(color.rgb, 1.0);     // Albedo
-    gl_FragData[1] = vec4(packedNormal, 1.0);  // Normal
+    // Output to G-buffer, the material goes in the spare channels. Albedo
+    // and specular, then the normal and roughness.
+    gl_FragData[0] = vec4(color.rgb, u_material.y);
+    gl_FragData[1] = vec4(encodeNormal(normal), u_material.x, 0.0);
 }
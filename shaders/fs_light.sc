@@ -1,28 +1,126 @@
 $input v_texcoord0
 #include <bgfx_shader.sh>
+#include <gbuffer.sh>
 
 // Match the uniform names from C++ code
 SAMPLER2D(u_normal, 0);
 SAMPLER2D(u_depth, 1);
+// See LightClusters for the layout of these
+SAMPLER2D(u_lights, 2);
+SAMPLER2D(u_clusters, 3);
+SAMPLER2D(u_lightIndices, 4);
+SAMPLER2D(u_albedo, 5);
+
+uniform mat4 u_invViewProj;
+uniform mat4 u_cameraView;
+// Cluster counts in xyz, index texture width in w
+uniform vec4 u_clusterSize;
+// Near and far plane, homogeneous depth and origin bottom left
+uniform vec4 u_clusterParams;
+// Towards the sun
+uniform vec4 u_sunDirection;
+uniform vec4 u_sunColor;
+uniform vec4 u_cameraPosition;
+
+// LightClusters::MAX_LIGHTS and INDEX_HEIGHT
+#define MAX_LIGHTS 1024.0
+#define INDEX_HEIGHT 256.0
+// Loops need a constant bound on some targets
+#define MAX_CLUSTER_LIGHTS 256
+
+vec4 fetchLight(float index, float row) {
+    return texture2DLod(u_lights,
+                        vec2((index + 0.5) / MAX_LIGHTS, (row + 0.5) / 3.0),
+                        0.0);
+}
+
+// Diffuse plus Blinn-Phong specular of one light, the specular power
+// follows the roughness
+vec3 shade(vec3 normal, vec3 lightDir, vec3 viewDir, vec3 albedo,
+           float roughness, float specular) {
+    float diffuseStrength = max(dot(normal, lightDir), 0.0);
+    vec3 halfway = normalize(lightDir + viewDir);
+    float power = exp2(10.0 * (1.0 - roughness) + 1.0);
+    float highlight = specular * (power + 8.0) / 25.0 *
+                      pow(max(dot(normal, halfway), 0.0), power);
+    return (albedo + highlight) * diffuseStrength;
+}
 
 void main() {
+    float depth = texture2D(u_depth, v_texcoord0).x;
+    // Nothing was drawn here
+    if (depth >= 1.0) {
+        gl_FragColor = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+
     // Sample G-buffer
+    vec4 albedoData = texture2D(u_albedo, v_texcoord0);
     vec4 normalData = texture2D(u_normal, v_texcoord0);
-    
-    // Unpack normal from [0,1] to [-1,1] range
-    vec3 normal = normalize(normalData.xyz * 2.0 - 1.0);
-    
-    // Simple directional light
-    vec3 lightDir = normalize(vec3(0.5, 0.3, -0.5));
-    vec3 lightColor = vec3(1.0, 0.9, 0.8);
-    
-    // Calculate lighting
-    float diffuseStrength = max(dot(normal, lightDir), 0.0);
-    vec3 diffuse = diffuseStrength * lightColor;
+    vec3 albedo = albedoData.rgb;
+    float specular = albedoData.a;
+    vec3 normal = decodeNormal(normalData.xy);
+    float roughness = normalData.z;
+
+    // World position of the pixel, from its depth
+    vec2 ndc = vec2(v_texcoord0.x * 2.0 - 1.0,
+                    u_clusterParams.w > 0.5 ? v_texcoord0.y * 2.0 - 1.0
+                                            : 1.0 - v_texcoord0.y * 2.0);
+    float ndcDepth = u_clusterParams.z > 0.5 ? depth * 2.0 - 1.0 : depth;
+    vec4 position = mul(u_invViewProj, vec4(ndc, ndcDepth, 1.0));
+    position.xyz /= position.w;
+
+    vec3 viewDir = normalize(u_cameraPosition.xyz - position.xyz);
     vec3 ambient = vec3(0.2, 0.2, 0.25);
-    
-    // Combine lighting with albedo
-    vec3 finalColor = (ambient + diffuse);
+    vec3 finalColor = ambient * albedo +
+                      u_sunColor.rgb * shade(normal, u_sunDirection.xyz,
+                                             viewDir, albedo, roughness,
+                                             specular);
+
+    // Cluster of the pixel, slices grow exponentially with view depth
+    float viewDepth = mul(u_cameraView, vec4(position.xyz, 1.0)).z;
+    float nearPlane = u_clusterParams.x;
+    float farPlane = u_clusterParams.y;
+    vec3 cluster = vec3(
+        floor((ndc.x * 0.5 + 0.5) * u_clusterSize.x),
+        floor((0.5 - ndc.y * 0.5) * u_clusterSize.y),
+        floor(log(clamp(viewDepth, nearPlane, farPlane) / nearPlane) /
+              log(farPlane / nearPlane) *
+              u_clusterSize.z));
+    cluster = min(cluster, u_clusterSize.xyz - 1.0);
+    vec2 clusterData = texture2DLod(
+        u_clusters,
+        vec2((cluster.y * u_clusterSize.x + cluster.x + 0.5) /
+                 (u_clusterSize.x * u_clusterSize.y),
+             (cluster.z + 0.5) / u_clusterSize.z),
+        0.0).xy;
+
+    for (int i = 0; i < MAX_CLUSTER_LIGHTS; i++) {
+        float entry = clusterData.x + float(i);
+        if (float(i) >= clusterData.y) {
+            break;
+        }
+        float index = texture2DLod(
+            u_lightIndices,
+            vec2((mod(entry, u_clusterSize.w) + 0.5) / u_clusterSize.w,
+                 (floor(entry / u_clusterSize.w) + 0.5) / INDEX_HEIGHT),
+            0.0).x;
+        vec4 positionRange = fetchLight(index, 0.0);
+        vec4 colorCosInner = fetchLight(index, 1.0);
+        vec4 directionCosOuter = fetchLight(index, 2.0);
+
+        vec3 toLight = positionRange.xyz - position.xyz;
+        float lightDistance = length(toLight);
+        vec3 lightDir = toLight / max(lightDistance, 0.0001);
+        // Inverse square, windowed to reach zero at the range
+        float fade = saturate(1.0 - pow(lightDistance / positionRange.w, 4.0));
+        float attenuation = fade * fade / (lightDistance * lightDistance + 1.0);
+        float spot = smoothstep(directionCosOuter.w, colorCosInner.w,
+                                dot(-lightDir, directionCosOuter.xyz));
+        finalColor += colorCosInner.rgb * attenuation * spot *
+                      shade(normal, lightDir, viewDir, albedo, roughness,
+                            specular);
+    }
     
     gl_FragColor = vec4(finalColor, 1.0);
 }
@@ -0,0 +1,326 @@
+#include "Bvh.hpp"
+#include <algorithm>
+#include <cfloat>
+
+namespace {
+float surfaceArea(const glm::vec3& min, const glm::vec3& max) {
+    glm::vec3 size = max - min;
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+bool overlaps(const glm::vec3& minA, const glm::vec3& maxA,
+              const glm::vec3& minB, const glm::vec3& maxB) {
+    return minA.x <= maxB.x && maxA.x >= minB.x && minA.y <= maxB.y &&
+           maxA.y >= minB.y && minA.z <= maxB.z && maxA.z >= minB.z;
+}
+
+// Slab test, returns the entry distance or FLT_MAX on a miss
+float intersect(const glm::vec3& origin, const glm::vec3& inverseDirection,
+                const glm::vec3& min, const glm::vec3& max,
+                float maxDistance) {
+    glm::vec3 t0 = (min - origin) * inverseDirection;
+    glm::vec3 t1 = (max - origin) * inverseDirection;
+    glm::vec3 lower = glm::min(t0, t1);
+    glm::vec3 upper = glm::max(t0, t1);
+    float enter = std::max(std::max(lower.x, lower.y), std::max(lower.z, 0.0f));
+    float leave =
+        std::min(std::min(upper.x, upper.y), std::min(upper.z, maxDistance));
+    return enter <= leave ? enter : FLT_MAX;
+}
+
+float centroid(const Bvh::Item& item, int axis) {
+    return (item.min[axis] + item.max[axis]) * 0.5f;
+}
+} // namespace
+
+void Bvh::Build(std::vector<Item> newItems) {
+    items = std::move(newItems);
+    Rebuild();
+}
+
+void Bvh::Rebuild() {
+    nodes.clear();
+    updates = 0;
+    if (items.empty()) {
+        leafOf.clear();
+        itemOf.clear();
+        return;
+    }
+
+    // A leaf holds at least one item, so this never reallocates
+    nodes.reserve(items.size() * 2);
+    nodes.push_back({glm::vec3(0.0f), 0, glm::vec3(0.0f),
+                     (uint32_t)items.size(), INVALID_INDEX});
+    fit(nodes[0]);
+    std::vector<uint32_t> stack{0};
+    while (!stack.empty()) {
+        uint32_t index = stack.back();
+        stack.pop_back();
+        subdivide(index);
+        if (nodes[index].count == 0) {
+            stack.push_back(nodes[index].first);
+            stack.push_back(nodes[index].first + 1);
+        }
+    }
+
+    // Items were reordered by the build
+    EntityId maxEntity = 0;
+    for (const Item& item : items) {
+        maxEntity = std::max(maxEntity, item.entity);
+    }
+    itemOf.assign((size_t)maxEntity + 1, INVALID_INDEX);
+    leafOf.assign(items.size(), INVALID_INDEX);
+    for (uint32_t i = 0; i < items.size(); i++) {
+        itemOf[items[i].entity] = i;
+    }
+    for (uint32_t i = 0; i < nodes.size(); i++) {
+        for (uint32_t j = 0; j < nodes[i].count; j++) {
+            leafOf[nodes[i].first + j] = i;
+        }
+    }
+}
+
+void Bvh::Clear() {
+    nodes.clear();
+    items.clear();
+    leafOf.clear();
+    itemOf.clear();
+    updates = 0;
+}
+
+void Bvh::fit(Node& node) const {
+    node.min = glm::vec3(FLT_MAX);
+    node.max = glm::vec3(-FLT_MAX);
+    if (node.count == 0) {
+        for (uint32_t child = node.first; child < node.first + 2; child++) {
+            node.min = glm::min(node.min, nodes[child].min);
+            node.max = glm::max(node.max, nodes[child].max);
+        }
+        return;
+    }
+    for (uint32_t i = node.first; i < node.first + node.count; i++) {
+        node.min = glm::min(node.min, items[i].min);
+        node.max = glm::max(node.max, items[i].max);
+    }
+}
+
+void Bvh::subdivide(uint32_t nodeIndex) {
+    Node& node = nodes[nodeIndex];
+    if (node.count <= MAX_LEAF_SIZE) {
+        return;
+    }
+    uint32_t first = node.first;
+    uint32_t count = node.count;
+
+    glm::vec3 centroidMin(FLT_MAX);
+    glm::vec3 centroidMax(-FLT_MAX);
+    for (uint32_t i = first; i < first + count; i++) {
+        glm::vec3 center = (items[i].min + items[i].max) * 0.5f;
+        centroidMin = glm::min(centroidMin, center);
+        centroidMax = glm::max(centroidMax, center);
+    }
+
+    // Binned SAH, the split with the smallest area times item count wins
+    struct Bin {
+        glm::vec3 min = glm::vec3(FLT_MAX);
+        glm::vec3 max = glm::vec3(-FLT_MAX);
+        uint32_t count = 0;
+    };
+    int bestAxis = -1;
+    uint32_t bestSplit = 0;
+    float bestCost = FLT_MAX;
+    for (int axis = 0; axis < 3; axis++) {
+        float extent = centroidMax[axis] - centroidMin[axis];
+        if (extent <= 0.0f) {
+            continue;
+        }
+        float scale = BIN_COUNT / extent;
+        Bin bins[BIN_COUNT];
+        for (uint32_t i = first; i < first + count; i++) {
+            uint32_t bin = std::min(
+                BIN_COUNT - 1,
+                (uint32_t)((centroid(items[i], axis) - centroidMin[axis]) *
+                           scale));
+            bins[bin].min = glm::min(bins[bin].min, items[i].min);
+            bins[bin].max = glm::max(bins[bin].max, items[i].max);
+            bins[bin].count++;
+        }
+
+        // Area and count left of each split, then sweep from the right
+        float leftCost[BIN_COUNT - 1];
+        Bin left;
+        for (uint32_t i = 0; i < BIN_COUNT - 1; i++) {
+            left.min = glm::min(left.min, bins[i].min);
+            left.max = glm::max(left.max, bins[i].max);
+            left.count += bins[i].count;
+            leftCost[i] =
+                left.count > 0 ? left.count * surfaceArea(left.min, left.max)
+                               : 0.0f;
+        }
+        Bin right;
+        for (uint32_t i = BIN_COUNT - 1; i > 0; i--) {
+            right.min = glm::min(right.min, bins[i].min);
+            right.max = glm::max(right.max, bins[i].max);
+            right.count += bins[i].count;
+            if (right.count == 0 || right.count == count) {
+                continue;
+            }
+            float cost = leftCost[i - 1] +
+                         right.count * surfaceArea(right.min, right.max);
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = i;
+            }
+        }
+    }
+
+    uint32_t middle;
+    if (bestAxis >= 0) {
+        float minimum = centroidMin[bestAxis];
+        float scale = BIN_COUNT / (centroidMax[bestAxis] - minimum);
+        Item* split = std::partition(
+            items.data() + first, items.data() + first + count,
+            [&](const Item& item) {
+                uint32_t bin = std::min(
+                    BIN_COUNT - 1,
+                    (uint32_t)((centroid(item, bestAxis) - minimum) * scale));
+                return bin < bestSplit;
+            });
+        middle = (uint32_t)(split - items.data());
+    } else {
+        // Every centroid is in the same place, any split is as good
+        middle = first + count / 2;
+    }
+
+    uint32_t leftIndex = (uint32_t)nodes.size();
+    nodes.push_back({glm::vec3(0.0f), first, glm::vec3(0.0f), middle - first,
+                     nodeIndex});
+    nodes.push_back({glm::vec3(0.0f), middle, glm::vec3(0.0f),
+                     first + count - middle, nodeIndex});
+    fit(nodes[leftIndex]);
+    fit(nodes[leftIndex + 1]);
+    // Reserved up front, node is still valid
+    node.first = leftIndex;
+    node.count = 0;
+}
+
+void Bvh::Update(EntityId entity, const glm::vec3& min, const glm::vec3& max) {
+    uint32_t index = itemOf[entity];
+    items[index].min = min;
+    items[index].max = max;
+    updates++;
+
+    // Refit up to the first node that does not change
+    uint32_t nodeIndex = leafOf[index];
+    while (nodeIndex != INVALID_INDEX) {
+        Node& node = nodes[nodeIndex];
+        glm::vec3 oldMin = node.min;
+        glm::vec3 oldMax = node.max;
+        fit(node);
+        if (node.min == oldMin && node.max == oldMax) {
+            break;
+        }
+        nodeIndex = node.parent;
+    }
+}
+
+void Bvh::QueryBox(const glm::vec3& min, const glm::vec3& max,
+                   std::vector<EntityId>& out) const {
+    if (nodes.empty()) {
+        return;
+    }
+    std::vector<uint32_t> stack{0};
+    while (!stack.empty()) {
+        const Node& node = nodes[stack.back()];
+        stack.pop_back();
+        if (!overlaps(node.min, node.max, min, max)) {
+            continue;
+        }
+        if (node.count == 0) {
+            stack.push_back(node.first);
+            stack.push_back(node.first + 1);
+            continue;
+        }
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            if (overlaps(items[i].min, items[i].max, min, max)) {
+                out.push_back(items[i].entity);
+            }
+        }
+    }
+}
+
+void Bvh::QueryFrustum(const glm::vec4 planes[6],
+                       std::vector<EntityId>& out) const {
+    // Tests the corner furthest along each plane normal
+    auto outside = [&](const glm::vec3& min, const glm::vec3& max) {
+        for (int i = 0; i < 6; i++) {
+            glm::vec3 normal(planes[i]);
+            glm::vec3 corner(normal.x >= 0.0f ? max.x : min.x,
+                             normal.y >= 0.0f ? max.y : min.y,
+                             normal.z >= 0.0f ? max.z : min.z);
+            if (glm::dot(normal, corner) + planes[i].w < 0.0f) {
+                return true;
+            }
+        }
+        return false;
+    };
+    if (nodes.empty()) {
+        return;
+    }
+    std::vector<uint32_t> stack{0};
+    while (!stack.empty()) {
+        const Node& node = nodes[stack.back()];
+        stack.pop_back();
+        if (outside(node.min, node.max)) {
+            continue;
+        }
+        if (node.count == 0) {
+            stack.push_back(node.first);
+            stack.push_back(node.first + 1);
+            continue;
+        }
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            if (!outside(items[i].min, items[i].max)) {
+                out.push_back(items[i].entity);
+            }
+        }
+    }
+}
+
+bool Bvh::Raycast(const glm::vec3& origin, const glm::vec3& direction,
+                  float maxDistance, EntityId& hit, float& distance) const {
+    if (nodes.empty()) {
+        return false;
+    }
+    glm::vec3 inverseDirection = 1.0f / direction;
+    float closest = maxDistance;
+    bool found = false;
+    std::vector<uint32_t> stack{0};
+    while (!stack.empty()) {
+        const Node& node = nodes[stack.back()];
+        stack.pop_back();
+        if (intersect(origin, inverseDirection, node.min, node.max,
+                      closest) == FLT_MAX) {
+            continue;
+        }
+        if (node.count == 0) {
+            stack.push_back(node.first);
+            stack.push_back(node.first + 1);
+            continue;
+        }
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            float t = intersect(origin, inverseDirection, items[i].min,
+                                items[i].max, closest);
+            if (t != FLT_MAX && (!found || t < closest)) {
+                closest = t;
+                hit = items[i].entity;
+                found = true;
+            }
+        }
+    }
+    if (found) {
+        distance = closest;
+    }
+    return found;
+}
@@ -4,6 +4,10 @@
 #include "bgfx/bgfx.h"
 #include "bx/math.h"
 
+namespace {
+uint64_t nextVersion = 0;
+} // namespace
+
 Camera::Camera(Renderer& renderer, const glm::vec3& position,
                const glm::vec3& up, float fov, float nearPlane, float farPlane)
     : renderer(renderer), position(position), up(up), fov(fov),
@@ -19,7 +23,8 @@ Camera::~Camera() {}
 Camera::Camera(Camera&& other) noexcept
     : renderer(other.renderer), position(other.position), up(other.up),
       target(other.target), fov(other.fov), nearPlane(other.nearPlane),
-      farPlane(other.farPlane) {
+      farPlane(other.farPlane), version(other.version),
+      aspectRatio(other.aspectRatio) {
     // Move the view and projection matrices
     std::copy(std::begin(other.view), std::end(other.view), view);
     std::copy(std::begin(other.projection), std::end(other.projection),
@@ -39,6 +44,8 @@ Camera& Camera::operator=(Camera&& other) noexcept {
         fov = other.fov;
         nearPlane = other.nearPlane;
         farPlane = other.farPlane;
+        version = other.version;
+        aspectRatio = other.aspectRatio;
 
         // Move the view and projection matrices
         std::copy(std::begin(other.view), std::end(other.view), view);
@@ -52,6 +59,9 @@ Camera& Camera::operator=(Camera&& other) noexcept {
     return *this;
 }
 void Camera::SetPosition(const glm::vec3& position) {
+    if (position == this->position) {
+        return;
+    }
     this->position = position;
     // Update the view matrix when the position changes
     LookAt(target);
@@ -75,11 +85,17 @@ void Camera::SetFarPlane(float farPlane) {
     SetProjection(fov, nearPlane, farPlane);
 }
 
-void Camera::SetProjection() { SetProjection(fov, nearPlane, farPlane); }
+void Camera::SetProjection() {
+    if (renderer.GetAspectRatio() != aspectRatio) {
+        SetProjection(fov, nearPlane, farPlane);
+    }
+}
 
 void Camera::SetProjection(float fov, float nearPlane, float farPlane) {
-    bx::mtxProj(projection, fov, renderer.GetAspectRatio(), nearPlane, farPlane,
+    aspectRatio = renderer.GetAspectRatio();
+    bx::mtxProj(projection, fov, aspectRatio, nearPlane, farPlane,
                 bgfx::getCaps()->homogeneousDepth);
+    version = ++nextVersion;
 }
 
 void Camera::LookAt(const glm::vec3& target) {
@@ -88,8 +104,21 @@ void Camera::LookAt(const glm::vec3& target) {
     bx::Vec3 positionVec = {position.x, position.y, position.z};
     bx::Vec3 targetVec = {target.x, target.y, target.z};
     bx::mtxLookAt(view, positionVec, targetVec, upVec);
+    version = ++nextVersion;
 }
 
 void Camera::SetViewTransform(bgfx::ViewId viewId) {
     bgfx::setViewTransform(viewId, view, projection);
 }
+
+void Camera::Capture(FrameSnapshot& snapshot) const {
+    if (snapshot.cameraVersion == version) {
+        return;
+    }
+    snapshot.cameraVersion = version;
+    std::copy(std::begin(view), std::end(view), snapshot.view);
+    std::copy(std::begin(projection), std::end(projection),
+              snapshot.projection);
+    snapshot.nearPlane = nearPlane;
+    snapshot.farPlane = farPlane;
+}
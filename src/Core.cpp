@@ -1,11 +1,14 @@
 #include "Core.hpp"
 
+#include "EventBus.hpp"
 #include "EventDispatcher.hpp"
+#include "Events.hpp"
 #include <SDL2/SDL.h>
 #include "Enums.hpp"
 #include "SDL_keyboard.h"
 #include "SDL_video.h"
 #include "bx/debug.h"
+#include <algorithm>
 #include <cstddef>
 #include <iostream>
 
@@ -18,10 +21,65 @@ bool Core::Init() {
         std::cerr << "SDL_Init Error: " << SDL_GetError() << std::endl;
         return false;
     }
-    lastKeyboardState = new uint8_t[SDL_NUM_SCANCODES];
+    // Core keeps its own copy of the keyboard state so it can be driven by
+    // recorded input as well as by SDL
+    keyboardState = new uint8_t[SDL_NUM_SCANCODES]();
+    lastKeyboardState = new uint8_t[SDL_NUM_SCANCODES]();
+
+    // Input is queued on the EventBus and reaches the callbacks when the
+    // PrePhysics phase is flushed. Only the last mouse move of a frame is
+    // kept.
+    EventBus& bus = EventBus::Get();
+    bus.SetDelivery<KeyEvent>(FramePhase::PrePhysics);
+    bus.SetDelivery<MouseMoveEvent>(FramePhase::PrePhysics, Coalesce::Latest);
+    bus.SetDelivery<MouseButtonEvent>(FramePhase::PrePhysics);
+    bus.SetDelivery<MouseWheelEvent>(FramePhase::PrePhysics);
+
+    EventDispatcher& dispatcher = EventDispatcher::Get();
+    inputListeners.push_back(
+        dispatcher.AddListener<KeyEvent>([this](const KeyEvent& e) {
+            // Pressed keys only go to the dispatcher listeners, the callback
+            // gets releases
+            if (keyEventCallback == nullptr || e.state != KeyState::Release)
+                return;
+            keyEventCallback(e.keycode, e.state);
+        }));
+    inputListeners.push_back(dispatcher.AddListener<MouseMoveEvent>(
+        [this](const MouseMoveEvent& e) {
+            if (mouseMoveEventCallback == nullptr) {
+                return;
+            }
+            mouseMoveEventCallback(e.x, e.y, e.xrel, e.yrel);
+        }));
+    inputListeners.push_back(dispatcher.AddListener<MouseButtonEvent>(
+        [this](const MouseButtonEvent& e) {
+            if (mouseButtonEventCallback == nullptr) {
+                return;
+            }
+            mouseButtonEventCallback(e.x, e.y, e.button, e.state);
+        }));
+    inputListeners.push_back(dispatcher.AddListener<MouseWheelEvent>(
+        [this](const MouseWheelEvent& e) {
+            if (mouseWheelEventCallback == nullptr) {
+                return;
+            }
+            mouseWheelEventCallback(e.x, e.y);
+        }));
     return true;
 }
 bool Core::Shutdown() {
+    for (EventHandle handle : inputListeners) {
+        EventDispatcher::Get().RemoveListener(handle);
+    }
+    inputListeners.clear();
+    for (EventHandle handle : keyPressListeners) {
+        EventDispatcher::Get().RemoveListener(handle);
+    }
+    keyPressListeners.clear();
+    if (keyboardState != nullptr) {
+        delete[] keyboardState;
+        keyboardState = nullptr;
+    }
     if (lastKeyboardState != nullptr) {
         delete[] lastKeyboardState;
         lastKeyboardState = nullptr;
@@ -30,80 +88,128 @@ bool Core::Shutdown() {
     return true;
 }
 void Core::EventLoop() {
-    while (SDL_PollEvent(&event)) {
-        switch (event.type) {
-        case SDL_EventType::SDL_KEYUP:
-            memcpy(lastKeyboardState, keyboardState,
-                   SDL_NUM_SCANCODES * sizeof(uint8_t));
-            keyboardState = SDL_GetKeyboardState(nullptr);
-            keyboardActive = false;
-            if (keyEventCallback == nullptr)
-                break;
-            keyEventCallback((Keycode)event.key.keysym.scancode,
-                             KeyState::Release);
-            break;
-        case SDL_EventType::SDL_KEYDOWN:
-            if (event.key.repeat == 1)
-                break;
-            keyboardState = SDL_GetKeyboardState(nullptr);
-            keyboardActive = true;
-            break;
-        case SDL_EventType::SDL_MOUSEMOTION:
-            if (mouseMoveEventCallback == nullptr) {
-                break;
-            }
-            mouseMoveEventCallback(event.motion.x, event.motion.y,
-                                   event.motion.xrel, event.motion.yrel);
-            break;
-        case SDL_EventType::SDL_MOUSEBUTTONDOWN:
-        case SDL_EventType::SDL_MOUSEBUTTONUP:
-            if (mouseButtonEventCallback == nullptr) {
-                break;
-            }
-            mouseButtonEventCallback(event.button.x, event.button.y,
-                                     (MouseButton)event.button.button,
-                                     (KeyState)event.button.state);
-            break;
-        case SDL_EventType::SDL_MOUSEWHEEL:
-            if (mouseWheelEventCallback == nullptr) {
-                break;
-            }
-            mouseWheelEventCallback(event.wheel.x, event.wheel.y);
-            break;
-        case SDL_EventType::SDL_QUIT:
+    if (inputRecorder != nullptr && inputRecorder->IsPlaying()) {
+        if (!inputRecorder->BeginFrame()) {
             quit = true;
-            break;
-        case SDL_EventType::SDL_WINDOWEVENT:
-            if (event.window.event == SDL_WINDOWEVENT_RESIZED) {
-                renderer->RecreateFrameBuffers(event.window.data1,
-                                               event.window.data2);
-            } else if (event.window.event == SDL_WINDOWEVENT_MINIMIZED) {
-                bx::debugPrintf("Window minimized\n");
-                WindowMinimized();
-                bx::debugPrintf("Minimized event sent\n");
+            return;
+        }
+        // Window events still come from SDL, input comes from the recording
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_EventType::SDL_QUIT ||
+                event.type == SDL_EventType::SDL_WINDOWEVENT) {
+                handleEvent(event);
             }
-            break;
-        default:
-            break;
         }
+        for (const InputEvent& input : inputRecorder->GetFrameEvents()) {
+            applyInputEvent(input);
+        }
+        return;
+    }
+
+    while (SDL_PollEvent(&event)) {
+        handleEvent(event);
+    }
+}
+
+void Core::handleEvent(const SDL_Event& event) {
+    InputEvent input{InputEventType::KeyDown};
+    switch (event.type) {
+    case SDL_EventType::SDL_KEYUP:
+        input.type = InputEventType::KeyUp;
+        input.code = (uint16_t)event.key.keysym.scancode;
+        break;
+    case SDL_EventType::SDL_KEYDOWN:
+        if (event.key.repeat == 1)
+            return;
+        input.type = InputEventType::KeyDown;
+        input.code = (uint16_t)event.key.keysym.scancode;
+        break;
+    case SDL_EventType::SDL_MOUSEMOTION:
+        input.type = InputEventType::MouseMove;
+        input.x = event.motion.x;
+        input.y = event.motion.y;
+        input.xrel = event.motion.xrel;
+        input.yrel = event.motion.yrel;
+        break;
+    case SDL_EventType::SDL_MOUSEBUTTONDOWN:
+    case SDL_EventType::SDL_MOUSEBUTTONUP:
+        input.type = InputEventType::MouseButton;
+        input.x = event.button.x;
+        input.y = event.button.y;
+        input.code = event.button.button;
+        input.state = event.button.state;
+        break;
+    case SDL_EventType::SDL_MOUSEWHEEL:
+        input.type = InputEventType::MouseWheel;
+        input.x = event.wheel.x;
+        input.y = event.wheel.y;
+        break;
+    case SDL_EventType::SDL_QUIT:
+        quit = true;
+        return;
+    case SDL_EventType::SDL_WINDOWEVENT:
+        if (event.window.event == SDL_WINDOWEVENT_RESIZED) {
+            renderer->RecreateFrameBuffers(event.window.data1,
+                                           event.window.data2);
+        } else if (event.window.event == SDL_WINDOWEVENT_MINIMIZED) {
+            bx::debugPrintf("Window minimized\n");
+            WindowMinimized();
+            bx::debugPrintf("Minimized event sent\n");
+        }
+        return;
+    default:
+        return;
+    }
+
+    if (inputRecorder != nullptr) {
+        inputRecorder->RecordEvent(input);
     }
+    applyInputEvent(input);
 }
 
-struct KeyEvent {
-    Keycode keycode;
-    KeyState state;
-};
+void Core::applyInputEvent(const InputEvent& input) {
+    EventBus& bus = EventBus::Get();
+    switch (input.type) {
+    case InputEventType::KeyUp:
+        if (input.code >= SDL_NUM_SCANCODES)
+            break;
+        memcpy(lastKeyboardState, keyboardState,
+               SDL_NUM_SCANCODES * sizeof(uint8_t));
+        keyboardState[input.code] = 0;
+        keyboardActive = false;
+        bus.Post(KeyEvent{(Keycode)input.code, KeyState::Release});
+        break;
+    case InputEventType::KeyDown:
+        if (input.code >= SDL_NUM_SCANCODES)
+            break;
+        keyboardState[input.code] = 1;
+        keyboardActive = true;
+        break;
+    case InputEventType::MouseMove:
+        bus.Post(MouseMoveEvent{input.x, input.y, input.xrel, input.yrel});
+        break;
+    case InputEventType::MouseButton:
+        bus.Post(MouseButtonEvent{input.x, input.y, (MouseButton)input.code,
+                                  (KeyState)input.state});
+        break;
+    case InputEventType::MouseWheel:
+        bus.Post(MouseWheelEvent{input.x, input.y});
+        break;
+    default:
+        break;
+    }
+}
 
 void Core::CallKeyboardEvent() {
+    // Only the key press listeners want pressed keys
     if (keyboardState == nullptr || keyEventCallback == nullptr ||
-        !keyboardActive) {
+        !keyboardActive || keyPressListeners.empty()) {
         return;
     }
     for (int i = 0; i < SDL_NUM_SCANCODES; ++i) {
         if (keyboardState[i] == 1 && lastKeyboardState[i] == 0) {
             // keyEventCallback((Keycode)i, KeyState::Pressed); LEGACY CODE
-            EventDispatcher::Get().DispatchEvent(
-                "KeyDown", KeyEvent{(Keycode)i, KeyState::Pressed});
+            EventBus::Get().Post(KeyEvent{(Keycode)i, KeyState::Pressed});
         }
     }
 }
@@ -127,6 +233,26 @@ void Core::SetKeyEventCallback(
     keyEventCallback = callback;
 }
 
+EventHandle
+Core::AddKeyPressListener(std::function<void(const KeyEvent&)> fn) {
+    EventHandle handle =
+        EventDispatcher::Get().AddListener<KeyEvent>(std::move(fn));
+    keyPressListeners.push_back(handle);
+    return handle;
+}
+
+void Core::RemoveKeyPressListener(EventHandle handle) {
+    auto it = std::find_if(keyPressListeners.begin(), keyPressListeners.end(),
+                           [&](const EventHandle& listener) {
+                               return listener.id == handle.id;
+                           });
+    if (it == keyPressListeners.end()) {
+        return;
+    }
+    keyPressListeners.erase(it);
+    EventDispatcher::Get().RemoveListener(handle);
+}
+
 void Core::SetMouseMoveEventCallback(
     std::function<void(int, int, int, int)> callback) {
     mouseMoveEventCallback = callback;
@@ -149,9 +275,15 @@ void Core::SetUpdateCallback(std::function<void(double)> callback) {
     updateCallback = callback;
 }
 
-double Core::GetDeltaTime() {
+void Core::BeginFrame() {
     now = bx::getHPCounter();
-    double deltaTime = double(now - lastTime) / double(freq);
+    deltaTime = double(now - lastTime) / double(freq);
     lastTime = now;
-    return deltaTime;
+    if (inputRecorder != nullptr) {
+        if (inputRecorder->IsPlaying()) {
+            deltaTime = inputRecorder->GetFrameDeltaTime();
+        } else {
+            inputRecorder->RecordDeltaTime(deltaTime);
+        }
+    }
 }
@@ -0,0 +1,111 @@
+#include "DepthPyramid.hpp"
+#include <algorithm>
+#include <bgfx/bgfx.h>
+#include <cfloat>
+
+void DepthPyramid::Build(const float* depth, uint32_t width, uint32_t height,
+                         uint32_t screenWidth, uint32_t screenHeight,
+                         const glm::mat4& viewProjection) {
+    const bgfx::Caps* caps = bgfx::getCaps();
+    homogeneousDepth = caps->homogeneousDepth;
+    originBottomLeft = caps->originBottomLeft;
+    this->viewProjection = viewProjection;
+    this->screenWidth = (float)screenWidth;
+    this->screenHeight = (float)screenHeight;
+
+    // Levels are kept between builds so their memory is reused
+    size_t count = 1;
+    for (uint32_t w = width, h = height; w > 1 || h > 1; count++) {
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+    levels.resize(count);
+    levels[0].width = width;
+    levels[0].height = height;
+    levels[0].depth.assign(depth, depth + (size_t)width * height);
+    for (size_t i = 1; i < count; i++) {
+        const Level& below = levels[i - 1];
+        Level& level = levels[i];
+        level.width = (below.width + 1) / 2;
+        level.height = (below.height + 1) / 2;
+        level.depth.resize((size_t)level.width * level.height);
+        for (uint32_t y = 0; y < level.height; y++) {
+            // Odd sizes leave the last texel with one texel below it
+            uint32_t y0 = y * 2;
+            uint32_t y1 = std::min(y0 + 1, below.height - 1);
+            for (uint32_t x = 0; x < level.width; x++) {
+                uint32_t x0 = x * 2;
+                uint32_t x1 = std::min(x0 + 1, below.width - 1);
+                level.depth[(size_t)y * level.width + x] = std::max(
+                    std::max(below.depth[(size_t)y0 * below.width + x0],
+                             below.depth[(size_t)y0 * below.width + x1]),
+                    std::max(below.depth[(size_t)y1 * below.width + x0],
+                             below.depth[(size_t)y1 * below.width + x1]));
+            }
+        }
+    }
+}
+
+void DepthPyramid::Clear() { levels.clear(); }
+
+bool DepthPyramid::IsOccluded(const glm::vec3& min,
+                              const glm::vec3& max) const {
+    if (levels.empty()) {
+        return false;
+    }
+
+    // Screen rectangle and nearest depth of the eight corners
+    glm::vec2 ndcMin(FLT_MAX);
+    glm::vec2 ndcMax(-FLT_MAX);
+    float nearest = FLT_MAX;
+    for (int i = 0; i < 8; i++) {
+        glm::vec4 corner(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y,
+                         i & 4 ? max.z : min.z, 1.0f);
+        glm::vec4 clip = viewProjection * corner;
+        if (clip.w <= 1e-5f) {
+            return false;
+        }
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        ndcMin = glm::min(ndcMin, glm::vec2(ndc));
+        ndcMax = glm::max(ndcMax, glm::vec2(ndc));
+        nearest = std::min(nearest, homogeneousDepth ? ndc.z * 0.5f + 0.5f
+                                                     : ndc.z);
+    }
+    if (ndcMin.x < -1.0f || ndcMin.y < -1.0f || ndcMax.x > 1.0f ||
+        ndcMax.y > 1.0f || nearest < 0.0f) {
+        return false;
+    }
+
+    // Level 0 texels covered by the rectangle, rows follow the texture
+    const Level& base = levels[0];
+    float scaleX = screenWidth * 0.5f / BLOCK_SIZE;
+    float scaleY = screenHeight * 0.5f / BLOCK_SIZE;
+    float top = originBottomLeft ? ndcMin.y + 1.0f : 1.0f - ndcMax.y;
+    float bottom = originBottomLeft ? ndcMax.y + 1.0f : 1.0f - ndcMin.y;
+    uint32_t x0 = (uint32_t)((ndcMin.x + 1.0f) * scaleX);
+    uint32_t x1 = (uint32_t)((ndcMax.x + 1.0f) * scaleX);
+    uint32_t y0 = (uint32_t)(top * scaleY);
+    uint32_t y1 = (uint32_t)(bottom * scaleY);
+    x1 = std::min(x1, base.width - 1);
+    y1 = std::min(y1, base.height - 1);
+    x0 = std::min(x0, x1);
+    y0 = std::min(y0, y1);
+
+    // The lowest level where the rectangle spans at most 4x4 texels. Fewer
+    // texels would test coarser depth and miss more occluded boxes.
+    size_t index = 0;
+    while (index + 1 < levels.size() &&
+           ((x1 >> index) - (x0 >> index) > 3 ||
+            (y1 >> index) - (y0 >> index) > 3)) {
+        index++;
+    }
+    const Level& level = levels[index];
+    for (uint32_t y = y0 >> index; y <= y1 >> index; y++) {
+        for (uint32_t x = x0 >> index; x <= x1 >> index; x++) {
+            if (nearest <= level.depth[(size_t)y * level.width + x]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
@@ -1,53 +1,57 @@
 #include "Entity.hpp"
+#include <cfloat>
 #include <cstdint>
+#include <cstring>
 #include <glm/fwd.hpp>
 #include <glm/gtc/quaternion.hpp>
 
 #include <bgfx/bgfx.h>
 #include "utils.hpp"
 
-Entity::Entity(RigidBodyType bodyType, PhysicsCore& physicsCore,
-               bgfx::VertexLayout& layout, uint64_t materialId,
-               glm::vec3 position, glm::vec3 rotation, glm::vec3 size)
-    : bodyType(bodyType), position(position), rotation(rotation), size(size),
-      materialId(materialId) {}
+Entity::Entity(EntityKind kind, RigidBodyType bodyType,
+               PhysicsCore& physicsCore, bgfx::VertexLayout& layout,
+               uint64_t materialId, glm::vec3 position, glm::vec3 rotation,
+               glm::vec3 size)
+    : kind(kind), bodyType(bodyType), entity(World::Get().Create()),
+      rotation(rotation), size(size) {
+    World& world = World::Get();
+    world.Add<Transform>(entity,
+                         {glm::translate(glm::mat4(1.0f), position)});
+    world.Add<RenderMesh>(entity);
+    world.Add<MaterialRef>(entity, {materialId});
+    world.Add<Bounds>(entity);
+    world.MarkChanged<Transform>(entity);
+}
 
+// The entity id moves with the object, the components stay in place
 Entity::Entity(Entity&& other) noexcept {
+    kind = other.kind;
     bodyType = other.bodyType;
-    position = other.position;
+    entity = other.entity;
     rotation = other.rotation;
     size = other.size;
-    transform = other.transform;
-    materialId = other.materialId;
-    vbh = other.vbh;
-    ibh = other.ibh;
     bodyID = other.bodyID;
     bodyInterface = other.bodyInterface;
 
+    other.entity = INVALID_ENTITY;
     other.bodyInterface = nullptr;
     other.bodyID = JPH::BodyID();
-    other.vbh.idx = bgfx::kInvalidHandle;
-    other.ibh.idx = bgfx::kInvalidHandle;
-    other.materialId = 0;
 }
 
 Entity& Entity::operator=(Entity&& other) noexcept {
     if (this != &other) {
+        Delete();
+        kind = other.kind;
         bodyType = other.bodyType;
-        position = other.position;
+        entity = other.entity;
         rotation = other.rotation;
         size = other.size;
-        transform = other.transform;
-        materialId = other.materialId;
-        vbh = other.vbh;
-        ibh = other.ibh;
         bodyID = other.bodyID;
         bodyInterface = other.bodyInterface;
 
+        other.entity = INVALID_ENTITY;
         other.bodyInterface = nullptr;
         other.bodyID = JPH::BodyID();
-        other.vbh.idx = bgfx::kInvalidHandle;
-        other.ibh.idx = bgfx::kInvalidHandle;
     }
     return *this;
 }
@@ -60,14 +64,100 @@ void Entity::Delete() {
         bodyInterface->DestroyBody(bodyID);
         bodyInterface = nullptr;
     }
-    if (vbh.idx != bgfx::kInvalidHandle) {
-        bgfx::destroy(vbh);
-        vbh.idx = bgfx::kInvalidHandle;
+    if (entity == INVALID_ENTITY) {
+        return;
+    }
+    destroyBuffers();
+    World::Get().Destroy(entity);
+    entity = INVALID_ENTITY;
+}
+
+void Entity::syncRigidBody() {
+    if (bodyType != RigidBodyType::Static && !bodyID.IsInvalid()) {
+        World::Get().Add<RigidBody>(entity, {bodyID});
+        // Lets the physics sync go from an active body back to the entity
+        if (bodyInterface) {
+            bodyInterface->SetUserData(bodyID, entity);
+        }
+    } else {
+        World::Get().Remove<RigidBody>(entity);
+    }
+}
+
+void Entity::createBuffers(const bgfx::Memory* vertices,
+                           const bgfx::Memory* indices,
+                           const bgfx::VertexLayout& layout,
+                           uint16_t indexFlags) {
+    destroyBuffers();
+    // Read before the buffer takes the memory
+    setLocalBounds(vertices, layout);
+    RenderMesh& mesh = renderMesh();
+    mesh.staticVbh = bgfx::createVertexBuffer(vertices, layout);
+    mesh.ibh = bgfx::createIndexBuffer(indices, indexFlags);
+}
+
+void Entity::updateBuffers(const bgfx::Memory* vertices,
+                           const bgfx::Memory* indices,
+                           const bgfx::VertexLayout& layout,
+                           uint16_t indexFlags) {
+    setLocalBounds(vertices, layout);
+    RenderMesh& mesh = renderMesh();
+    if (bgfx::isValid(mesh.staticVbh)) {
+        bgfx::destroy(mesh.staticVbh);
+        mesh.staticVbh = BGFX_INVALID_HANDLE;
+    }
+    if (bgfx::isValid(mesh.vbh)) {
+        // Grows the buffer when the new mesh has more vertices
+        bgfx::update(mesh.vbh, 0, vertices);
+    } else {
+        mesh.vbh = bgfx::createDynamicVertexBuffer(vertices, layout,
+                                                   BGFX_BUFFER_ALLOW_RESIZE);
+    }
+    if (bgfx::isValid(mesh.ibh)) {
+        bgfx::destroy(mesh.ibh);
     }
-    if (ibh.idx != bgfx::kInvalidHandle) {
-        bgfx::destroy(ibh);
-        ibh.idx = bgfx::kInvalidHandle;
+    mesh.ibh = bgfx::createIndexBuffer(indices, indexFlags);
+}
+
+void Entity::destroyBuffers() {
+    RenderMesh& mesh = renderMesh();
+    if (bgfx::isValid(mesh.staticVbh)) {
+        bgfx::destroy(mesh.staticVbh);
+        mesh.staticVbh = BGFX_INVALID_HANDLE;
+    }
+    if (bgfx::isValid(mesh.vbh)) {
+        bgfx::destroy(mesh.vbh);
+        mesh.vbh = BGFX_INVALID_HANDLE;
+    }
+    if (bgfx::isValid(mesh.ibh)) {
+        bgfx::destroy(mesh.ibh);
+        mesh.ibh = BGFX_INVALID_HANDLE;
+    }
+}
+
+void Entity::setLocalBounds(const bgfx::Memory* vertices,
+                            const bgfx::VertexLayout& layout) {
+    World& world = World::Get();
+    Bounds& bounds = world.Get<Bounds>(entity);
+    uint16_t stride = layout.getStride();
+    uint16_t offset = layout.getOffset(bgfx::Attrib::Position);
+    uint32_t count = stride == 0 ? 0 : vertices->size / stride;
+    if (count == 0) {
+        bounds.localMin = bounds.localMax = glm::vec3(0.0f);
+    } else {
+        bounds.localMin = glm::vec3(FLT_MAX);
+        bounds.localMax = glm::vec3(-FLT_MAX);
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        glm::vec3 position;
+        std::memcpy(&position, vertices->data + i * stride + offset,
+                    sizeof(position));
+        bounds.localMin = glm::min(bounds.localMin, position);
+        bounds.localMax = glm::max(bounds.localMax, position);
     }
+    bounds.Update(transform());
+    world.MarkChanged<Bounds>(entity);
+    world.MarkLayoutChanged();
 }
 
 // From: https://stackoverflow.com/a/66054048
@@ -89,11 +179,10 @@ void Entity::QuaternionRotate(glm::mat4& result, const glm::vec3& axis,
 
 void Entity::SetPhysicsPosition(glm::vec3 position,
                                 JPH::EActivation activation) {
-    if (this->position == position) {
+    if (GetPosition() == position) {
         return;
     }
-    this->position = position;
-    transform = glm::translate(glm::mat4(1.0f), position);
+    SetPosition(position);
     if (bodyInterface) {
         bodyInterface->SetPosition(bodyID, ToJPH(position), activation);
     }
@@ -105,11 +194,18 @@ void Entity::AddImpulse(glm::vec3 impulse) {
     }
 }
 
+void Entity::SetLinearVelocity(glm::vec3 velocity) {
+    if (bodyInterface) {
+        bodyInterface->SetLinearVelocity(bodyID, ToJPH(velocity));
+    }
+}
+
 void Entity::SetRotation(glm::vec3 rotation) {
     if (rotation == this->rotation) {
         return;
     }
     this->rotation = rotation;
+    glm::mat4& transform = editTransform();
     QuaternionRotate(transform, glm::vec3(1.0f, 0.0f, 0.0f), rotation.x);
     QuaternionRotate(transform, glm::vec3(0.0f, 1.0f, 0.0f), rotation.y);
     QuaternionRotate(transform, glm::vec3(0.0f, 0.0f, 1.0f), rotation.z);
@@ -117,6 +213,7 @@ void Entity::SetRotation(glm::vec3 rotation) {
 
 void Entity::AddRotation(glm::vec3 rotation) {
     this->rotation += rotation;
+    glm::mat4& transform = editTransform();
     QuaternionRotate(transform, glm::vec3(1.0f, 0.0f, 0.0f), rotation.x);
     QuaternionRotate(transform, glm::vec3(0.0f, 1.0f, 0.0f), rotation.y);
     QuaternionRotate(transform, glm::vec3(0.0f, 0.0f, 1.0f), rotation.z);
@@ -0,0 +1,36 @@
+#include "FrameTimings.hpp"
+#include "bx/debug.h"
+#include "bx/timer.h"
+#include <algorithm>
+
+void FrameTimings::BeginFrame() { frameStart = bx::getHPCounter(); }
+
+void FrameTimings::EndFrame() {
+    int64_t elapsed = bx::getHPCounter() - frameStart;
+    frameTimes.push_back(float(double(elapsed) * 1000.0 /
+                               double(bx::getHPFrequency())));
+}
+
+void FrameTimings::Clear() { frameTimes.clear(); }
+
+void FrameTimings::Report() const {
+    if (frameTimes.empty()) {
+        return;
+    }
+
+    std::vector<float> sorted = frameTimes;
+    std::sort(sorted.begin(), sorted.end());
+    double total = 0.0;
+    for (float time : sorted) {
+        total += time;
+    }
+    auto percentile = [&](double p) {
+        return sorted[size_t(p * double(sorted.size() - 1))];
+    };
+
+    bx::debugPrintf("Frame timings over %zu frames (ms): avg %.3f, min %.3f, "
+                    "p50 %.3f, p95 %.3f, p99 %.3f, max %.3f\n",
+                    sorted.size(), total / double(sorted.size()), sorted.front(),
+                    percentile(0.5), percentile(0.95), percentile(0.99),
+                    sorted.back());
+}
@@ -0,0 +1,244 @@
+#include "InputRecorder.hpp"
+#include "Events.hpp"
+#include "bx/debug.h"
+
+// "LNRI" followed by the format version
+static constexpr uint32_t INPUT_FILE_MAGIC = 0x49524e4c;
+static constexpr uint32_t INPUT_FILE_VERSION = 1;
+
+template <typename T> static void write(std::fstream& file, const T& value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T> static bool read(std::fstream& file, T& value) {
+    file.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return bool(file);
+}
+
+InputRecorder::~InputRecorder() { Close(); }
+
+bool InputRecorder::Open(const std::string& path, Mode mode) {
+    Close();
+    if (mode == Mode::Off) {
+        return true;
+    }
+
+    if (mode == Mode::Record) {
+        file.open(path, std::ios::binary | std::ios::out | std::ios::trunc);
+    } else {
+        file.open(path, std::ios::binary | std::ios::in);
+    }
+    if (!file.is_open()) {
+        bx::debugPrintf("Failed to open input recording: %s\n", path.c_str());
+        return false;
+    }
+
+    if (mode == Mode::Record) {
+        write(file, INPUT_FILE_MAGIC);
+        write(file, INPUT_FILE_VERSION);
+    } else {
+        uint32_t magic = 0;
+        uint32_t version = 0;
+        if (!read(file, magic) || !read(file, version) ||
+            magic != INPUT_FILE_MAGIC || version != INPUT_FILE_VERSION) {
+            bx::debugPrintf("Invalid input recording: %s\n", path.c_str());
+            file.close();
+            return false;
+        }
+    }
+
+    this->mode = mode;
+    frameIndex = 0;
+    diverged = false;
+    events.clear();
+    spawns.clear();
+    spawnListener = EventDispatcher::Get().AddListener<SpawnEvent>(
+        [this](const SpawnEvent& spawn) {
+            onSpawn(spawn.type, spawn.entityId);
+        });
+
+    bx::debugPrintf("%s input: %s\n",
+                    mode == Mode::Record ? "Recording" : "Playing back",
+                    path.c_str());
+    return true;
+}
+
+void InputRecorder::Close() {
+    if (mode == Mode::Off) {
+        return;
+    }
+    if (mode == Mode::Record && (!events.empty() || deltaTime > 0.0)) {
+        writeFrame();
+    }
+    EventDispatcher::Get().RemoveListener(spawnListener);
+    spawnListener = EventHandle{};
+    file.close();
+    bx::debugPrintf("Input %s closed after %llu frames\n",
+                    mode == Mode::Record ? "recording" : "playback",
+                    (unsigned long long)frameIndex);
+    mode = Mode::Off;
+}
+
+bool InputRecorder::BeginFrame() {
+    if (mode != Mode::Playback) {
+        return true;
+    }
+    return readFrame();
+}
+
+void InputRecorder::EndFrame() {
+    if (mode == Mode::Record) {
+        writeFrame();
+        return;
+    }
+    if (mode != Mode::Playback) {
+        return;
+    }
+
+    // Compare the spawns made this frame with the recorded ones
+    size_t expected = 0;
+    for (const InputEvent& event : events) {
+        if (event.type != InputEventType::Spawn) {
+            continue;
+        }
+        if (expected >= spawns.size() ||
+            spawns[expected].code != event.code ||
+            spawns[expected].entityId != event.entityId) {
+            break;
+        }
+        expected++;
+    }
+    size_t recorded = 0;
+    for (const InputEvent& event : events) {
+        recorded += event.type == InputEventType::Spawn;
+    }
+    if (!diverged && (expected != recorded || spawns.size() != recorded)) {
+        diverged = true;
+        bx::debugPrintf("Playback diverged at frame %llu: %zu spawns recorded, "
+                        "%zu made\n",
+                        (unsigned long long)frameIndex, recorded,
+                        spawns.size());
+    }
+    spawns.clear();
+}
+
+void InputRecorder::RecordEvent(const InputEvent& event) {
+    if (mode == Mode::Record) {
+        events.push_back(event);
+    }
+}
+
+void InputRecorder::RecordDeltaTime(double deltaTime) {
+    if (mode == Mode::Record) {
+        this->deltaTime = deltaTime;
+    }
+}
+
+void InputRecorder::onSpawn(PrimitiveType type, uint64_t entityId) {
+    InputEvent event{InputEventType::Spawn};
+    event.code = (uint16_t)type;
+    event.entityId = entityId;
+    if (mode == Mode::Record) {
+        events.push_back(event);
+    } else if (mode == Mode::Playback) {
+        spawns.push_back(event);
+    }
+}
+
+void InputRecorder::writeFrame() {
+    // Frame layout: delta time, event count, then each event with only the
+    // fields its type uses
+    write(file, deltaTime);
+    write(file, (uint16_t)events.size());
+    for (const InputEvent& event : events) {
+        write(file, (uint8_t)event.type);
+        switch (event.type) {
+        case InputEventType::KeyDown:
+        case InputEventType::KeyUp:
+            write(file, event.code);
+            break;
+        case InputEventType::MouseMove:
+            write(file, (int16_t)event.x);
+            write(file, (int16_t)event.y);
+            write(file, (int16_t)event.xrel);
+            write(file, (int16_t)event.yrel);
+            break;
+        case InputEventType::MouseButton:
+            write(file, (int16_t)event.x);
+            write(file, (int16_t)event.y);
+            write(file, (uint8_t)event.code);
+            write(file, event.state);
+            break;
+        case InputEventType::MouseWheel:
+            write(file, (int16_t)event.x);
+            write(file, (int16_t)event.y);
+            break;
+        case InputEventType::Spawn:
+            write(file, (uint8_t)event.code);
+            write(file, event.entityId);
+            break;
+        }
+    }
+    events.clear();
+    deltaTime = 0.0;
+    frameIndex++;
+}
+
+bool InputRecorder::readFrame() {
+    events.clear();
+    uint16_t count = 0;
+    if (!read(file, deltaTime) || !read(file, count)) {
+        return false;
+    }
+
+    events.reserve(count);
+    for (uint16_t i = 0; i < count; i++) {
+        uint8_t type = 0;
+        if (!read(file, type)) {
+            return false;
+        }
+        InputEvent event{(InputEventType)type};
+        int16_t x = 0, y = 0, xrel = 0, yrel = 0;
+        uint8_t code = 0;
+        bool ok = true;
+        switch (event.type) {
+        case InputEventType::KeyDown:
+        case InputEventType::KeyUp:
+            ok = read(file, event.code);
+            break;
+        case InputEventType::MouseMove:
+            ok = read(file, x) && read(file, y) && read(file, xrel) &&
+                 read(file, yrel);
+            break;
+        case InputEventType::MouseButton:
+            ok = read(file, x) && read(file, y) && read(file, code) &&
+                 read(file, event.state);
+            break;
+        case InputEventType::MouseWheel:
+            ok = read(file, x) && read(file, y);
+            break;
+        case InputEventType::Spawn:
+            ok = read(file, code) && read(file, event.entityId);
+            break;
+        default:
+            ok = false;
+            break;
+        }
+        if (!ok) {
+            bx::debugPrintf("Corrupt input recording at frame %llu\n",
+                            (unsigned long long)frameIndex);
+            return false;
+        }
+        if (event.type == InputEventType::MouseButton ||
+            event.type == InputEventType::Spawn) {
+            event.code = code;
+        }
+        event.x = x;
+        event.y = y;
+        event.xrel = xrel;
+        event.yrel = yrel;
+        events.push_back(event);
+    }
+    frameIndex++;
+    return true;
+}
@@ -0,0 +1,41 @@
+#include "JoltJobSystem.hpp"
+
+JoltJobSystem::JoltJobSystem(TaskSystem& tasks, JPH::uint maxBarriers,
+                             int maxConcurrency)
+    : JPH::JobSystemWithBarrier(maxBarriers), tasks(tasks),
+      maxConcurrency(maxConcurrency) {}
+
+JPH::JobSystem::JobHandle
+JoltJobSystem::CreateJob(const char* name, JPH::ColorArg color,
+                         const JobFunction& function,
+                         JPH::uint32 numDependencies) {
+    Job* job = new Job(name, color, this, function, numDependencies);
+    // The handle keeps a reference, the job may finish as soon as it is
+    // queued
+    JobHandle handle(job);
+    if (numDependencies == 0) {
+        QueueJob(job);
+    }
+    return handle;
+}
+
+void JoltJobSystem::QueueJob(Job* job) {
+    // Held until the task ran. The barrier may have run the job already, then
+    // Execute does nothing.
+    job->AddRef();
+    // The step blocks the main thread, so it goes before other work
+    tasks.Submit(
+        [job] {
+            job->Execute();
+            job->Release();
+        },
+        TaskPriority::High);
+}
+
+void JoltJobSystem::QueueJobs(Job** jobs, JPH::uint count) {
+    for (JPH::uint i = 0; i < count; i++) {
+        QueueJob(jobs[i]);
+    }
+}
+
+void JoltJobSystem::FreeJob(Job* job) { delete job; }
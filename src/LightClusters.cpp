@@ -0,0 +1,139 @@
+#include "LightClusters.hpp"
+#include <algorithm>
+#include <bx/debug.h>
+#include <cfloat>
+#include <cmath>
+#include <glm/gtc/type_ptr.hpp>
+
+LightClusters::LightClusters()
+    : lights((size_t)MAX_LIGHTS * 3 * 4, 0.0f),
+      clusters((size_t)CLUSTER_X * CLUSTER_Y * CLUSTER_Z * 2, 0.0f) {}
+
+uint32_t LightClusters::slice(float depth, float nearPlane,
+                              float farPlane) const {
+    depth = std::clamp(depth, nearPlane, farPlane);
+    float t = std::log(depth / nearPlane) / std::log(farPlane / nearPlane);
+    return std::min((uint32_t)(t * CLUSTER_Z), CLUSTER_Z - 1);
+}
+
+void LightClusters::Build(const std::vector<LightItem>& items,
+                          const float view[16], const float projection[16],
+                          float nearPlane, float farPlane) {
+    glm::mat4 viewMatrix = glm::make_mat4(view);
+    glm::mat4 projectionMatrix = glm::make_mat4(projection);
+    if (items.size() > MAX_LIGHTS) {
+        bx::debugPrintf("%zu lights, only the first %u are drawn\n",
+                        items.size(), MAX_LIGHTS);
+    }
+
+    // The clusters each light's sphere touches. A spot light is treated as
+    // the sphere its cone fits in.
+    ranges.clear();
+    lightCount = 0;
+    for (const LightItem& item : items) {
+        if (lightCount == MAX_LIGHTS) {
+            break;
+        }
+        glm::vec3 center = glm::vec3(
+            viewMatrix * glm::vec4(glm::vec3(item.positionRange), 1.0f));
+        float radius = item.positionRange.w;
+        // View space looks down +z
+        if (center.z + radius < nearPlane || center.z - radius > farPlane) {
+            continue;
+        }
+        Range range;
+        range.minZ = slice(center.z - radius, nearPlane, farPlane);
+        range.maxZ = slice(center.z + radius, nearPlane, farPlane);
+        glm::vec2 ndcMin(-1.0f);
+        glm::vec2 ndcMax(1.0f);
+        // Crossing the near plane it can cover any part of the screen
+        if (center.z - radius > nearPlane) {
+            ndcMin = glm::vec2(FLT_MAX);
+            ndcMax = glm::vec2(-FLT_MAX);
+            for (int i = 0; i < 8; i++) {
+                glm::vec3 corner =
+                    center + glm::vec3(i & 1 ? radius : -radius,
+                                       i & 2 ? radius : -radius,
+                                       i & 4 ? radius : -radius);
+                glm::vec4 clip = projectionMatrix * glm::vec4(corner, 1.0f);
+                glm::vec2 ndc = glm::vec2(clip) / clip.w;
+                ndcMin = glm::min(ndcMin, ndc);
+                ndcMax = glm::max(ndcMax, ndc);
+            }
+            if (ndcMax.x < -1.0f || ndcMin.x > 1.0f || ndcMax.y < -1.0f ||
+                ndcMin.y > 1.0f) {
+                continue;
+            }
+            ndcMin = glm::max(ndcMin, glm::vec2(-1.0f));
+            ndcMax = glm::min(ndcMax, glm::vec2(1.0f));
+        }
+        // Tile rows go from the top of the screen down
+        range.minX = std::min((uint32_t)((ndcMin.x * 0.5f + 0.5f) * CLUSTER_X),
+                              CLUSTER_X - 1);
+        range.maxX = std::min((uint32_t)((ndcMax.x * 0.5f + 0.5f) * CLUSTER_X),
+                              CLUSTER_X - 1);
+        range.minY = std::min((uint32_t)((0.5f - ndcMax.y * 0.5f) * CLUSTER_Y),
+                              CLUSTER_Y - 1);
+        range.maxY = std::min((uint32_t)((0.5f - ndcMin.y * 0.5f) * CLUSTER_Y),
+                              CLUSTER_Y - 1);
+        ranges.push_back(range);
+
+        float* data = lights.data() + (size_t)lightCount * 4;
+        const size_t row = (size_t)MAX_LIGHTS * 4;
+        std::copy_n(&item.positionRange.x, 4, data);
+        std::copy_n(&item.colorCosInner.x, 4, data + row);
+        std::copy_n(&item.directionCosOuter.x, 4, data + row * 2);
+        lightCount++;
+    }
+
+    // Count the lights of each cluster, then place the lists one after the
+    // other and fill them in
+    counts.assign((size_t)CLUSTER_X * CLUSTER_Y * CLUSTER_Z, 0);
+    auto index = [](uint32_t x, uint32_t y, uint32_t z) {
+        return ((size_t)z * CLUSTER_Y + y) * CLUSTER_X + x;
+    };
+    for (const Range& range : ranges) {
+        for (uint32_t z = range.minZ; z <= range.maxZ; z++) {
+            for (uint32_t y = range.minY; y <= range.maxY; y++) {
+                for (uint32_t x = range.minX; x <= range.maxX; x++) {
+                    counts[index(x, y, z)]++;
+                }
+            }
+        }
+    }
+    uint32_t offset = 0;
+    bool full = false;
+    for (size_t i = 0; i < counts.size(); i++) {
+        uint32_t count = counts[i];
+        if (offset + count > INDEX_WIDTH * INDEX_HEIGHT) {
+            count = INDEX_WIDTH * INDEX_HEIGHT - offset;
+            full = true;
+        }
+        clusters[i * 2] = (float)offset;
+        clusters[i * 2 + 1] = 0.0f;
+        counts[i] = count;
+        offset += count;
+    }
+    if (full) {
+        bx::debugPrintf("Light index list is full, some clusters are missing "
+                        "lights\n");
+    }
+    indexCount = offset;
+    indices.assign((size_t)GetIndexRows() * INDEX_WIDTH, 0.0f);
+    for (uint32_t light = 0; light < ranges.size(); light++) {
+        const Range& range = ranges[light];
+        for (uint32_t z = range.minZ; z <= range.maxZ; z++) {
+            for (uint32_t y = range.minY; y <= range.maxY; y++) {
+                for (uint32_t x = range.minX; x <= range.maxX; x++) {
+                    size_t cluster = index(x, y, z);
+                    float& filled = clusters[cluster * 2 + 1];
+                    if ((uint32_t)filled < counts[cluster]) {
+                        indices[(size_t)clusters[cluster * 2] +
+                                (size_t)filled] = (float)light;
+                        filled += 1.0f;
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,125 @@
+#include "LuaAllocator.hpp"
+#include "LuaProfiler.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+constexpr size_t CLASS_SIZES[LuaAllocator::NUM_CLASSES] = {16, 32,  48,  64,
+                                                          96, 128, 192, 256};
+
+// Maps (size + 15) / 16 to the smallest class that fits
+constexpr uint8_t CLASS_LOOKUP[17] = {0, 0, 1, 2, 3, 4, 4, 5, 5,
+                                      6, 6, 6, 6, 7, 7, 7, 7};
+
+inline size_t sizeClassOf(size_t size) { return CLASS_LOOKUP[(size + 15) / 16]; }
+} // namespace
+
+LuaAllocator::~LuaAllocator() {
+    for (void* chunk : chunks) {
+        std::free(chunk);
+    }
+}
+
+void* LuaAllocator::allocSmall(size_t sizeClass) {
+    if (FreeBlock* block = freeLists[sizeClass]) {
+        freeLists[sizeClass] = block->next;
+        return block;
+    }
+
+    size_t size = CLASS_SIZES[sizeClass];
+    if (bumpPtr[sizeClass] == nullptr ||
+        bumpPtr[sizeClass] + size > bumpEnd[sizeClass]) {
+        char* chunk = static_cast<char*>(std::malloc(CHUNK_SIZE));
+        if (chunk == nullptr) {
+            return nullptr;
+        }
+        chunks.push_back(chunk);
+        bumpPtr[sizeClass] = chunk;
+        bumpEnd[sizeClass] = chunk + CHUNK_SIZE;
+    }
+    void* block = bumpPtr[sizeClass];
+    bumpPtr[sizeClass] += size;
+    return block;
+}
+
+void LuaAllocator::freeSmall(void* ptr, size_t sizeClass) {
+    FreeBlock* block = static_cast<FreeBlock*>(ptr);
+    block->next = freeLists[sizeClass];
+    freeLists[sizeClass] = block;
+}
+
+void* LuaAllocator::allocate(size_t size) {
+    void* ptr = size <= MAX_SMALL_SIZE ? allocSmall(sizeClassOf(size))
+                                       : std::malloc(size);
+    if (ptr == nullptr) {
+        return nullptr;
+    }
+    liveBytes += size;
+    peakBytes = std::max(peakBytes, liveBytes);
+    if (size <= MAX_SMALL_SIZE) {
+        pooledBytes += size;
+    }
+    if (profiler != nullptr) {
+        profiler->RecordAllocation(size);
+    }
+    return ptr;
+}
+
+void LuaAllocator::deallocate(void* ptr, size_t size) {
+    liveBytes -= size;
+    if (size <= MAX_SMALL_SIZE) {
+        pooledBytes -= size;
+        freeSmall(ptr, sizeClassOf(size));
+    } else {
+        std::free(ptr);
+    }
+}
+
+void* LuaAllocator::Alloc(void* ud, void* ptr, size_t osize, size_t nsize) {
+    LuaAllocator* self = static_cast<LuaAllocator*>(ud);
+
+    // For new blocks Lua passes the object type in osize, not a size
+    if (ptr == nullptr) {
+        return nsize == 0 ? nullptr : self->allocate(nsize);
+    }
+    if (nsize == 0) {
+        self->deallocate(ptr, osize);
+        return nullptr;
+    }
+
+    bool oldSmall = osize <= MAX_SMALL_SIZE;
+    bool newSmall = nsize <= MAX_SMALL_SIZE;
+    if (oldSmall && newSmall && sizeClassOf(osize) == sizeClassOf(nsize)) {
+        // Still fits the same block
+        self->liveBytes += nsize - osize;
+        self->pooledBytes += nsize - osize;
+        self->peakBytes = std::max(self->peakBytes, self->liveBytes);
+        if (nsize > osize && self->profiler != nullptr) {
+            self->profiler->RecordAllocation(nsize - osize);
+        }
+        return ptr;
+    }
+    if (!oldSmall && !newSmall) {
+        void* block = std::realloc(ptr, nsize);
+        if (block == nullptr) {
+            return nullptr;
+        }
+        self->liveBytes += nsize - osize;
+        self->peakBytes = std::max(self->peakBytes, self->liveBytes);
+        if (nsize > osize && self->profiler != nullptr) {
+            self->profiler->RecordAllocation(nsize - osize);
+        }
+        return block;
+    }
+
+    // Moving between the pools and malloc
+    void* block = self->allocate(nsize);
+    if (block == nullptr) {
+        // Lua expects the old block to be untouched when shrinking fails
+        return nullptr;
+    }
+    std::memcpy(block, ptr, std::min(osize, nsize));
+    self->deallocate(ptr, osize);
+    return block;
+}
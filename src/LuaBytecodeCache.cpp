@@ -0,0 +1,157 @@
+#include "LuaBytecodeCache.hpp"
+#include "bx/debug.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+
+namespace {
+constexpr uint32_t CACHE_MAGIC = 0x42524e4c; // "LNRB"
+constexpr uint32_t CACHE_VERSION = 1;
+
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t luaVersion;
+    uint32_t reserved;
+    int64_t mtime;
+    uint64_t size;
+    uint64_t hash;
+};
+
+uint64_t fnv1a(const char* data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (uint8_t)data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+bool readFile(const std::string& path, std::string& out) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    out.assign(std::istreambuf_iterator<char>(file),
+               std::istreambuf_iterator<char>());
+    return true;
+}
+
+// Removes what luaL_loadfile skips and luaL_loadbufferx does not: a UTF-8
+// BOM and a first line starting with #. The newline of that line is kept so
+// the line numbers do not shift.
+void stripFilePrefix(std::string& source) {
+    if (source.compare(0, 3, "\xEF\xBB\xBF") == 0) {
+        source.erase(0, 3);
+    }
+    if (!source.empty() && source[0] == '#') {
+        source.erase(0, source.find('\n'));
+    }
+}
+
+int dumpWriter(lua_State* L, const void* p, size_t size, void* ud) {
+    static_cast<std::string*>(ud)->append(static_cast<const char*>(p), size);
+    return 0;
+}
+} // namespace
+
+LuaBytecodeCache::LuaBytecodeCache(std::string directory)
+    : directory(std::move(directory)) {}
+
+std::string LuaBytecodeCache::entryPath(const std::string& path) const {
+    std::error_code ec;
+    std::string key =
+        std::filesystem::absolute(path, ec).lexically_normal().string();
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.luac",
+             (unsigned long long)fnv1a(key.data(), key.size()));
+    return (std::filesystem::path(directory) / name).string();
+}
+
+int LuaBytecodeCache::Load(lua_State* L, const std::string& path) const {
+    if (!enabled) {
+        return luaL_loadfile(L, path.c_str());
+    }
+
+    std::error_code ec;
+    auto mtime = std::filesystem::last_write_time(path, ec);
+    uint64_t size = ec ? 0 : std::filesystem::file_size(path, ec);
+    if (ec) {
+        // Let Lua report the missing file
+        return luaL_loadfile(L, path.c_str());
+    }
+    int64_t stamp = (int64_t)mtime.time_since_epoch().count();
+    std::string chunkName = "@" + path;
+    std::string cachePath = entryPath(path);
+
+    std::string entry;
+    CacheHeader header{};
+    bool haveEntry = readFile(cachePath, entry) &&
+                     entry.size() >= sizeof(CacheHeader);
+    if (haveEntry) {
+        std::memcpy(&header, entry.data(), sizeof(CacheHeader));
+        haveEntry = header.magic == CACHE_MAGIC &&
+                    header.version == CACHE_VERSION &&
+                    header.luaVersion == LUA_VERSION_NUM;
+    }
+
+    auto loadEntry = [&]() {
+        return luaL_loadbufferx(L, entry.data() + sizeof(CacheHeader),
+                                entry.size() - sizeof(CacheHeader),
+                                chunkName.c_str(), "b");
+    };
+
+    // Same timestamp and size, trust the entry without reading the source
+    if (haveEntry && header.mtime == stamp && header.size == size) {
+        if (loadEntry() == LUA_OK) {
+            return LUA_OK;
+        }
+        lua_pop(L, 1);
+    }
+
+    std::string source;
+    if (!readFile(path, source)) {
+        return luaL_loadfile(L, path.c_str());
+    }
+    uint64_t hash = fnv1a(source.data(), source.size());
+
+    // Touched but unchanged, the entry is still good
+    bool reuse = haveEntry && header.hash == hash && header.size == size;
+    if (reuse && loadEntry() != LUA_OK) {
+        lua_pop(L, 1);
+        reuse = false;
+    }
+    if (!reuse) {
+        stripFilePrefix(source);
+        int status = luaL_loadbufferx(L, source.data(), source.size(),
+                                      chunkName.c_str(), "t");
+        if (status != LUA_OK) {
+            return status;
+        }
+        // Keep debug info so errors still point at the right lines
+        entry.assign(sizeof(CacheHeader), '\0');
+        lua_dump(L, dumpWriter, &entry, 0);
+    }
+
+    header = {CACHE_MAGIC, CACHE_VERSION, LUA_VERSION_NUM, 0,
+              stamp,       size,          hash};
+    std::memcpy(entry.data(), &header, sizeof(CacheHeader));
+
+    // Write to a temporary file first so a crash never leaves a torn entry
+    std::filesystem::create_directories(directory, ec);
+    std::string tempPath = cachePath + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.write(entry.data(), entry.size())) {
+            bx::debugPrintf("Failed to write bytecode cache: %s\n",
+                            tempPath.c_str());
+            return LUA_OK;
+        }
+    }
+    std::filesystem::rename(tempPath, cachePath, ec);
+    return LUA_OK;
+}
@@ -3,12 +3,14 @@
 #include <lua.hpp>
 #include <sol/sol.hpp>
 #include <iostream>
+#include "bx/debug.h"
 
 #include "LuaType.hpp"
 #include "LuaVector3.hpp"
 #include "LuaPrimitive.hpp"
 #include "LuaSignal.hpp"
 #include "LuaMaterial.hpp"
+#include "LuaSceneService.hpp"
 #include "LuaWindowService.hpp"
 
 namespace {
@@ -17,6 +19,13 @@ int luaGetVersion(lua_State* L) {
     return 1;
 }
 
+int luaPanic(lua_State* L) {
+    const char* message = lua_tostring(L, -1);
+    std::cerr << "Unprotected Lua error: "
+              << (message ? message : "error object is not a string")
+              << std::endl;
+    return 0; // Lua aborts after this
+}
 } // namespace
 namespace {
 int luaPrintOverride(lua_State* L) {
@@ -47,17 +56,77 @@ void LuaCore::registerGlobalFunction(lua_CFunction func,
 }
 
 void LuaCore::Run(std::string script) const {
-    prepare(script);
+    // Loading, running and everything the script connects or spawns is
+    // accounted to it
+    LuaProfiler::Scope scope(LuaProfiler::Get().GetOwner(script),
+                             LuaCallKind::Script);
+    if (!prepare(script)) {
+        return;
+    }
+    // Connections made while the script runs are recorded against it
+    lua_pushstring(L, script.c_str());
+    lua_setfield(L, LUA_REGISTRYINDEX, LuaUtil::CURRENT_SCRIPT_KEY);
     pcall(0, 0, 0);
+    lua_pushnil(L);
+    lua_setfield(L, LUA_REGISTRYINDEX, LuaUtil::CURRENT_SCRIPT_KEY);
+}
+
+void LuaCore::Update(double deltaTime) {
+    scheduler.Update(deltaTime);
+    if (gcStepKB > 0) {
+        lua_gc(L, LUA_GCSTEP, gcStepKB);
+    }
+    LuaProfiler::Get().Update(deltaTime);
+}
+
+void LuaCore::SetIncrementalGC(int pause, int stepMul, int stepSize) const {
+    lua_gc(L, LUA_GCINC, pause, stepMul, stepSize);
+}
+
+void LuaCore::SetGenerationalGC(int minorMul, int majorMul) const {
+    lua_gc(L, LUA_GCGEN, minorMul, majorMul);
+}
+
+void LuaCore::Reload(std::string script) {
+    bx::debugPrintf("Reloading %s\n", script.c_str());
+    disconnectScript(script);
+    lua_pushboolean(L, true);
+    lua_setglobal(L, "IsReloading");
+    Run(script);
+    lua_pushboolean(L, false);
+    lua_setglobal(L, "IsReloading");
 }
 
-void LuaCore::prepare(std::string script) const {
-    if (luaL_loadfile(L, script.c_str())) {
+void LuaCore::disconnectScript(const std::string& script) {
+    // Tasks left over from the old script would keep running its old code
+    scheduler.CancelOwner(LuaProfiler::Get().GetOwner(script));
+
+    if (lua_getfield(L, LUA_REGISTRYINDEX, LuaUtil::CONNECTIONS_KEY) !=
+        LUA_TTABLE) {
+        lua_pop(L, 1);
+        return;
+    }
+    if (lua_getfield(L, -1, script.c_str()) == LUA_TTABLE) {
+        lua_Integer count = (lua_Integer)lua_rawlen(L, -1);
+        for (lua_Integer i = 1; i <= count; i++) {
+            lua_rawgeti(L, -1, i);
+            pcall(0, 0, 0);
+        }
+    }
+    lua_pop(L, 1);
+    lua_pushnil(L);
+    lua_setfield(L, -2, script.c_str());
+    lua_pop(L, 1); // Pop the connections table
+}
+
+bool LuaCore::prepare(std::string script) const {
+    if (bytecodeCache.Load(L, script)) {
         std::cerr << "Failed to prepare file: " << lua_tostring(L, -1)
                   << std::endl;
         lua_pop(L, 1);
-        return;
+        return false;
     }
+    return true;
 }
 
 void LuaCore::SetGlobal(const std::string name, const std::string value) const {
@@ -73,18 +142,32 @@ std::string LuaCore::GetGlobal(std::string name) const {
 }
 // Sends a LuaSignal without any arguments to the Lua function
 void LuaCore::FireSignal(LuaSignal* signal) const {
+    lua_createtable(L, 1, 0);
     LuaUtil::Get().WrapAndPush(L, signal);
-    LuaSignal::luaSend(L);
-    lua_pop(L, 1); // Pop the signal from the stack
+    lua_rawseti(L, -2, 1);
+    int ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    EventBus::Get().Post(LuaSignalEvent{L, ref});
 };
 
 void LuaCore::Init() {
     luaL_openlibs(L);
+    lua_pushboolean(L, false);
+    lua_setglobal(L, "IsReloading");
     registerGlobalFunction(luaGetVersion, "Version");
     overrideLuaLibFunctions();
+    scheduler.Init(L);
+    LuaProfiler::Get().Init(L);
+
+    // Deferred signal sends are delivered in one batch before rendering
+    EventBus::Get().SetDelivery<LuaSignalEvent>(FramePhase::PreRender,
+                                                Coalesce::None, 1024);
+    EventBus::Get().SetDropHandler<LuaSignalEvent>(LuaSignal::Release);
+    signalListener = EventDispatcher::Get().AddListener<LuaSignalEvent>(
+        LuaSignal::Deliver);
 
     LuaType<LuaSignal> signalType(L, "Signal", true);
     signalType.AddMethod("Send", LuaSignal::luaSend)
+        .AddMethod("SendDeferred", LuaSignal::luaSendDeferred)
         .AddMethod("OnReceive", LuaSignal::luaOnReceive)
         .MakeClass(LuaSignal::luaNew);
 
@@ -93,10 +176,21 @@ void LuaCore::Init() {
         .AddProperty("Minimized", LuaWindowService::luaMinimized, nullptr)
         .MakeSingleton(&WindowService);
 
-    LuaType<LuaVector3> vector3(L, "Vector3", true);
+    LuaType<LuaSceneService> sceneService(L, "Scene", true, false);
+    sceneService.AddMethod("QueryBox", LuaSceneService::luaQueryBox)
+        .AddMethod("Raycast", LuaSceneService::luaRaycast)
+        .MakeSingleton(&SceneService);
+
+    // Vector3 is a value type, stored inline in the userdata
+    LuaType<LuaVector3> vector3(L, "Vector3");
     vector3.AddMethod("Dot", LuaVector3::luaDot)
         .AddMethod("Cross", LuaVector3::luaCross)
         .AddMethod("GetLength", LuaVector3::luaGetLength)
+        .AddMethod("Unpack", LuaVector3::luaUnpack)
+        .AddMethod("Set", LuaVector3::luaSet)
+        .AddMethod("AddInPlace", LuaVector3::luaAddInPlace)
+        .AddMethod("SubInPlace", LuaVector3::luaSubInPlace)
+        .AddMethod("ScaleInPlace", LuaVector3::luaScaleInPlace)
         .AddProperty("X", LuaVector3::luaGetX, nullptr)
         .AddProperty("Y", LuaVector3::luaGetY, nullptr)
         .AddProperty("Z", LuaVector3::luaGetZ, nullptr)
@@ -113,9 +207,15 @@ void LuaCore::Init() {
     LuaType<LuaPrimitive> primitive(L, "Primitive", true);
     primitive.AddMethod("SetPosition", LuaPrimitive::luaSetPosition)
         .AddMethod("GetPosition", LuaPrimitive::luaGetPosition)
+        .AddMethod("SetPositionXYZ", LuaPrimitive::luaSetPositionXYZ)
+        .AddMethod("GetPositionXYZ", LuaPrimitive::luaGetPositionXYZ)
         .AddMethod("SetType", LuaPrimitive::luaSetType)
         .AddMethod("GetType", LuaPrimitive::luaGetType)
         .AddMethod("Destroy", LuaPrimitive::luaDestroy)
+        .AddStaticFunction("SpawnMany", LuaPrimitive::luaSpawnMany)
+        .AddStaticFunction("SetPositions", LuaPrimitive::luaSetPositions)
+        .AddStaticFunction("SetVelocities", LuaPrimitive::luaSetVelocities)
+        .AddStaticFunction("GetPositions", LuaPrimitive::luaGetPositions)
         .MakeClass(LuaPrimitive::luaNew);
 
     sol::state_view lua(L);
@@ -139,9 +239,18 @@ void LuaCore::pcall(int nargs, int nresults, int errfunc) const {
 //     return 0;
 // }
 
-LuaCore::LuaCore() : L(luaL_newstate()), WindowService() {}
+LuaCore::LuaCore()
+    : allocator(&LuaProfiler::Get()),
+      L(lua_newstate(LuaAllocator::Alloc, &allocator)), WindowService(),
+      SceneService() {
+    lua_atpanic(L, luaPanic);
+    LuaProfiler::Get().SetAllocator(&allocator);
+}
 LuaCore::~LuaCore() {
+    EventDispatcher::Get().RemoveListener(signalListener);
+    EventBus::Get().Clear<LuaSignalEvent>();
     if (L) {
         lua_close(L);
     }
+    LuaProfiler::Get().SetAllocator(nullptr);
 }
@@ -5,20 +5,28 @@
 #include "Primitive.hpp"
 #include "SceneManager.hpp"
 #include "Enums.hpp"
+#include "EventDispatcher.hpp"
+#include "Events.hpp"
 #include <lua.hpp>
 #include <iostream>
 #include <glm/glm.hpp>
+#include <algorithm>
+#include <vector>
 
 LuaPrimitive::LuaPrimitive(PrimitiveType type) {
     this->m_ref =
         SceneManager::Get().AddEntity(type, RigidBodyType::Dynamic, 0);
+    EventDispatcher::Get().DispatchEvent(SpawnEvent{type, m_ref.id});
 }
 
 LuaPrimitive::LuaPrimitive(PrimitiveType type, LuaMaterial* material) {
     this->m_ref = SceneManager::Get().AddEntity(type, RigidBodyType::Dynamic,
                                                 material->GetID());
+    EventDispatcher::Get().DispatchEvent(SpawnEvent{type, m_ref.id});
 }
 
+LuaPrimitive::LuaPrimitive(SceneRef<Entity> ref) : m_ref(ref) {}
+
 LuaPrimitive::~LuaPrimitive() {
     // Destructor logic if needed
     std::cout << "LuaPrimitive destructor called for primitive" << std::endl;
@@ -32,7 +40,8 @@ LuaVector3 LuaPrimitive::GetPosition() {
 }
 
 PrimitiveType LuaPrimitive::GetType() {
-    Primitive* p = dynamic_cast<Primitive*>(m_ref.data);
+    // Only valid for a Primitive, see luaGetType
+    Primitive* p = static_cast<Primitive*>(m_ref.data);
     return p->GetType();
 }
 void LuaPrimitive::SetType(PrimitiveType type) {
@@ -66,6 +75,11 @@ PrimitiveType IntToPrimitiveType(int type) {
 
 int LuaPrimitive::luaGetType(lua_State* L) {
     LuaPrimitive* self = LuaUtil::Get().CheckUserdata<LuaPrimitive>(L, 1);
+    // Scene queries can return other entities, like imported meshes
+    if (self->GetEntity()->GetKind() != EntityKind::Primitive) {
+        lua_pushinteger(L, -1);
+        return 1;
+    }
     PrimitiveType type = self->GetType();
     int typeInt = PrimitiveTypeToInt(type);
     lua_pushinteger(L, typeInt);
@@ -80,15 +94,37 @@ int LuaPrimitive::luaSetType(lua_State* L) {
     return 0;
 }
 
-// Returns a copy of the position vector
+// Returns a copy of the position vector. If a Vector3 is passed it is filled
+// in and returned instead of creating a new one.
 int LuaPrimitive::luaGetPosition(lua_State* L) {
     LuaPrimitive* self = LuaUtil::Get().CheckUserdata<LuaPrimitive>(L, 1);
-    LuaVector3 pos = self->GetPosition();
-    LuaUtil::Get().CreateAndPush<LuaVector3>(L, pos.GetX(), pos.GetY(),
-                                             pos.GetZ());
+    if (!lua_isnoneornil(L, 2)) {
+        LuaVector3* out = LuaUtil::Get().CheckUserdata<LuaVector3>(L, 2);
+        out->Set(self->m_ref.data->GetPosition());
+        lua_settop(L, 2);
+        return 1;
+    }
+    LuaUtil::Get().CreateAndPush<LuaVector3>(L, self->GetPosition());
     return 1;
 }
 
+int LuaPrimitive::luaGetPositionXYZ(lua_State* L) {
+    LuaPrimitive* self = LuaUtil::Get().CheckUserdata<LuaPrimitive>(L, 1);
+    glm::vec3 pos = self->m_ref.data->GetPosition();
+    lua_pushnumber(L, pos.x);
+    lua_pushnumber(L, pos.y);
+    lua_pushnumber(L, pos.z);
+    return 3;
+}
+
+int LuaPrimitive::luaSetPositionXYZ(lua_State* L) {
+    LuaPrimitive* self = LuaUtil::Get().CheckUserdata<LuaPrimitive>(L, 1);
+    glm::vec3 pos(luaL_checknumber(L, 2), luaL_checknumber(L, 3),
+                  luaL_checknumber(L, 4));
+    self->m_ref.data->SetPhysicsPosition(pos);
+    return 0;
+}
+
 int LuaPrimitive::luaSetPosition(lua_State* L) {
     LuaPrimitive* self = LuaUtil::Get().CheckUserdata<LuaPrimitive>(L, 1);
     LuaVector3* position = LuaUtil::Get().CheckUserdata<LuaVector3>(L, 2);
@@ -123,3 +159,103 @@ int LuaPrimitive::luaNew(lua_State* L) {
     LuaUtil::Get().CreateAndPush<LuaPrimitive>(L, IntToPrimitiveType(type));
     return 1;
 }
+
+namespace {
+// Reads component i (0 based) of a flat {x1, y1, z1, x2, ...} array
+glm::vec3 readVec3(lua_State* L, int table, lua_Integer i) {
+    glm::vec3 v;
+    for (int c = 0; c < 3; c++) {
+        lua_rawgeti(L, table, i * 3 + c + 1);
+        v[c] = (float)lua_tonumber(L, -1);
+        lua_pop(L, 1);
+    }
+    return v;
+}
+
+Entity* checkPrimitiveAt(lua_State* L, int table, lua_Integer i) {
+    lua_rawgeti(L, table, i + 1);
+    LuaPrimitive* p = LuaUtil::Get().CheckUserdata<LuaPrimitive>(L, -1);
+    lua_pop(L, 1);
+    return p->GetEntity();
+}
+} // namespace
+
+// Primitive.SpawnMany(type, positions) where positions is a flat array of
+// numbers or an array of Vector3. Returns an array of the new primitives.
+int LuaPrimitive::luaSpawnMany(lua_State* L) {
+    PrimitiveType type = IntToPrimitiveType(luaL_checkinteger(L, 1));
+    luaL_checktype(L, 2, LUA_TTABLE);
+    lua_Integer len = luaL_len(L, 2);
+
+    std::vector<glm::vec3> positions;
+    lua_rawgeti(L, 2, 1);
+    bool vectors = lua_isuserdata(L, -1);
+    lua_pop(L, 1);
+    if (vectors) {
+        positions.reserve(len);
+        for (lua_Integer i = 1; i <= len; i++) {
+            lua_rawgeti(L, 2, i);
+            positions.push_back(
+                LuaUtil::Get().CheckUserdata<LuaVector3>(L, -1)->Get());
+            lua_pop(L, 1);
+        }
+    } else {
+        positions.reserve(len / 3);
+        for (lua_Integer i = 0; i < len / 3; i++) {
+            positions.push_back(readVec3(L, 2, i));
+        }
+    }
+
+    auto refs = SceneManager::Get().AddEntities(type, RigidBodyType::Dynamic,
+                                                0, positions);
+    lua_createtable(L, (int)refs.size(), 0);
+    for (size_t i = 0; i < refs.size(); i++) {
+        LuaUtil::Get().CreateAndPush<LuaPrimitive>(L, refs[i]);
+        lua_rawseti(L, -2, (lua_Integer)i + 1);
+        EventDispatcher::Get().DispatchEvent(SpawnEvent{type, refs[i].id});
+    }
+    return 1;
+}
+
+// Primitive.SetPositions(primitives, positions) with a flat number array
+int LuaPrimitive::luaSetPositions(lua_State* L) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    lua_Integer count = std::min(luaL_len(L, 1), luaL_len(L, 2) / 3);
+    for (lua_Integer i = 0; i < count; i++) {
+        checkPrimitiveAt(L, 1, i)->SetPhysicsPosition(readVec3(L, 2, i));
+    }
+    return 0;
+}
+
+// Primitive.SetVelocities(primitives, velocities) with a flat number array
+int LuaPrimitive::luaSetVelocities(lua_State* L) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    lua_Integer count = std::min(luaL_len(L, 1), luaL_len(L, 2) / 3);
+    for (lua_Integer i = 0; i < count; i++) {
+        checkPrimitiveAt(L, 1, i)->SetLinearVelocity(readVec3(L, 2, i));
+    }
+    return 0;
+}
+
+// Primitive.GetPositions(primitives, out) writes the positions as a flat
+// number array into out, creating it if not given, and returns it
+int LuaPrimitive::luaGetPositions(lua_State* L) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+    lua_Integer count = luaL_len(L, 1);
+    if (lua_istable(L, 2)) {
+        lua_settop(L, 2);
+    } else {
+        lua_settop(L, 1);
+        lua_createtable(L, (int)count * 3, 0);
+    }
+    for (lua_Integer i = 0; i < count; i++) {
+        glm::vec3 position = checkPrimitiveAt(L, 1, i)->GetPosition();
+        for (int c = 0; c < 3; c++) {
+            lua_pushnumber(L, position[c]);
+            lua_rawseti(L, 2, i * 3 + c + 1);
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,164 @@
+#include "LuaProfiler.hpp"
+#include "LuaAllocator.hpp"
+#include "bx/debug.h"
+#include "bx/timer.h"
+#include <algorithm>
+
+namespace {
+const char* KIND_NAMES[(size_t)LuaCallKind::Count] = {"script", "signal",
+                                                      "event", "task"};
+
+double toMilliseconds(int64_t ticks) {
+    return double(ticks) * 1000.0 / double(bx::getHPFrequency());
+}
+} // namespace
+
+LuaProfiler::LuaProfiler() : mainThread(std::this_thread::get_id()) {
+    owners.push_back({"engine"});
+    ownerIds["engine"] = ENGINE_OWNER;
+}
+
+LuaProfiler::Scope::Scope(OwnerId owner, LuaCallKind kind)
+    : owner(owner), previous(ENGINE_OWNER), kind(kind), start(0),
+      active(std::this_thread::get_id() == Get().mainThread) {
+    if (!active) {
+        return;
+    }
+    LuaProfiler& profiler = Get();
+    previous = profiler.current;
+    profiler.current = owner;
+    if (profiler.enabled) {
+        start = bx::getHPCounter();
+    }
+}
+
+LuaProfiler::Scope::~Scope() {
+    if (!active) {
+        return;
+    }
+    LuaProfiler& profiler = Get();
+    if (profiler.enabled && start != 0) {
+        profiler.RecordCall(owner, kind, bx::getHPCounter() - start);
+    }
+    profiler.current = previous;
+}
+
+LuaProfiler::OwnerId LuaProfiler::GetOwner(const std::string& name) {
+    auto it = ownerIds.find(name);
+    if (it != ownerIds.end()) {
+        return it->second;
+    }
+    OwnerId id = (OwnerId)owners.size();
+    owners.push_back({name});
+    ownerIds[name] = id;
+    return id;
+}
+
+void LuaProfiler::RecordCall(OwnerId owner, LuaCallKind kind, int64_t ticks) {
+    CallStats& stats = owners[owner].calls[(size_t)kind];
+    stats.calls++;
+    stats.ticks += ticks;
+    stats.maxTicks = std::max(stats.maxTicks, ticks);
+}
+
+void LuaProfiler::Update(double deltaTime) {
+    sinceReport += deltaTime;
+    if (reportInterval > 0.0 && sinceReport >= reportInterval) {
+        Report();
+        Reset();
+    }
+}
+
+void LuaProfiler::Report() const {
+    bx::debugPrintf("Lua profile over %.2f s\n", sinceReport);
+    for (const OwnerStats& owner : owners) {
+        bool any = owner.allocations > 0;
+        for (const CallStats& call : owner.calls) {
+            any = any || call.calls > 0;
+        }
+        if (!any) {
+            continue;
+        }
+
+        bx::debugPrintf("  %s: %zu allocs, %.1f KB allocated\n",
+                        owner.name.c_str(), owner.allocations,
+                        double(owner.bytesAllocated) / 1024.0);
+        for (size_t kind = 0; kind < (size_t)LuaCallKind::Count; kind++) {
+            const CallStats& call = owner.calls[kind];
+            if (call.calls == 0) {
+                continue;
+            }
+            bx::debugPrintf("    %-6s %8llu calls, total %.3f ms, avg %.4f ms, "
+                            "max %.4f ms\n",
+                            KIND_NAMES[kind], (unsigned long long)call.calls,
+                            toMilliseconds(call.ticks),
+                            toMilliseconds(call.ticks) / double(call.calls),
+                            toMilliseconds(call.maxTicks));
+        }
+    }
+    if (allocator != nullptr) {
+        bx::debugPrintf("  memory: %.1f KB live, %.1f KB peak, %.1f KB pooled "
+                        "in %.1f KB of chunks\n",
+                        double(allocator->GetLiveBytes()) / 1024.0,
+                        double(allocator->GetPeakBytes()) / 1024.0,
+                        double(allocator->GetPooledBytes()) / 1024.0,
+                        double(allocator->GetChunkBytes()) / 1024.0);
+    }
+}
+
+void LuaProfiler::Reset() {
+    for (OwnerStats& owner : owners) {
+        std::string name = std::move(owner.name);
+        owner = OwnerStats{std::move(name)};
+    }
+    sinceReport = 0.0;
+}
+
+void LuaProfiler::Init(lua_State* L) {
+    lua_createtable(L, 0, 3);
+    const luaL_Reg functions[] = {{"Report", luaReport},
+                                  {"GetStats", luaGetStats},
+                                  {"Reset", luaReset},
+                                  {nullptr, nullptr}};
+    luaL_setfuncs(L, functions, 0);
+    lua_setglobal(L, "Profiler");
+}
+
+// Profiler.Report() prints the stats since the last reset
+int LuaProfiler::luaReport(lua_State* L) {
+    Get().Report();
+    return 0;
+}
+
+// Profiler.GetStats() returns a table keyed by owner, with the allocated
+// bytes and the calls and milliseconds spent per kind of callback
+int LuaProfiler::luaGetStats(lua_State* L) {
+    const LuaProfiler& profiler = Get();
+    lua_createtable(L, 0, (int)profiler.owners.size());
+    for (const OwnerStats& owner : profiler.owners) {
+        lua_createtable(L, 0, 2 + (int)LuaCallKind::Count);
+        lua_pushinteger(L, (lua_Integer)owner.bytesAllocated);
+        lua_setfield(L, -2, "allocated");
+        lua_pushinteger(L, (lua_Integer)owner.allocations);
+        lua_setfield(L, -2, "allocations");
+        for (size_t kind = 0; kind < (size_t)LuaCallKind::Count; kind++) {
+            const CallStats& call = owner.calls[kind];
+            lua_createtable(L, 0, 3);
+            lua_pushinteger(L, (lua_Integer)call.calls);
+            lua_setfield(L, -2, "calls");
+            lua_pushnumber(L, toMilliseconds(call.ticks));
+            lua_setfield(L, -2, "time");
+            lua_pushnumber(L, toMilliseconds(call.maxTicks));
+            lua_setfield(L, -2, "maxTime");
+            lua_setfield(L, -2, KIND_NAMES[kind]);
+        }
+        lua_setfield(L, -2, owner.name.c_str());
+    }
+    return 1;
+}
+
+// Profiler.Reset() clears the counters
+int LuaProfiler::luaReset(lua_State* L) {
+    Get().Reset();
+    return 0;
+}
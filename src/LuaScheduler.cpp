@@ -0,0 +1,173 @@
+#include "LuaScheduler.hpp"
+#include "bx/timer.h"
+#include <algorithm>
+#include <iostream>
+
+namespace {
+// Yielded by task.wait to tell the scheduler how long to sleep
+char waitSentinel;
+
+// Heap order for the sleeping tasks, earliest wake time on top
+struct LaterWake {
+    template <typename T> bool operator()(const T& a, const T& b) const {
+        return a.wakeTime > b.wakeTime ||
+               (a.wakeTime == b.wakeTime && a.order > b.order);
+    }
+};
+
+LuaScheduler* getScheduler(lua_State* L) {
+    return static_cast<LuaScheduler*>(lua_touserdata(L, lua_upvalueindex(1)));
+}
+} // namespace
+
+void LuaScheduler::Init(lua_State* L) {
+    this->L = L;
+
+    lua_createtable(L, 0, 3);
+    const luaL_Reg functions[] = {{"spawn", luaSpawn},
+                                  {"defer", luaDefer},
+                                  {"wait", luaWait},
+                                  {nullptr, nullptr}};
+    lua_pushlightuserdata(L, this);
+    luaL_setfuncs(L, functions, 1);
+    lua_setglobal(L, "task");
+}
+
+// Moves the function and its arguments on the stack to a new thread
+LuaScheduler::Task LuaScheduler::createTask(lua_State* L) {
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    int nargs = lua_gettop(L) - 1;
+
+    Task task;
+    task.thread = lua_newthread(L);
+    task.ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    lua_xmove(L, task.thread, nargs + 1);
+    task.nargs = nargs;
+    task.owner = LuaProfiler::Get().GetCurrentOwner();
+    return task;
+}
+
+void LuaScheduler::release(Task& task) {
+    luaL_unref(L, LUA_REGISTRYINDEX, task.ref);
+    task.ref = LUA_NOREF;
+    task.thread = nullptr;
+}
+
+void LuaScheduler::resume(Task task, lua_State* from) {
+    int nres = 0;
+    int status;
+    {
+        LuaProfiler::Scope scope(task.owner, LuaCallKind::Task);
+        status = lua_resume(task.thread, from, task.nargs, &nres);
+    }
+
+    if (status == LUA_OK) {
+        release(task);
+        return;
+    }
+    if (status != LUA_YIELD) {
+        luaL_traceback(L, task.thread, lua_tostring(task.thread, -1), 0);
+        std::cerr << "Error in task: " << lua_tostring(L, -1) << std::endl;
+        lua_pop(L, 1);
+        release(task);
+        return;
+    }
+
+    if (nres == 2 && lua_touserdata(task.thread, -2) == &waitSentinel) {
+        double seconds = lua_tonumber(task.thread, -1);
+        lua_pop(task.thread, nres);
+        task.waitStart = time;
+        sleeping.push_back({time + seconds, sleepOrder++, task});
+        std::push_heap(sleeping.begin(), sleeping.end(),
+                       LaterWake());
+    } else {
+        // A plain coroutine.yield inside a task resumes on the next frame
+        lua_pop(task.thread, nres);
+        task.nargs = 0;
+        sleeping.push_back({time, sleepOrder++, task});
+        std::push_heap(sleeping.begin(), sleeping.end(),
+                       LaterWake());
+    }
+}
+
+void LuaScheduler::Update(double deltaTime) {
+    time += deltaTime;
+
+    // Tasks that are due join the back of the ready queue
+    while (!sleeping.empty() && sleeping.front().wakeTime <= time) {
+        std::pop_heap(sleeping.begin(), sleeping.end(),
+                      LaterWake());
+        Task task = sleeping.back().task;
+        sleeping.pop_back();
+
+        // task.wait returns the time actually waited
+        lua_pushnumber(task.thread, time - task.waitStart);
+        task.nargs = 1;
+        ready.push_back(task);
+    }
+
+    // Only run what was ready when the frame started, tasks deferred from
+    // inside a task run next frame
+    int64_t start = bx::getHPCounter();
+    int64_t budget = int64_t(frameBudget * double(bx::getHPFrequency()));
+    size_t count = ready.size();
+    for (size_t i = 0; i < count && !ready.empty(); i++) {
+        Task task = ready.front();
+        ready.pop_front();
+        resume(task, nullptr);
+        if (bx::getHPCounter() - start >= budget) {
+            break;
+        }
+    }
+}
+
+void LuaScheduler::CancelOwner(LuaProfiler::OwnerId owner) {
+    auto ownedReady = [&](Task& task) {
+        if (task.owner != owner) {
+            return false;
+        }
+        release(task);
+        return true;
+    };
+    ready.erase(std::remove_if(ready.begin(), ready.end(), ownedReady),
+                ready.end());
+
+    auto ownedSleeper = [&](Sleeper& sleeper) {
+        return ownedReady(sleeper.task);
+    };
+    sleeping.erase(
+        std::remove_if(sleeping.begin(), sleeping.end(), ownedSleeper),
+        sleeping.end());
+    std::make_heap(sleeping.begin(), sleeping.end(), LaterWake());
+}
+
+// task.spawn(fn, ...) runs fn as a task right away, until it first yields
+int LuaScheduler::luaSpawn(lua_State* L) {
+    LuaScheduler* self = getScheduler(L);
+    Task task = self->createTask(L);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, task.ref); // Return the thread
+    self->resume(task, L);
+    return 1;
+}
+
+// task.defer(fn, ...) runs fn as a task on the next scheduler update
+int LuaScheduler::luaDefer(lua_State* L) {
+    LuaScheduler* self = getScheduler(L);
+    Task task = self->createTask(L);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, task.ref);
+    self->ready.push_back(task);
+    return 1;
+}
+
+// task.wait(seconds) suspends the calling task, returns the time waited.
+// Without a duration it waits until the next frame.
+int LuaScheduler::luaWait(lua_State* L) {
+    double seconds = luaL_optnumber(L, 1, 0.0);
+    if (!lua_isyieldable(L)) {
+        return luaL_error(L, "task.wait can only be called from a task");
+    }
+    lua_settop(L, 0);
+    lua_pushlightuserdata(L, &waitSentinel);
+    lua_pushnumber(L, seconds);
+    return lua_yield(L, 2);
+}
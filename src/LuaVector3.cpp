@@ -5,11 +5,6 @@ LuaVector3::LuaVector3() : position(0.0f, 0.0f, 0.0f) {}
 LuaVector3::LuaVector3(glm::vec3 position) : position(position) {}
 LuaVector3::LuaVector3(float x, float y, float z) : position(x, y, z) {}
 
-LuaVector3::~LuaVector3() {
-    // Destructor logic if needed
-    // std::cout << "LuaVector3 destructor called for vector" << std::endl;
-}
-
 namespace {
 template <typename T> T* check(lua_State* L, int index) {
     T* obj = LuaUtil::Get().CheckUserdata<T>(L, index);
@@ -70,12 +65,8 @@ int LuaVector3::luaCross(lua_State* L) {
     LuaVector3* vec = check<LuaVector3>(L, 1);
     LuaVector3* other = check<LuaVector3>(L, 2);
 
-    lua_pop(L, 2); // Pop the two userdata from the stack to create new ones
-    LuaVector3 cross = vec->Cross(*other);
-    lua_pushnumber(L, cross.GetX());
-    lua_pushnumber(L, cross.GetY());
-    lua_pushnumber(L, cross.GetZ());
-    return luaNew(L);
+    LuaUtil::Get().CreateAndPush<LuaVector3>(L, vec->Cross(*other));
+    return 1;
 }
 
 int LuaVector3::luaGetLength(lua_State* L) {
@@ -87,12 +78,51 @@ int LuaVector3::luaGetLength(lua_State* L) {
 // Creates a normalized copy of the vector and returns it
 int LuaVector3::luaNormalize(lua_State* L) {
     LuaVector3* vec = check<LuaVector3>(L, 1);
-    lua_pop(L, 1); // Pop the userdata from the stack to create new ones
-    LuaVector3 normalized = vec->Normalize();
-    lua_pushnumber(L, normalized.GetX());
-    lua_pushnumber(L, normalized.GetY());
-    lua_pushnumber(L, normalized.GetZ());
-    return luaNew(L);
+    LuaUtil::Get().CreateAndPush<LuaVector3>(L, vec->Normalize());
+    return 1;
+}
+
+// Returns the components as x, y, z without creating a new vector
+int LuaVector3::luaUnpack(lua_State* L) {
+    LuaVector3* vec = check<LuaVector3>(L, 1);
+    lua_pushnumber(L, vec->position.x);
+    lua_pushnumber(L, vec->position.y);
+    lua_pushnumber(L, vec->position.z);
+    return 3;
+}
+
+// The in place methods modify self and return it, so calls can be chained
+// without allocating, e.g. v:AddInPlace(u):ScaleInPlace(2)
+int LuaVector3::luaSet(lua_State* L) {
+    LuaVector3* vec = check<LuaVector3>(L, 1);
+    vec->position.x = luaL_checknumber(L, 2);
+    vec->position.y = luaL_checknumber(L, 3);
+    vec->position.z = luaL_checknumber(L, 4);
+    lua_settop(L, 1);
+    return 1;
+}
+
+int LuaVector3::luaAddInPlace(lua_State* L) {
+    LuaVector3* vec = check<LuaVector3>(L, 1);
+    LuaVector3* other = check<LuaVector3>(L, 2);
+    vec->position += other->position;
+    lua_settop(L, 1);
+    return 1;
+}
+
+int LuaVector3::luaSubInPlace(lua_State* L) {
+    LuaVector3* vec = check<LuaVector3>(L, 1);
+    LuaVector3* other = check<LuaVector3>(L, 2);
+    vec->position -= other->position;
+    lua_settop(L, 1);
+    return 1;
+}
+
+int LuaVector3::luaScaleInPlace(lua_State* L) {
+    LuaVector3* vec = check<LuaVector3>(L, 1);
+    vec->position *= (float)luaL_checknumber(L, 2);
+    lua_settop(L, 1);
+    return 1;
 }
 
 int LuaVector3::luaNew(lua_State* L) {
@@ -0,0 +1,436 @@
+#include "LuaWorkerPool.hpp"
+#include "LuaPrimitive.hpp"
+#include "SceneManager.hpp"
+#include "EventDispatcher.hpp"
+#include "Events.hpp"
+#include "bx/debug.h"
+#include <iostream>
+
+namespace {
+// Registry table of signal name to the list of receiving functions
+constexpr const char* RECEIVERS_KEY = "loonar.receivers";
+// Metatable of the worker signals, a userdata with the name as user value
+constexpr const char* SIGNAL_METATABLE = "loonar.WorkerSignal";
+
+glm::vec3 checkVec3(lua_State* L, int index) {
+    return glm::vec3((float)luaL_checknumber(L, index),
+                     (float)luaL_checknumber(L, index + 1),
+                     (float)luaL_checknumber(L, index + 2));
+}
+
+void pushReceiverList(lua_State* L, const char* signal) {
+    if (lua_getfield(L, LUA_REGISTRYINDEX, RECEIVERS_KEY) != LUA_TTABLE) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_setfield(L, LUA_REGISTRYINDEX, RECEIVERS_KEY);
+    }
+    if (lua_getfield(L, -1, signal) != LUA_TTABLE) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_setfield(L, -3, signal);
+    }
+    lua_remove(L, -2); // Remove the receivers table
+}
+
+// The name of the worker signal at index, kept alive by the signal
+const char* checkSignal(lua_State* L, int index) {
+    luaL_checkudata(L, index, SIGNAL_METATABLE);
+    lua_getiuservalue(L, index, 1);
+    const char* name = lua_tostring(L, -1);
+    lua_pop(L, 1);
+    return name;
+}
+} // namespace
+
+LuaWorker::LuaWorker(size_t index, const SceneSnapshot& snapshot)
+    : L(lua_newstate(LuaAllocator::Alloc, &allocator)), index(index),
+      snapshot(&snapshot) {
+    luaL_openlibs(L);
+    lua_pushboolean(L, false);
+    lua_setglobal(L, "IsReloading");
+    lua_pushinteger(L, (lua_Integer)index);
+    lua_setglobal(L, "WorkerIndex");
+
+    lua_pushlightuserdata(L, this);
+    lua_pushcclosure(L, luaPrint, 1);
+    lua_setglobal(L, "print");
+
+    const luaL_Reg scene[] = {{"Spawn", luaSpawn},
+                              {"GetEntities", luaGetEntities},
+                              {"GetPosition", luaGetPosition},
+                              {"SetPosition", luaSetPosition},
+                              {"SetVelocity", luaSetVelocity},
+                              {"AddImpulse", luaAddImpulse},
+                              {"Destroy", luaDestroy},
+                              {nullptr, nullptr}};
+    lua_createtable(L, 0, 7);
+    lua_pushlightuserdata(L, this);
+    luaL_setfuncs(L, scene, 1);
+    lua_setglobal(L, "Scene");
+
+    // Signals have the Send and OnReceive methods of the main state's
+    // Signal. A LuaSignal keeps its callbacks as refs in one state and calls
+    // them right away, so it can not be shared between states. A worker
+    // signal is only a name instead: what is sent on it reaches every signal
+    // of that name in all workers, on their next update, like SendDeferred.
+    const luaL_Reg signal[] = {{"Send", luaSend},
+                               {"SendDeferred", luaSend},
+                               {"OnReceive", luaOnReceive},
+                               {nullptr, nullptr}};
+    luaL_newmetatable(L, SIGNAL_METATABLE);
+    lua_createtable(L, 0, 3);
+    lua_pushlightuserdata(L, this);
+    luaL_setfuncs(L, signal, 1);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1); // Pop the metatable
+    lua_createtable(L, 0, 1);
+    lua_pushcfunction(L, luaNewSignal);
+    lua_setfield(L, -2, "new");
+    lua_setglobal(L, "Signal");
+
+    scheduler.Init(L);
+}
+
+LuaWorker::~LuaWorker() {
+    if (L) {
+        lua_close(L);
+    }
+}
+
+bool LuaWorker::Run(const std::string& path) {
+    if (luaL_loadfile(L, path.c_str()) != LUA_OK) {
+        std::cerr << "Failed to prepare file: " << lua_tostring(L, -1)
+                  << std::endl;
+        lua_pop(L, 1);
+        return false;
+    }
+    if (lua_pcall(L, 0, 0, 0) != LUA_OK) {
+        std::cerr << "Error in worker " << index << ": " << lua_tostring(L, -1)
+                  << std::endl;
+        lua_pop(L, 1);
+        return false;
+    }
+    return true;
+}
+
+void LuaWorker::Update(double deltaTime,
+                       const std::vector<LuaMessage>& messages) {
+    for (const LuaMessage& message : messages) {
+        deliver(message);
+    }
+    scheduler.Update(deltaTime);
+}
+
+void LuaWorker::deliver(const LuaMessage& message) {
+    int top = lua_gettop(L);
+    if (lua_getfield(L, LUA_REGISTRYINDEX, RECEIVERS_KEY) != LUA_TTABLE ||
+        lua_getfield(L, -1, message.signal.c_str()) != LUA_TTABLE) {
+        lua_settop(L, top);
+        return;
+    }
+    int list = lua_gettop(L);
+    lua_Integer count = (lua_Integer)lua_rawlen(L, list);
+    for (lua_Integer i = 1; i <= count; i++) {
+        if (lua_rawgeti(L, list, i) != LUA_TFUNCTION) {
+            lua_pop(L, 1); // Disconnected by an earlier callback
+            continue;
+        }
+        for (const LuaMessageValue& value : message.args) {
+            switch (value.type) {
+            case LUA_TBOOLEAN:
+                lua_pushboolean(L, value.boolean);
+                break;
+            case LUA_TNUMBER:
+                if (value.isInteger) {
+                    lua_pushinteger(L, value.integer);
+                } else {
+                    lua_pushnumber(L, value.number);
+                }
+                break;
+            case LUA_TSTRING:
+                lua_pushlstring(L, value.string.data(), value.string.size());
+                break;
+            default:
+                lua_pushnil(L);
+                break;
+            }
+        }
+        if (lua_pcall(L, (int)message.args.size(), 0, 0) != LUA_OK) {
+            std::cerr << "Error in worker " << index
+                      << " signal callback: " << lua_tostring(L, -1)
+                      << std::endl;
+            lua_pop(L, 1);
+        }
+    }
+    lua_settop(L, top);
+}
+
+LuaWorker* LuaWorker::getWorker(lua_State* L) {
+    return static_cast<LuaWorker*>(lua_touserdata(L, lua_upvalueindex(1)));
+}
+
+void LuaWorker::pushCommand(lua_State* L, SceneCommand::Type type) {
+    SceneCommand command{type};
+    command.entityId = (uint64_t)luaL_checkinteger(L, 1);
+    if (type != SceneCommand::Type::Destroy) {
+        command.value = checkVec3(L, 2);
+    }
+    commands.push_back(command);
+}
+
+// Scene.Spawn(type, x, y, z) spawns a dynamic primitive at the next sync
+int LuaWorker::luaSpawn(lua_State* L) {
+    SceneCommand command{SceneCommand::Type::Spawn};
+    command.primitive = IntToPrimitiveType((int)luaL_checkinteger(L, 1));
+    command.value = checkVec3(L, 2);
+    getWorker(L)->commands.push_back(command);
+    return 0;
+}
+
+// Scene.GetEntities() returns the ids of the entities in the snapshot
+int LuaWorker::luaGetEntities(lua_State* L) {
+    const SceneSnapshot& snapshot = *getWorker(L)->snapshot;
+    lua_createtable(L, (int)snapshot.positions.size(), 0);
+    lua_Integer i = 1;
+    for (const auto& [id, position] : snapshot.positions) {
+        lua_pushinteger(L, (lua_Integer)id);
+        lua_rawseti(L, -2, i++);
+    }
+    return 1;
+}
+
+// Scene.GetPosition(id) returns x, y, z as of the last sync, or nil
+int LuaWorker::luaGetPosition(lua_State* L) {
+    const SceneSnapshot& snapshot = *getWorker(L)->snapshot;
+    auto it = snapshot.positions.find((uint64_t)luaL_checkinteger(L, 1));
+    if (it == snapshot.positions.end()) {
+        lua_pushnil(L);
+        return 1;
+    }
+    lua_pushnumber(L, it->second.x);
+    lua_pushnumber(L, it->second.y);
+    lua_pushnumber(L, it->second.z);
+    return 3;
+}
+
+int LuaWorker::luaSetPosition(lua_State* L) {
+    getWorker(L)->pushCommand(L, SceneCommand::Type::SetPosition);
+    return 0;
+}
+
+int LuaWorker::luaSetVelocity(lua_State* L) {
+    getWorker(L)->pushCommand(L, SceneCommand::Type::SetVelocity);
+    return 0;
+}
+
+int LuaWorker::luaAddImpulse(lua_State* L) {
+    getWorker(L)->pushCommand(L, SceneCommand::Type::AddImpulse);
+    return 0;
+}
+
+int LuaWorker::luaDestroy(lua_State* L) {
+    getWorker(L)->pushCommand(L, SceneCommand::Type::Destroy);
+    return 0;
+}
+
+// Signal.new(name) returns the signal of that name
+int LuaWorker::luaNewSignal(lua_State* L) {
+    luaL_checkstring(L, 1);
+    lua_newuserdatauv(L, 0, 1);
+    lua_pushvalue(L, 1);
+    lua_setiuservalue(L, -2, 1);
+    luaL_setmetatable(L, SIGNAL_METATABLE);
+    return 1;
+}
+
+// signal:Send(...) sends the values to every receiver of the signal in all
+// workers, delivered on their next update
+int LuaWorker::luaSend(lua_State* L) {
+    LuaMessage message;
+    message.signal = checkSignal(L, 1);
+    int n = lua_gettop(L);
+    for (int i = 2; i <= n; i++) {
+        LuaMessageValue value;
+        value.type = lua_type(L, i);
+        switch (value.type) {
+        case LUA_TNIL:
+            break;
+        case LUA_TBOOLEAN:
+            value.boolean = lua_toboolean(L, i);
+            break;
+        case LUA_TNUMBER:
+            value.isInteger = lua_isinteger(L, i);
+            value.integer = lua_tointeger(L, i);
+            value.number = lua_tonumber(L, i);
+            break;
+        case LUA_TSTRING: {
+            size_t length = 0;
+            const char* string = lua_tolstring(L, i, &length);
+            value.string.assign(string, length);
+            break;
+        }
+        default:
+            return luaL_argerror(L, i, "only nil, booleans, numbers and "
+                                       "strings can be sent");
+        }
+        message.args.push_back(std::move(value));
+    }
+    getWorker(L)->outbox.push_back(std::move(message));
+    return 0;
+}
+
+// signal:OnReceive(fn) calls fn with the values of every message sent on
+// the signal. Returns a function that disconnects it.
+int LuaWorker::luaOnReceive(lua_State* L) {
+    const char* signal = checkSignal(L, 1);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    pushReceiverList(L, signal);
+    lua_pushvalue(L, 2);
+    lua_rawseti(L, -2, (lua_Integer)lua_rawlen(L, -2) + 1);
+
+    // The list and the function are the upvalues of the disconnect function
+    lua_pushvalue(L, 2);
+    lua_pushcclosure(L, luaDisconnect, 2);
+    return 1;
+}
+
+int LuaWorker::luaDisconnect(lua_State* L) {
+    int list = lua_upvalueindex(1);
+    lua_Integer count = (lua_Integer)lua_rawlen(L, list);
+    for (lua_Integer i = 1; i <= count; i++) {
+        lua_rawgeti(L, list, i);
+        bool found = lua_rawequal(L, -1, lua_upvalueindex(2));
+        lua_pop(L, 1);
+        if (found) {
+            // Shift the rest of the list down
+            for (; i < count; i++) {
+                lua_rawgeti(L, list, i + 1);
+                lua_rawseti(L, list, i);
+            }
+            lua_pushnil(L);
+            lua_rawseti(L, list, count);
+            break;
+        }
+    }
+    return 0;
+}
+
+int LuaWorker::luaPrint(lua_State* L) {
+    LuaWorker* self = getWorker(L);
+    int n = lua_gettop(L);
+    std::string line = "[Lua " + std::to_string(self->index) + "]: ";
+    for (int i = 1; i <= n; i++) {
+        line += luaL_tolstring(L, i, nullptr);
+        line += " ";
+        lua_pop(L, 1);
+    }
+    // One write per line so output from the workers does not interleave
+    std::cout << line + "\n" << std::flush;
+    return 0;
+}
+
+LuaWorkerPool::~LuaWorkerPool() { Shutdown(); }
+
+void LuaWorkerPool::Init(size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        workers.push_back(std::make_unique<LuaWorker>(i, snapshot));
+    }
+    bx::debugPrintf("Started %zu Lua workers\n", count);
+}
+
+void LuaWorkerPool::Shutdown() {
+    TaskSystem::Get().Wait(updates);
+    updates.clear();
+    workers.clear();
+    messages.clear();
+}
+
+bool LuaWorkerPool::AddScript(const std::string& path) {
+    if (workers.empty()) {
+        return false;
+    }
+    LuaWorker& worker = *workers[nextWorker];
+    nextWorker = (nextWorker + 1) % workers.size();
+    return worker.Run(path);
+}
+
+void LuaWorkerPool::Kick(double deltaTime) {
+    // Scripts may run for most of a frame, so they are low priority and the
+    // threads waiting on shorter tasks leave them alone
+    for (auto& worker : workers) {
+        LuaWorker* updated = worker.get();
+        updates.push_back(TaskSystem::Get().Submit(
+            [this, updated, deltaTime] {
+                updated->Update(deltaTime, messages);
+            },
+            TaskPriority::Low));
+    }
+}
+
+void LuaWorkerPool::Sync() {
+    if (workers.empty()) {
+        return;
+    }
+    TaskSystem::Get().Wait(updates);
+    updates.clear();
+
+    // Workers are applied in order so the result does not depend on which
+    // thread finished first
+    messages.clear();
+    for (auto& worker : workers) {
+        applyCommands(worker->GetCommands());
+        std::vector<LuaMessage>& outbox = worker->GetOutbox();
+        for (LuaMessage& message : outbox) {
+            messages.push_back(std::move(message));
+        }
+        outbox.clear();
+    }
+    takeSnapshot();
+}
+
+void LuaWorkerPool::applyCommands(std::vector<SceneCommand>& commands) {
+    SceneManager& scene = SceneManager::Get();
+    auto& entities = scene.GetEntities();
+    for (const SceneCommand& command : commands) {
+        if (command.type == SceneCommand::Type::Spawn) {
+            auto ref = scene.AddEntity(command.primitive,
+                                       RigidBodyType::Dynamic, 0,
+                                       command.value);
+            EventDispatcher::Get().DispatchEvent(
+                SpawnEvent{command.primitive, ref.id});
+            continue;
+        }
+
+        auto it = entities.find(command.entityId);
+        if (it == entities.end()) {
+            continue; // Destroyed since the snapshot was taken
+        }
+        Entity* entity = it->second;
+        switch (command.type) {
+        case SceneCommand::Type::SetPosition:
+            entity->SetPhysicsPosition(command.value);
+            break;
+        case SceneCommand::Type::SetVelocity:
+            entity->SetLinearVelocity(command.value);
+            break;
+        case SceneCommand::Type::AddImpulse:
+            entity->AddImpulse(command.value);
+            break;
+        case SceneCommand::Type::Destroy:
+            scene.RemoveEntity(command.entityId);
+            break;
+        default:
+            break;
+        }
+    }
+    commands.clear();
+}
+
+void LuaWorkerPool::takeSnapshot() {
+    snapshot.positions.clear();
+    for (const auto& [id, entity] : SceneManager::Get().GetEntities()) {
+        snapshot.positions[id] = entity->GetPosition();
+    }
+}
@@ -11,7 +11,8 @@ MeshEntity::MeshEntity(MeshContainer& mesh, Collider* collider,
                        const RigidBodyType bodyType, PhysicsCore& physicsCore,
                        bgfx::VertexLayout& layout, uint64_t materialId,
                        glm::vec3 position, glm::vec3 rotation, glm::vec3 size)
-    : Entity(bodyType, physicsCore, layout, materialId, position, rotation, size),
+    : Entity(EntityKind::Mesh, bodyType, physicsCore, layout, materialId,
+             position, rotation, size),
       collider(collider) {
     const bgfx::Memory* verticesMem = nullptr;
     const bgfx::Memory* indicesMem = nullptr;
@@ -22,8 +23,7 @@ MeshEntity::MeshEntity(MeshContainer& mesh, Collider* collider,
             verticesMem, indicesMem);
         return;
     }
-    vbh = bgfx::createDynamicVertexBuffer(verticesMem, layout);
-    ibh = bgfx::createIndexBuffer(indicesMem, BGFX_BUFFER_INDEX32);
+    createBuffers(verticesMem, indicesMem, layout, BGFX_BUFFER_INDEX32);
 
     SetPosition(position);
     SetRotation(rotation);
@@ -56,6 +56,7 @@ MeshEntity::MeshEntity(MeshContainer& mesh, Collider* collider,
             physicsCore.AddDynamicCollider(colPos, collider->GetShape(), 1.0f);
     } break;
     }
+    syncRigidBody();
 }
 MeshEntity::MeshEntity(MeshEntity&& other) noexcept
     : Entity(std::move(other)), collider(other.collider), mesh(other.mesh) {}
@@ -87,14 +88,7 @@ void MeshEntity::UpdateMesh(PhysicsCore& physicsCore,
             verticesMem, indicesMem);
         return;
     }
-    if (vbh.idx != bgfx::kInvalidHandle) {
-        bgfx::destroy(vbh);
-    }
-    if (ibh.idx != bgfx::kInvalidHandle) {
-        bgfx::destroy(ibh);
-    }
-    vbh = bgfx::createDynamicVertexBuffer(verticesMem, layout);
-    ibh = bgfx::createIndexBuffer(indicesMem, BGFX_BUFFER_INDEX32);
+    updateBuffers(verticesMem, indicesMem, layout, BGFX_BUFFER_INDEX32);
 
     // Update the physics body with the new mesh
     physicsCore.RemoveBody(bodyID);
@@ -111,18 +105,19 @@ void MeshEntity::UpdateMesh(PhysicsCore& physicsCore,
     }
 
     bodyInterface = &physicsCore.GetBodyInterface();
-    JPH::Vec3 joltPosition = ToJPH(position);
+    JPH::Vec3 joltPosition = ToJPH(GetPosition());
     JPH::Vec3 joltSize = ToJPH(size);
 
     switch (bodyType) {
     case RigidBodyType::Static: {
-        JPH::Vec3 colPos = ToJPH(collider->GetPosition() + position);
+        JPH::Vec3 colPos = ToJPH(collider->GetPosition() + GetPosition());
         bodyID = physicsCore.AddStaticCollider(colPos, collider->GetShape());
     } break;
     case RigidBodyType::Dynamic: {
-        JPH::Vec3 colPos = ToJPH(collider->GetPosition() + position);
+        JPH::Vec3 colPos = ToJPH(collider->GetPosition() + GetPosition());
         bodyID =
             physicsCore.AddDynamicCollider(colPos, collider->GetShape(), 1.0f);
     } break;
     }
+    syncRigidBody();
 }
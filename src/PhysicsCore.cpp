@@ -6,18 +6,21 @@
 #include "Jolt/Physics/Collision/ContactListener.h"
 #include "Jolt/Physics/Collision/Shape/PlaneShape.h"
 #include "Jolt/Physics/Collision/Shape/SphereShape.h"
+#include "Jolt/Physics/StateRecorderImpl.h"
 #include "bx/debug.h"
+#include <algorithm>
 
 #include <Jolt/Jolt.h>
 #include <Jolt/Physics/PhysicsSystem.h>
 #include <Jolt/RegisterTypes.h>
 #include <Jolt/Core/TempAllocator.h>
-#include <Jolt/Core/JobSystemThreadPool.h>
 #include <Jolt/Physics/Body/Body.h>
 #include <Jolt/Physics/Body/BodyInterface.h>
 #include <Jolt/Physics/Collision/Shape/BoxShape.h>
 #include <Jolt/Physics/Collision/ObjectLayer.h>
 #include <Jolt/Physics/Collision/BroadPhase/BroadPhaseLayer.h>
+#include <Jolt/Physics/Body/BodyLock.h>
+#include <Jolt/Core/HashCombine.h>
 
 bool ObjectLayerPairFilterImpl::ShouldCollide(JPH::ObjectLayer inLayer1,
                                               JPH::ObjectLayer inLayer2) const {
@@ -107,20 +110,31 @@ void MyBodyActivationListener::OnBodyDeactivated(const JPH::BodyID& inBodyID,
     bx::debugPrintf("A body went to sleep, id: %d\n", inBodyID.GetIndex());
 }
 
+bool DeltaStateFilter::ShouldSaveBody(const JPH::Body& inBody) const {
+    uint32_t index = inBody.GetID().GetIndex();
+    return index < changed.size() && changed[index];
+}
+
 PhysicsCore::PhysicsCore()
     : jobSystem(nullptr), physicsSystem(nullptr), tempAllocator(nullptr) {}
 PhysicsCore::~PhysicsCore() { Shutdown(); }
 
-void PhysicsCore::Init() {
+void PhysicsCore::Init(bool deterministic) {
+    this->deterministic = deterministic;
+
     // Initialize Jolt
     JPH::RegisterDefaultAllocator();
     JPH::Factory::sInstance = new JPH::Factory();
     JPH::RegisterTypes();
 
-    // Create a job system with multiple threads
-    jobSystem = new JPH::JobSystemThreadPool(
-        JPH::cMaxPhysicsJobs, JPH::cMaxPhysicsBarriers,
-        std::thread::hardware_concurrency() - 1);
+    // Jolt runs its jobs on the engine task system. Deterministic mode pins
+    // the concurrency Jolt plans for so every machine splits the work the
+    // same way.
+    int concurrency = deterministic
+                          ? DETERMINISTIC_WORKER_COUNT + 1
+                          : (int)TaskSystem::Get().GetWorkerCount() + 1;
+    jobSystem = new JoltJobSystem(TaskSystem::Get(), JPH::cMaxPhysicsBarriers,
+                                  concurrency);
 
     // Create a temporary allocator
     tempAllocator = new JPH::TempAllocatorImpl(10 * 1024 * 1024); // 10 MB
@@ -136,16 +150,116 @@ void PhysicsCore::Init() {
     physicsSystem->Init(1024, 0, 1024, 1024, *broadPhaseLayerInterface,
                         *objectVsBroadPhaseLayerFilter, *objectLayerPairFilter);
     physicsSystem->SetGravity(JPH::Vec3(0, -9.81f, 0));
+
+    // Deterministic mode sorts contacts and constraints before solving so
+    // the order does not depend on which thread found them first. Outside
+    // of it the sort is skipped, nothing replays the simulation.
+    JPH::PhysicsSettings settings = physicsSystem->GetPhysicsSettings();
+    settings.mDeterministicSimulation = deterministic;
+    physicsSystem->SetPhysicsSettings(settings);
     // physicsSystem->SetContactListener(contactListener);
     // physicsSystem->SetBodyActivationListener(bodyActivationListener);
 
+#ifdef JPH_CROSS_PLATFORM_DETERMINISTIC
+    bx::debugPrintf("Jolt Physics built cross platform deterministic.\n");
+#else
+    if (deterministic) {
+        bx::debugPrintf("Warning: deterministic mode without a cross platform "
+                        "deterministic build, only same-binary runs will "
+                        "match.\n");
+    }
+#endif
     bx::debugPrintf("Jolt Physics initialized successfully.\n");
 }
 
 void PhysicsCore::Update(float deltaTime) {
     if (physicsSystem) {
         physicsSystem->Update(deltaTime, 2, tempAllocator, jobSystem);
+        stepCount++;
+    }
+}
+
+uint64_t PhysicsCore::ComputeStateHash() const {
+    uint64_t hash = JPH::HashBytes(&stepCount, sizeof(stepCount));
+    if (!physicsSystem) {
+        return hash;
     }
+
+    JPH::BodyIDVector bodies;
+    physicsSystem->GetBodies(bodies);
+    std::sort(bodies.begin(), bodies.end());
+
+    // Called between steps, so nothing else is touching the bodies
+    const JPH::BodyLockInterfaceNoLock& lockInterface =
+        physicsSystem->GetBodyLockInterfaceNoLock();
+    for (const JPH::BodyID& id : bodies) {
+        JPH::BodyLockRead lock(lockInterface, id);
+        if (!lock.Succeeded()) {
+            continue;
+        }
+        const JPH::Body& body = lock.GetBody();
+
+        // Store into plain floats so the padding lane of the SIMD types does
+        // not end up in the hash
+        JPH::Float3 values[4];
+        JPH::Vec3(body.GetPosition()).StoreFloat3(&values[0]);
+        body.GetLinearVelocity().StoreFloat3(&values[1]);
+        body.GetAngularVelocity().StoreFloat3(&values[2]);
+        body.GetRotation().GetXYZ().StoreFloat3(&values[3]);
+        float w = body.GetRotation().GetW();
+
+        JPH::uint32 index = id.GetIndexAndSequenceNumber();
+        hash = JPH::HashBytes(&index, sizeof(index), hash);
+        hash = JPH::HashBytes(values, sizeof(values), hash);
+        hash = JPH::HashBytes(&w, sizeof(w), hash);
+    }
+    return hash;
+}
+
+PhysicsSnapshot PhysicsCore::SaveSnapshot() const {
+    PhysicsSnapshot snapshot;
+    snapshot.step = stepCount;
+    if (!physicsSystem) {
+        return snapshot;
+    }
+
+    JPH::StateRecorderImpl recorder;
+    physicsSystem->SaveState(recorder, JPH::EStateRecorderState::All);
+    snapshot.data = recorder.GetData();
+    return snapshot;
+}
+
+PhysicsSnapshot
+PhysicsCore::SaveDeltaSnapshot(const std::vector<bool>& changed) const {
+    PhysicsSnapshot snapshot;
+    snapshot.step = stepCount;
+    snapshot.delta = true;
+    if (!physicsSystem) {
+        return snapshot;
+    }
+
+    JPH::StateRecorderImpl recorder;
+    DeltaStateFilter filter(changed);
+    physicsSystem->SaveState(recorder, JPH::EStateRecorderState::All, &filter);
+    snapshot.data = recorder.GetData();
+    return snapshot;
+}
+
+bool PhysicsCore::RestoreSnapshot(const PhysicsSnapshot& snapshot) {
+    if (!physicsSystem || snapshot.data.empty()) {
+        return false;
+    }
+
+    JPH::StateRecorderImpl recorder;
+    recorder.WriteBytes(snapshot.data.data(), snapshot.data.size());
+    recorder.Rewind();
+    if (!physicsSystem->RestoreState(recorder)) {
+        bx::debugPrintf("Failed to restore physics snapshot from step %llu\n",
+                        snapshot.step);
+        return false;
+    }
+    stepCount = snapshot.step;
+    return true;
 }
 
 JPH::BodyID PhysicsCore::AddStaticBox(const JPH::Vec3& position,
@@ -165,7 +279,7 @@ JPH::BodyID PhysicsCore::AddStaticBox(const JPH::Vec3& position,
     JPH::Body* body = bodyInterface.CreateBody(settings);
     if (body) {
         bodyID = body->GetID();
-        bodyInterface.AddBody(bodyID, JPH::EActivation::DontActivate);
+        addBody(bodyID, JPH::EActivation::DontActivate);
     }
     return JPH::BodyID(); // Return an invalid ID if body creation failed
 }
@@ -199,7 +313,7 @@ JPH::BodyID PhysicsCore::AddDynamicBox(const JPH::Vec3& position,
     JPH::Body* body = bodyInterface.CreateBody(bodySettings);
     if (body) {
         bodyID = body->GetID();
-        bodyInterface.AddBody(bodyID, JPH::EActivation::Activate);
+        addBody(bodyID, JPH::EActivation::Activate);
     } else {
         bx::debugPrintf("Failed to create dynamic sphere!\n");
     }
@@ -235,7 +349,7 @@ JPH::BodyID PhysicsCore::AddDynamicSphere(float radius, JPH::RVec3 position,
     JPH::Body* body = bodyInterface.CreateBody(bodySettings);
     if (body) {
         bodyID = body->GetID();
-        bodyInterface.AddBody(bodyID, JPH::EActivation::Activate);
+        addBody(bodyID, JPH::EActivation::Activate);
     } else {
         bx::debugPrintf("Failed to create dynamic sphere!\n");
     }
@@ -261,7 +375,7 @@ JPH::BodyID PhysicsCore::AddStaticPlane(const JPH::Vec3& position,
     JPH::Body* body = bodyInterface.CreateBody(settings);
     if (body) {
         bodyID = body->GetID();
-        bodyInterface.AddBody(bodyID, JPH::EActivation::DontActivate);
+        addBody(bodyID, JPH::EActivation::DontActivate);
         return bodyID;
     }
     return JPH::BodyID(); // Return an invalid ID if body creation failed
@@ -279,7 +393,7 @@ JPH::BodyID PhysicsCore::AddStaticCollider(const JPH::Vec3& position,
     JPH::Body* body = bodyInterface.CreateBody(settings);
     if (body) {
         bodyID = body->GetID();
-        bodyInterface.AddBody(bodyID, JPH::EActivation::DontActivate);
+        addBody(bodyID, JPH::EActivation::DontActivate);
         return bodyID;
     }
     return JPH::BodyID(); // Return an invalid ID if body creation failed
@@ -301,12 +415,46 @@ JPH::BodyID PhysicsCore::AddDynamicCollider(const JPH::Vec3& position,
     JPH::Body* body = bodyInterface.CreateBody(settings);
     if (body) {
         bodyID = body->GetID();
-        bodyInterface.AddBody(bodyID, JPH::EActivation::Activate);
+        addBody(bodyID, JPH::EActivation::Activate);
         return bodyID;
     }
     return JPH::BodyID(); // Return an invalid ID if body creation failed
 }
 
+void PhysicsCore::addBody(JPH::BodyID bodyID, JPH::EActivation activation) {
+    if (!batching) {
+        physicsSystem->GetBodyInterface().AddBody(bodyID, activation);
+        return;
+    }
+    if (activation == JPH::EActivation::Activate) {
+        batchActivate.push_back(bodyID);
+    } else {
+        batchDontActivate.push_back(bodyID);
+    }
+}
+
+void PhysicsCore::BeginBatch() { batching = true; }
+
+void PhysicsCore::EndBatch() {
+    batching = false;
+    JPH::BodyInterface& bodyInterface = physicsSystem->GetBodyInterface();
+
+    // Adding the bodies in one go lets Jolt build the broad phase nodes for
+    // them together instead of inserting them one by one
+    auto addAll = [&](JPH::BodyIDVector& bodies, JPH::EActivation activation) {
+        if (bodies.empty()) {
+            return;
+        }
+        JPH::BodyInterface::AddState state =
+            bodyInterface.AddBodiesPrepare(bodies.data(), (int)bodies.size());
+        bodyInterface.AddBodiesFinalize(bodies.data(), (int)bodies.size(),
+                                        state, activation);
+        bodies.clear();
+    };
+    addAll(batchActivate, JPH::EActivation::Activate);
+    addAll(batchDontActivate, JPH::EActivation::DontActivate);
+}
+
 void PhysicsCore::Shutdown() {
     if (physicsSystem) {
         delete physicsSystem;
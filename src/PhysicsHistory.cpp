@@ -0,0 +1,84 @@
+#include "PhysicsHistory.hpp"
+#include "bx/debug.h"
+
+PhysicsHistory::PhysicsHistory(size_t capacity, uint32_t keyframeInterval)
+    : capacity(capacity), keyframeInterval(keyframeInterval) {}
+
+void PhysicsHistory::markActiveBodies(const PhysicsCore& physicsCore) {
+    activeBodies.clear();
+    physicsCore.GetActiveBodies(activeBodies);
+    for (const JPH::BodyID& body : activeBodies) {
+        uint32_t index = body.GetIndex();
+        if (index >= changed.size()) {
+            changed.resize(index + 1, false);
+        }
+        changed[index] = true;
+    }
+}
+
+void PhysicsHistory::Record(const PhysicsCore& physicsCore) {
+    bool keyframe = snapshots.empty() || sinceKeyframe >= keyframeInterval;
+    if (keyframe) {
+        // A body awake now can move in the next step, even if it falls
+        // asleep before the next record
+        changed.assign(changed.size(), false);
+        markActiveBodies(physicsCore);
+        snapshots.push_back(physicsCore.SaveSnapshot());
+    } else {
+        markActiveBodies(physicsCore);
+        snapshots.push_back(physicsCore.SaveDeltaSnapshot(changed));
+    }
+    sinceKeyframe = keyframe ? 1 : sinceKeyframe + 1;
+
+    // Evict from the front, but never leave deltas without the keyframe they
+    // are based on.
+    while (snapshots.size() > capacity) {
+        snapshots.pop_front();
+        while (!snapshots.empty() && snapshots.front().delta) {
+            snapshots.pop_front();
+        }
+    }
+}
+
+bool PhysicsHistory::Rewind(PhysicsCore& physicsCore, uint64_t step) {
+    // Find the requested step and the keyframe it is based on
+    size_t target = snapshots.size();
+    for (size_t i = snapshots.size(); i-- > 0;) {
+        if (snapshots[i].step == step) {
+            target = i;
+            break;
+        }
+    }
+    if (target == snapshots.size()) {
+        bx::debugPrintf("No physics snapshot recorded for step %llu\n", step);
+        return false;
+    }
+
+    size_t keyframe = target;
+    while (snapshots[keyframe].delta) {
+        if (keyframe == 0) {
+            bx::debugPrintf("No keyframe found for step %llu\n", step);
+            return false;
+        }
+        keyframe--;
+    }
+
+    if (!physicsCore.RestoreSnapshot(snapshots[keyframe])) {
+        return false;
+    }
+    if (target != keyframe && !physicsCore.RestoreSnapshot(snapshots[target])) {
+        return false;
+    }
+
+    // changed only grew since the keyframe, so it still covers every body
+    // that moved between the keyframe and the target
+    snapshots.erase(snapshots.begin() + target + 1, snapshots.end());
+    sinceKeyframe = static_cast<uint32_t>(target - keyframe + 1);
+    return true;
+}
+
+void PhysicsHistory::Clear() {
+    snapshots.clear();
+    changed.clear();
+    sinceKeyframe = 0;
+}
@@ -16,13 +16,15 @@ Primitive::Primitive(PrimitiveType type, RigidBodyType bodyType,
                      PhysicsCore& physicsCore, bgfx::VertexLayout& layout,
                      uint64_t materialId, glm::vec3 position, glm::vec3 rotation,
                      glm::vec3 size)
-    : Entity(bodyType, physicsCore, layout, materialId, position, rotation, size) {
+    : Entity(EntityKind::Primitive, bodyType, physicsCore, layout, materialId,
+             position, rotation, size) {
     const bgfx::Memory* verticesMem = nullptr;
     const bgfx::Memory* indicesMem = nullptr;
     GetPrimitiveTypeData(verticesMem, indicesMem, type);
 
-    vbh = bgfx::createDynamicVertexBuffer(verticesMem, layout);
-    ibh = bgfx::createIndexBuffer(indicesMem);
+    createBuffers(verticesMem, indicesMem, layout);
+    bgfx::VertexBufferHandle vbh = renderMesh().staticVbh;
+    bgfx::IndexBufferHandle ibh = renderMesh().ibh;
     if (vbh.idx == bgfx::kInvalidHandle || ibh.idx == bgfx::kInvalidHandle) {
         bx::debugPrintf("Failed to create primitive: Type: %d vbh: %d ibh: %x\n",
                         type, vbh.idx, ibh.idx);
@@ -72,27 +74,27 @@ Primitive::Primitive(PrimitiveType type, RigidBodyType bodyType,
         }
     }
     }
+    syncRigidBody();
 }
 
 Primitive::Primitive(Primitive&& other) noexcept : Entity(std::move(other)) {
     type = other.type;
-    bx::debugPrintf("Primitive moved: Type: %d vbh: %d ibh: %d\n", type, vbh.idx,
-                    ibh.idx);
+    bx::debugPrintf("Primitive moved: Type: %d ibh: %d\n", type,
+                    renderMesh().ibh.idx);
 }
 
 Primitive& Primitive::operator=(Primitive&& other) noexcept {
     if (this != &other) {
         Entity::operator=(std::move(other));
         type = other.type;
-        bx::debugPrintf("Primitive moved: Type: %d vbh: %d ibh: %d\n", type,
-                        vbh.idx, ibh.idx);
+        bx::debugPrintf("Primitive moved: Type: %d ibh: %d\n", type,
+                        renderMesh().ibh.idx);
     }
     return *this;
 }
 
 Primitive::~Primitive() {
-    bx::debugPrintf("Primitive destroyed: Type: %d vbh: %d ibh: %d\n", type,
-                    vbh.idx, ibh.idx);
+    bx::debugPrintf("Primitive destroyed: Type: %d\n", type);
 }
 
 // Remember to call UpdateMesh after changing the type!
@@ -104,15 +106,9 @@ void Primitive::UpdateMesh(PhysicsCore& physicsCore,
     const bgfx::Memory* indicesMem = nullptr;
     GetPrimitiveTypeData(verticesMem, indicesMem, type);
 
-    if (vbh.idx != bgfx::kInvalidHandle) {
-        bgfx::destroy(vbh);
-    }
-    if (ibh.idx != bgfx::kInvalidHandle) {
-        bgfx::destroy(ibh);
-    }
-
-    vbh = bgfx::createDynamicVertexBuffer(verticesMem, layout);
-    ibh = bgfx::createIndexBuffer(indicesMem);
+    updateBuffers(verticesMem, indicesMem, layout);
+    bgfx::DynamicVertexBufferHandle vbh = renderMesh().vbh;
+    bgfx::IndexBufferHandle ibh = renderMesh().ibh;
     if (vbh.idx == bgfx::kInvalidHandle || ibh.idx == bgfx::kInvalidHandle) {
         bx::debugPrintf("Failed to create primitive: Type: %d vbh: %d ibh: %x\n",
                         type, vbh.idx, ibh.idx);
@@ -125,7 +121,7 @@ void Primitive::UpdateMesh(PhysicsCore& physicsCore,
     JPH::BodyInterface& bodyInterface = physicsCore.GetBodyInterface();
     physicsCore.RemoveBody(bodyID);
 
-    JPH::Vec3 joltPosition = ToJPH(position);
+    JPH::Vec3 joltPosition = ToJPH(GetPosition());
     JPH::Vec3 joltSize = ToJPH(size);
     switch (bodyType) {
     case RigidBodyType::Static: {
@@ -159,6 +155,7 @@ void Primitive::UpdateMesh(PhysicsCore& physicsCore,
         }
     }
     }
+    syncRigidBody();
 }
 
 void Primitive::GetPrimitiveTypeData(const bgfx::Memory*& vertMem,
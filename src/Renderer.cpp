@@ -5,7 +5,10 @@
 #include "bgfx/bgfx.h"
 #include "bgfx/platform.h"
 #include "bgfx/defines.h"
+#include "bx/debug.h"
 #include "bx/math.h"
+#include <cstring>
+#include <glm/gtc/type_ptr.hpp>
 #include <iostream>
 
 #include <glsl/vs_geom.sc.bin.h>
@@ -29,6 +32,10 @@
 #include <essl/fs_combine.sc.bin.h>
 #include <spirv/fs_combine.sc.bin.h>
 
+#include <glsl/fs_depth.sc.bin.h>
+#include <essl/fs_depth.sc.bin.h>
+#include <spirv/fs_depth.sc.bin.h>
+
 #if BX_PLATFORM_WINDOWS
 #include <dx11/vs_geom.sc.bin.h>
 #include <dx11/fs_geom.sc.bin.h>
@@ -36,6 +43,7 @@
 #include <dx11/fs_light.sc.bin.h>
 #include <dx11/vs_combine.sc.bin.h>
 #include <dx11/fs_combine.sc.bin.h>
+#include <dx11/fs_depth.sc.bin.h>
 
 #endif // BX_PLATFORM_WINDOWS
 #if BX_PLATFORM_OSX
@@ -45,6 +53,7 @@
 #include <metal/fs_light.sc.bin.h>
 #include <metal/vs_combine.sc.bin.h>
 #include <metal/fs_combine.sc.bin.h>
+#include <metal/fs_depth.sc.bin.h>
 #endif // BX_PLATFORM_OSX
 
 static const ScreenVertex screenVertices[] = {
@@ -61,7 +70,12 @@ Renderer::Renderer(std::string title, int width, int height)
 
 Renderer::~Renderer() {}
 
-bool Renderer::Init() {
+bool Renderer::Init(bool multithreaded) {
+#if BX_PLATFORM_OSX
+    // The render thread has to be the main thread here
+    multithreaded = false;
+#endif
+    this->multithreaded = multithreaded;
     window = SDL_CreateWindow(title.c_str(), width / 10, height / 10, width,
                               height, SDL_WINDOW_RESIZABLE);
     if (!window) {
@@ -72,7 +86,9 @@ bool Renderer::Init() {
 
     // Call bgfx::renderFrame before bgfx::init to signal to bgfx not to create
     // a render thread.
-    bgfx::renderFrame();
+    if (!multithreaded) {
+        bgfx::renderFrame();
+    }
 
     bgfx::Init init;
     SDL_SysWMinfo wmInfo;
@@ -131,6 +147,8 @@ bool Renderer::Init() {
     bgfx::setViewClear(lightingView, BGFX_CLEAR_COLOR, 0x443355FF, 1.0f, 0);
     bgfx::setViewRect(lightingView, 0, 0, bgfx::BackbufferRatio::Equal);
 
+    bgfx::setViewName(occlusionView, "Occlusion");
+
     bgfx::setViewName(combineView, "Combine");
     bgfx::setViewClear(combineView, BGFX_CLEAR_COLOR, 0x443355FF, 1.0f, 0);
     bgfx::setViewRect(combineView, 0, 0, bgfx::BackbufferRatio::Equal);
@@ -163,6 +181,30 @@ bool Renderer::Init() {
 
     lightingUniform =
         bgfx::createUniform("u_lighting", bgfx::UniformType::Sampler);
+    depthSizeUniform =
+        bgfx::createUniform("u_depthSize", bgfx::UniformType::Vec4);
+
+    lightsUniform = bgfx::createUniform("u_lights", bgfx::UniformType::Sampler);
+    clustersUniform =
+        bgfx::createUniform("u_clusters", bgfx::UniformType::Sampler);
+    lightIndicesUniform =
+        bgfx::createUniform("u_lightIndices", bgfx::UniformType::Sampler);
+    invViewProjUniform =
+        bgfx::createUniform("u_invViewProj", bgfx::UniformType::Mat4);
+    cameraViewUniform =
+        bgfx::createUniform("u_cameraView", bgfx::UniformType::Mat4);
+    clusterSizeUniform =
+        bgfx::createUniform("u_clusterSize", bgfx::UniformType::Vec4);
+    clusterParamsUniform =
+        bgfx::createUniform("u_clusterParams", bgfx::UniformType::Vec4);
+    sunDirectionUniform =
+        bgfx::createUniform("u_sunDirection", bgfx::UniformType::Vec4);
+    sunColorUniform =
+        bgfx::createUniform("u_sunColor", bgfx::UniformType::Vec4);
+    cameraPositionUniform =
+        bgfx::createUniform("u_cameraPosition", bgfx::UniformType::Vec4);
+    materialUniform =
+        bgfx::createUniform("u_material", bgfx::UniformType::Vec4);
 
 #if BX_PLATFORM_LINUX || BX_PLATFORM_BSD
     geometryProgram = bgfx::createProgram(
@@ -179,6 +221,10 @@ bool Renderer::Init() {
         bgfx::createShader(
             bgfx::makeRef(fs_combine_spv, sizeof(fs_combine_spv))),
         true);
+    depthProgram = bgfx::createProgram(
+        bgfx::createShader(bgfx::makeRef(vs_light_spv, sizeof(vs_light_spv))),
+        bgfx::createShader(bgfx::makeRef(fs_depth_spv, sizeof(fs_depth_spv))),
+        true);
 #elif BX_PLATFORM_WINDOWS
     if (bgfx::getRendererType() == bgfx::RendererType::Direct3D11) {
         geometryProgram = bgfx::createProgram(
@@ -199,6 +245,12 @@ bool Renderer::Init() {
             bgfx::createShader(
                 bgfx::makeRef(fs_combine_dx11, sizeof(fs_combine_dx11))),
             true);
+        depthProgram = bgfx::createProgram(
+            bgfx::createShader(
+                bgfx::makeRef(vs_light_dx11, sizeof(vs_light_dx11))),
+            bgfx::createShader(
+                bgfx::makeRef(fs_depth_dx11, sizeof(fs_depth_dx11))),
+            true);
     } else if (bgfx::getRendererType() == bgfx::RendererType::Vulkan) {
         geometryProgram = bgfx::createProgram(
             bgfx::createShader(bgfx::makeRef(vs_geom_spv, sizeof(vs_geom_spv))),
@@ -216,6 +268,12 @@ bool Renderer::Init() {
             bgfx::createShader(
                 bgfx::makeRef(fs_combine_spv, sizeof(fs_combine_spv))),
             true);
+        depthProgram = bgfx::createProgram(
+            bgfx::createShader(
+                bgfx::makeRef(vs_light_spv, sizeof(vs_light_spv))),
+            bgfx::createShader(
+                bgfx::makeRef(fs_depth_spv, sizeof(fs_depth_spv))),
+            true);
     } else {
         geometryProgram = bgfx::createProgram(
             bgfx::createShader(
@@ -235,6 +293,12 @@ bool Renderer::Init() {
             bgfx::createShader(
                 bgfx::makeRef(fs_combine_glsl, sizeof(fs_combine_glsl))),
             true);
+        depthProgram = bgfx::createProgram(
+            bgfx::createShader(
+                bgfx::makeRef(vs_light_glsl, sizeof(vs_light_glsl))),
+            bgfx::createShader(
+                bgfx::makeRef(fs_depth_glsl, sizeof(fs_depth_glsl))),
+            true);
     }
 #elif BX_PLATFORM_OSX
     geometryProgram = bgfx::createProgram(
@@ -251,26 +315,36 @@ bool Renderer::Init() {
         bgfx::createShader(
             bgfx::makeRef(fs_combine_mtl, sizeof(fs_combine_mtl))),
         true);
+    depthProgram = bgfx::createProgram(
+        bgfx::createShader(bgfx::makeRef(vs_light_mtl, sizeof(vs_light_mtl))),
+        bgfx::createShader(bgfx::makeRef(fs_depth_mtl, sizeof(fs_depth_mtl))),
+        true);
 #endif
 
     // Error-check program creation
     if (geometryProgram.idx == bgfx::kInvalidHandle ||
         lightingProgram.idx == bgfx::kInvalidHandle ||
-        combineProgram.idx == bgfx::kInvalidHandle) {
+        combineProgram.idx == bgfx::kInvalidHandle ||
+        depthProgram.idx == bgfx::kInvalidHandle) {
         std::cerr << "Failed to create program" << std::endl;
         bgfx::shutdown();
         SDL_DestroyWindow(window);
         return false;
     }
 
+    // Octahedral normals need only two channels, 10 bits each is plenty
+    if (!(bgfx::getCaps()->formats[normalFormat] &
+          BGFX_CAPS_FORMAT_TEXTURE_FRAMEBUFFER)) {
+        normalFormat = bgfx::TextureFormat::RGBA16F;
+    }
+
     // Create frame buffer for G-buffers
     texGbuffers[0] = bgfx::createTexture2D(
         (uint32_t)width, (uint32_t)height, false, 1, bgfx::TextureFormat::RGBA8,
         BGFX_TEXTURE_RT | BGFX_SAMPLER_U_CLAMP | BGFX_SAMPLER_V_CLAMP |
             BGFX_SAMPLER_MIN_POINT | BGFX_SAMPLER_MAG_POINT);
     texGbuffers[1] = bgfx::createTexture2D(
-        (uint32_t)width, (uint32_t)height, false, 1,
-        bgfx::TextureFormat::RGBA16F,
+        (uint32_t)width, (uint32_t)height, false, 1, normalFormat,
         BGFX_TEXTURE_RT | BGFX_SAMPLER_U_CLAMP | BGFX_SAMPLER_V_CLAMP |
             BGFX_SAMPLER_MIN_POINT | BGFX_SAMPLER_MAG_POINT);
     texGbuffers[2] = bgfx::createTexture2D(
@@ -287,25 +361,69 @@ bool Renderer::Init() {
         BGFX_TEXTURE_RT | BGFX_SAMPLER_U_CLAMP | BGFX_SAMPLER_V_CLAMP |
             BGFX_SAMPLER_MIN_POINT | BGFX_SAMPLER_MAG_POINT);
 
+    // Light data textures, filled every frame by uploadLights
+    lightTexture = bgfx::createTexture2D(
+        LightClusters::MAX_LIGHTS, 3, false, 1, bgfx::TextureFormat::RGBA32F,
+        BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
+    clusterTexture = bgfx::createTexture2D(
+        LightClusters::CLUSTER_X * LightClusters::CLUSTER_Y,
+        LightClusters::CLUSTER_Z, false, 1, bgfx::TextureFormat::RG32F,
+        BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
+    lightIndexTexture = bgfx::createTexture2D(
+        LightClusters::INDEX_WIDTH, LightClusters::INDEX_HEIGHT, false, 1,
+        bgfx::TextureFormat::R32F, BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
+
+    // The reduced depth is rendered to R32F, blitted to a CPU readable
+    // texture and read back
+    const bgfx::Caps* caps = bgfx::getCaps();
+    occlusionSupported =
+        (caps->supported & BGFX_CAPS_TEXTURE_BLIT) &&
+        (caps->supported & BGFX_CAPS_TEXTURE_READ_BACK) &&
+        (caps->formats[bgfx::TextureFormat::R32F] &
+         BGFX_CAPS_FORMAT_TEXTURE_FRAMEBUFFER);
+    if (!occlusionSupported) {
+        bx::debugPrintf("Occlusion culling not supported, only frustum "
+                        "culling is used\n");
+    }
+    createOcclusionBuffers();
+
     // Set the view transform for the lighting/combine pass
     bx::mtxIdentity(identity);
 
     return true;
 }
 bool Renderer::Shutdown() {
+    WaitForEncoding();
     bgfx::destroy(screenVbh);
     bgfx::destroy(screenIbh);
     bgfx::destroy(geometryProgram);
     bgfx::destroy(lightingProgram);
     bgfx::destroy(combineProgram);
+    bgfx::destroy(depthProgram);
     bgfx::destroy(texColorUniform);
     bgfx::destroy(texNormalUniform);
     bgfx::destroy(albedoUniform);
     bgfx::destroy(normalUniform);
     bgfx::destroy(depthUniform);
     bgfx::destroy(lightingUniform);
+    bgfx::destroy(depthSizeUniform);
+    bgfx::destroy(lightsUniform);
+    bgfx::destroy(clustersUniform);
+    bgfx::destroy(lightIndicesUniform);
+    bgfx::destroy(invViewProjUniform);
+    bgfx::destroy(cameraViewUniform);
+    bgfx::destroy(clusterSizeUniform);
+    bgfx::destroy(clusterParamsUniform);
+    bgfx::destroy(sunDirectionUniform);
+    bgfx::destroy(sunColorUniform);
+    bgfx::destroy(cameraPositionUniform);
+    bgfx::destroy(materialUniform);
+    bgfx::destroy(lightTexture);
+    bgfx::destroy(clusterTexture);
+    bgfx::destroy(lightIndexTexture);
     bgfx::destroy(GBuffersFrameBuffer);
     bgfx::destroy(lightingFrameBuffer);
+    destroyOcclusionBuffers();
 
     bgfx::shutdown();
     SDL_DestroyWindow(window);
@@ -313,6 +431,7 @@ bool Renderer::Shutdown() {
 }
 
 void Renderer::RecreateFrameBuffers(int width, int height) {
+    WaitForEncoding();
     this->width = width;
     this->height = height;
     bgfx::reset(width, height, BGFX_RESET_VSYNC);
@@ -327,8 +446,7 @@ void Renderer::RecreateFrameBuffers(int width, int height) {
         (uint32_t)width, (uint32_t)height, false, 1, bgfx::TextureFormat::RGBA8,
         BGFX_TEXTURE_RT | BGFX_SAMPLER_U_CLAMP | BGFX_SAMPLER_V_CLAMP);
     texGbuffers[1] = bgfx::createTexture2D(
-        (uint32_t)width, (uint32_t)height, false, 1,
-        bgfx::TextureFormat::RGBA16F,
+        (uint32_t)width, (uint32_t)height, false, 1, normalFormat,
         BGFX_TEXTURE_RT | BGFX_SAMPLER_U_CLAMP | BGFX_SAMPLER_V_CLAMP);
     texGbuffers[2] = bgfx::createTexture2D(
         (uint32_t)width, (uint32_t)height, false, 1, bgfx::TextureFormat::D24F,
@@ -341,88 +459,292 @@ void Renderer::RecreateFrameBuffers(int width, int height) {
     lightingFrameBuffer = bgfx::createFrameBuffer(
         (uint32_t)width, (uint32_t)height, bgfx::TextureFormat::RGBA8,
         BGFX_TEXTURE_RT | BGFX_SAMPLER_U_CLAMP | BGFX_SAMPLER_V_CLAMP);
+
+    destroyOcclusionBuffers();
+    createOcclusionBuffers();
+}
+
+void Renderer::createOcclusionBuffers() {
+    if (!occlusionSupported) {
+        return;
+    }
+    occlusionWidth = (width + DepthPyramid::BLOCK_SIZE - 1) /
+                     DepthPyramid::BLOCK_SIZE;
+    occlusionHeight = (height + DepthPyramid::BLOCK_SIZE - 1) /
+                      DepthPyramid::BLOCK_SIZE;
+    occlusionFrameBuffer = bgfx::createFrameBuffer(
+        occlusionWidth, occlusionHeight, bgfx::TextureFormat::R32F,
+        BGFX_TEXTURE_RT | BGFX_SAMPLER_U_CLAMP | BGFX_SAMPLER_V_CLAMP |
+            BGFX_SAMPLER_MIN_POINT | BGFX_SAMPLER_MAG_POINT);
+    occlusionReadback = bgfx::createTexture2D(
+        occlusionWidth, occlusionHeight, false, 1, bgfx::TextureFormat::R32F,
+        BGFX_TEXTURE_BLIT_DST | BGFX_TEXTURE_READ_BACK);
+}
+
+void Renderer::destroyOcclusionBuffers() {
+    // A read in flight keeps writing to occlusionDepth, which stays as is
+    if (bgfx::isValid(occlusionFrameBuffer)) {
+        bgfx::destroy(occlusionFrameBuffer);
+        occlusionFrameBuffer = BGFX_INVALID_HANDLE;
+    }
+    if (bgfx::isValid(occlusionReadback)) {
+        bgfx::destroy(occlusionReadback);
+        occlusionReadback = BGFX_INVALID_HANDLE;
+    }
 }
 
-void Renderer::BeginPass(bgfx::ViewId view) {
-    currentView = view;
-    switch (view) {
-    case 0:
-        BeginGeometry();
-        break;
-    case 1:
-        BeginLighting();
-        break;
-    case 2:
-        BeginCombine();
-        break;
-    default:
-        break;
+void Renderer::SetOcclusionCulling(bool enabled) {
+    occlusionCulling = enabled;
+    if (!enabled) {
+        depthPyramid.Clear();
     }
 }
 
-void Renderer::EndPass() {
-    switch (currentView) {
-    case 0:
-        bgfx::submit(geometryView, geometryProgram);
-        break;
-    case 1:
-        bgfx::submit(lightingView, lightingProgram);
-        break;
-    case 2:
-        bgfx::submit(combineView, combineProgram);
-        break;
-    default:
-        break;
+void Renderer::requestOcclusionDepth(const FrameSnapshot& snapshot) {
+    if (!occlusionSupported || !occlusionCulling || occlusionPending) {
+        return;
     }
+    occlusionDepth.resize((size_t)occlusionWidth * occlusionHeight);
+    occlusionReadWidth = occlusionWidth;
+    occlusionReadHeight = occlusionHeight;
+    occlusionScreenWidth = width;
+    occlusionScreenHeight = height;
+    occlusionViewProjection = glm::make_mat4(snapshot.projection) *
+                              glm::make_mat4(snapshot.view);
+
+    // Views run in id order, so this sees the depth of the geometry view
+    float depthSize[4] = {(float)width, (float)height, 1.0f / width,
+                          1.0f / height};
+    bgfx::setVertexBuffer(0, screenVbh);
+    bgfx::setIndexBuffer(screenIbh);
+    bgfx::setTexture(0, depthUniform, gbufferTextures[2]);
+    bgfx::setUniform(depthSizeUniform, depthSize);
+    bgfx::setState(BGFX_STATE_WRITE_R);
+    bgfx::submit(occlusionView, depthProgram);
+    bgfx::blit(occlusionView, occlusionReadback, 0, 0,
+               bgfx::getTexture(occlusionFrameBuffer));
+    occlusionReadyFrame =
+        bgfx::readTexture(occlusionReadback, occlusionDepth.data());
+    occlusionPending = true;
+}
+
+void Renderer::collectOcclusionDepth(uint32_t frame) {
+    if (!occlusionPending || frame < occlusionReadyFrame) {
+        return;
+    }
+    occlusionPending = false;
+    if (!occlusionCulling) {
+        return;
+    }
+    depthPyramid.Build(occlusionDepth.data(), occlusionReadWidth,
+                       occlusionReadHeight, occlusionScreenWidth,
+                       occlusionScreenHeight, occlusionViewProjection);
+}
+
+uint32_t Renderer::Present() {
+    FrameSnapshot& snapshot = snapshots[captureIndex];
+    if (!multithreaded) {
+        setupViews(snapshot);
+        allocateTransient(snapshot);
+        uploadLights(snapshot);
+        requestOcclusionDepth(snapshot);
+        encode(snapshot);
+        snapshot.procedural.clear();
+        uint32_t frame = bgfx::frame();
+        collectOcclusionDepth(frame);
+        return frame;
+    }
+
+    // The snapshot from the last Present goes into this frame
+    WaitForEncoding();
+    uint32_t frame = bgfx::frame();
+    collectOcclusionDepth(frame);
+    setupViews(snapshot);
+    allocateTransient(snapshot);
+    uploadLights(snapshot);
+    requestOcclusionDepth(snapshot);
+    encoding = TaskSystem::Get().Submit([this, &snapshot] { encode(snapshot); },
+                                        TaskPriority::High);
+    captureIndex = 1 - captureIndex;
+    // Its encoding finished in WaitForEncoding
+    snapshots[captureIndex].procedural.clear();
+    return frame;
+}
+
+void Renderer::allocateTransient(const FrameSnapshot& snapshot) {
+    transientDraws.clear();
+    for (const ProceduralDraw& draw : snapshot.procedural) {
+        TransientDraw buffers;
+        uint32_t vertexCount = (uint32_t)draw.vertices.size();
+        uint32_t indexCount = (uint32_t)draw.indices.size();
+        // Out of transient space for this frame, the rest is skipped
+        if (!bgfx::allocTransientBuffers(&buffers.vertices, layout,
+                                         vertexCount, &buffers.indices,
+                                         indexCount)) {
+            bx::debugPrintf("Skipped %zu procedural draws, no transient "
+                            "buffer space left\n",
+                            snapshot.procedural.size() -
+                                transientDraws.size());
+            break;
+        }
+        std::memcpy(buffers.vertices.data, draw.vertices.data(),
+                    vertexCount * sizeof(Vertex));
+        std::memcpy(buffers.indices.data, draw.indices.data(),
+                    indexCount * sizeof(uint16_t));
+        transientDraws.push_back(buffers);
+    }
+}
+
+void Renderer::uploadLights(const FrameSnapshot& snapshot) {
+    lightClusters.Build(snapshot.lights, snapshot.view, snapshot.projection,
+                        snapshot.nearPlane, snapshot.farPlane);
+    const std::vector<float>& lights = lightClusters.GetLights();
+    const std::vector<float>& clusters = lightClusters.GetClusters();
+    const std::vector<float>& indices = lightClusters.GetIndices();
+    // Only the rows in use, the shader never reads past them
+    uint16_t lightRows = lightClusters.GetLightCount() > 0 ? 3 : 0;
+    if (lightRows > 0) {
+        bgfx::updateTexture2D(
+            lightTexture, 0, 0, 0, 0, LightClusters::MAX_LIGHTS, lightRows,
+            bgfx::copy(lights.data(), lights.size() * sizeof(float)));
+    }
+    bgfx::updateTexture2D(
+        clusterTexture, 0, 0, 0, 0,
+        LightClusters::CLUSTER_X * LightClusters::CLUSTER_Y,
+        LightClusters::CLUSTER_Z,
+        bgfx::copy(clusters.data(), clusters.size() * sizeof(float)));
+    uint16_t indexRows = (uint16_t)lightClusters.GetIndexRows();
+    if (indexRows > 0) {
+        bgfx::updateTexture2D(
+            lightIndexTexture, 0, 0, 0, 0, LightClusters::INDEX_WIDTH,
+            indexRows,
+            bgfx::copy(indices.data(), indices.size() * sizeof(float)));
+    }
+
+    glm::mat4 view = glm::make_mat4(snapshot.view);
+    invViewProj = glm::inverse(glm::make_mat4(snapshot.projection) * view);
+    cameraPosition = glm::inverse(view)[3];
+    const bgfx::Caps* caps = bgfx::getCaps();
+    clusterParams[0] = snapshot.nearPlane;
+    clusterParams[1] = snapshot.farPlane;
+    clusterParams[2] = caps->homogeneousDepth ? 1.0f : 0.0f;
+    clusterParams[3] = caps->originBottomLeft ? 1.0f : 0.0f;
 }
 
-void Renderer::BeginGeometry() {
+void Renderer::WaitForEncoding() {
+    if (encoding) {
+        TaskSystem::Get().Wait(encoding);
+        encoding = nullptr;
+    }
+}
+
+void Renderer::setupViews(const FrameSnapshot& snapshot) {
     bgfx::setViewFrameBuffer(geometryView, GBuffersFrameBuffer);
     bgfx::setViewClear(geometryView, BGFX_CLEAR_COLOR | BGFX_CLEAR_DEPTH,
                        0x000000ff, 1.0f, 0);
     bgfx::setViewRect(geometryView, 0, 0, width, height);
+    bgfx::setViewTransform(geometryView, snapshot.view, snapshot.projection);
 
-    bgfx::setState(BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A |
-                   BGFX_STATE_WRITE_Z | BGFX_STATE_DEPTH_TEST_LESS |
-                   BGFX_STATE_MSAA);
-}
-
-void Renderer::BeginLighting() {
     bgfx::setViewFrameBuffer(lightingView, lightingFrameBuffer);
     bgfx::setViewClear(lightingView, BGFX_CLEAR_COLOR | BGFX_CLEAR_DEPTH,
                        0x0000ffff, 1.0f, 0);
     bgfx::setViewRect(lightingView, 0, 0, bgfx::BackbufferRatio::Equal);
-    bgfx::setState(BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A | BGFX_STATE_MSAA);
-
     bgfx::setViewTransform(lightingView, identity, identity);
 
-    bgfx::setVertexBuffer(0, screenVbh);
-    bgfx::setIndexBuffer(screenIbh);
-    bgfx::setTexture(0, normalUniform,
-                     bgfx::getTexture(GBuffersFrameBuffer, 1));
-    bgfx::setTexture(1, depthUniform, bgfx::getTexture(GBuffersFrameBuffer, 2));
-}
+    if (bgfx::isValid(occlusionFrameBuffer)) {
+        bgfx::setViewFrameBuffer(occlusionView, occlusionFrameBuffer);
+        bgfx::setViewRect(occlusionView, 0, 0, occlusionWidth,
+                          occlusionHeight);
+        bgfx::setViewTransform(occlusionView, identity, identity);
+    }
 
-void Renderer::BeginCombine() {
     bgfx::setViewFrameBuffer(combineView, BGFX_INVALID_HANDLE);
     bgfx::setViewClear(combineView, BGFX_CLEAR_COLOR | BGFX_CLEAR_DEPTH,
                        0x303030ff, 1.0f, 0);
     bgfx::setViewRect(combineView, 0, 0, width, height);
     bgfx::setViewTransform(combineView, identity, identity);
-    bgfx::setTexture(0, albedoUniform,
-                     bgfx::getTexture(GBuffersFrameBuffer, 0));
-    bgfx::setTexture(1, lightingUniform,
-                     bgfx::getTexture(lightingFrameBuffer, 0));
 
-    bgfx::setVertexBuffer(0, screenVbh);
-    bgfx::setIndexBuffer(screenIbh);
-    bgfx::setState(BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A | BGFX_STATE_MSAA);
+    gbufferTextures[0] = bgfx::getTexture(GBuffersFrameBuffer, 0);
+    gbufferTextures[1] = bgfx::getTexture(GBuffersFrameBuffer, 1);
+    gbufferTextures[2] = bgfx::getTexture(GBuffersFrameBuffer, 2);
+    lightingTexture = bgfx::getTexture(lightingFrameBuffer, 0);
 }
 
-void Renderer::SetTextureUniforms(bgfx::TextureHandle albedo,
-                                  bgfx::TextureHandle normal) {
-    bgfx::setTexture(0, texColorUniform, albedo);
-    bgfx::setTexture(1, texNormalUniform, normal);
+void Renderer::encode(const FrameSnapshot& snapshot) {
+    // From a task the encoder is made for the worker thread
+    bgfx::Encoder* encoder = bgfx::begin(multithreaded);
+    if (encoder == nullptr) {
+        return;
+    }
+
+    // Makes sure the geometry view is cleared even with nothing to draw
+    encoder->touch(geometryView);
+    for (uint32_t index : snapshot.visible) {
+        const DrawItem& draw = snapshot.draws[index];
+        encoder->setState(BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A |
+                          BGFX_STATE_WRITE_Z | BGFX_STATE_DEPTH_TEST_LESS |
+                          BGFX_STATE_MSAA);
+        if (bgfx::isValid(draw.staticVbh)) {
+            encoder->setVertexBuffer(0, draw.staticVbh);
+        } else {
+            encoder->setVertexBuffer(0, draw.vbh);
+        }
+        encoder->setIndexBuffer(draw.ibh);
+        encoder->setTransform(&draw.transform[0][0]);
+        encoder->setTexture(0, texColorUniform, draw.albedo);
+        encoder->setTexture(1, texNormalUniform, draw.normal);
+        encoder->setUniform(materialUniform, &draw.material);
+        encoder->submit(geometryView, geometryProgram);
+    }
+    for (size_t i = 0; i < transientDraws.size(); i++) {
+        const ProceduralDraw& draw = snapshot.procedural[i];
+        encoder->setState(BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A |
+                          BGFX_STATE_WRITE_Z | BGFX_STATE_DEPTH_TEST_LESS |
+                          BGFX_STATE_MSAA);
+        encoder->setVertexBuffer(0, &transientDraws[i].vertices);
+        encoder->setIndexBuffer(&transientDraws[i].indices);
+        encoder->setTransform(&draw.transform[0][0]);
+        encoder->setTexture(0, texColorUniform, draw.albedo);
+        encoder->setTexture(1, texNormalUniform, draw.normal);
+        encoder->setUniform(materialUniform, &draw.material);
+        encoder->submit(geometryView, geometryProgram);
+    }
+
+    const float clusterSize[4] = {
+        (float)LightClusters::CLUSTER_X, (float)LightClusters::CLUSTER_Y,
+        (float)LightClusters::CLUSTER_Z, (float)LightClusters::INDEX_WIDTH};
+    const float sunDirection[4] = {snapshot.sunDirection.x,
+                                   snapshot.sunDirection.y,
+                                   snapshot.sunDirection.z, 0.0f};
+    const float sunColor[4] = {snapshot.sunColor.r, snapshot.sunColor.g,
+                               snapshot.sunColor.b, 0.0f};
+    encoder->setVertexBuffer(0, screenVbh);
+    encoder->setIndexBuffer(screenIbh);
+    encoder->setTexture(0, normalUniform, gbufferTextures[1]);
+    encoder->setTexture(1, depthUniform, gbufferTextures[2]);
+    encoder->setTexture(2, lightsUniform, lightTexture);
+    encoder->setTexture(3, clustersUniform, clusterTexture);
+    encoder->setTexture(4, lightIndicesUniform, lightIndexTexture);
+    encoder->setTexture(5, albedoUniform, gbufferTextures[0]);
+    encoder->setUniform(invViewProjUniform, &invViewProj[0][0]);
+    encoder->setUniform(cameraViewUniform, snapshot.view);
+    encoder->setUniform(clusterSizeUniform, clusterSize);
+    encoder->setUniform(clusterParamsUniform, clusterParams);
+    encoder->setUniform(sunDirectionUniform, sunDirection);
+    encoder->setUniform(sunColorUniform, sunColor);
+    encoder->setUniform(cameraPositionUniform, &cameraPosition);
+    encoder->setState(BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A |
+                      BGFX_STATE_MSAA);
+    encoder->submit(lightingView, lightingProgram);
+
+    encoder->setVertexBuffer(0, screenVbh);
+    encoder->setIndexBuffer(screenIbh);
+    encoder->setTexture(0, lightingUniform, lightingTexture);
+    encoder->setState(BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A |
+                      BGFX_STATE_MSAA);
+    encoder->submit(combineView, combineProgram);
+
+    bgfx::end(encoder);
 }
 
 void Renderer::SetTitle(std::string title) {
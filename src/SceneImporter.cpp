@@ -3,25 +3,40 @@
 #include "SceneManager.hpp"
 #include "assimp/material.h"
 #include "assimp/postprocess.h"
+#include "TaskSystem.hpp"
 #include "utils.hpp"
+#include "bx/debug.h"
+#include <cfloat>
 #include <cstdint>
 #include <iostream>
 #include <vector>
 
-void SceneImporter::processNode(aiNode* node, const aiScene* scene) {
+void SceneImporter::processNode(aiNode* node, const aiScene* scene,
+                                const glm::mat4& parentTransform,
+                                bool batchStatic) {
+    // Node transforms are relative to the parent node
+    glm::mat4 transform = parentTransform * ToGLM(node->mTransformation);
     for (uint32_t i = 0; i < node->mNumMeshes; i++) {
+        if (batchStatic) {
+            addToBatch(node->mMeshes[i], transform, scene);
+            continue;
+        }
         uint64_t matId = 0;
-        auto meshRef =
-            processMesh(scene->mMeshes[node->mMeshes[i]], scene, matId);
+        auto meshRef = processMesh(node->mMeshes[i], scene, matId);
         if (meshRef.data) {
+            // The mesh is shared by the nodes that use it, the static body
+            // has no rotation or scale, so the collider is built in world
+            // space and the entity is drawn with the node transform
+            std::vector<Vertex> vertices =
+                toWorld(meshRef.data->GetVertices(), transform);
             auto colliderRef = sceneManager->AddCollider(
                 Collider(ColliderType::Mesh, glm::vec3(0.0f), glm::vec3(0.0f),
-                         glm::vec3(1.0f), meshRef.data->GetVertices(),
+                         glm::vec3(1.0f), vertices,
                          meshRef.data->GetIndices()));
             auto ref = sceneManager->AddEntity(meshRef.id, colliderRef.id,
                                               RigidBodyType::Static, matId);
-            ref.data->SetTransform(ToGLM(node->mTransformation));
             if (ref.data) {
+                ref.data->SetTransform(transform);
                 sceneRefs.push_back(std::move(ref));
             } else {
                 std::cerr << "ERROR: Failed to add entity" << std::endl;
@@ -29,15 +44,27 @@ void SceneImporter::processNode(aiNode* node, const aiScene* scene) {
         }
     }
     for (uint32_t i = 0; i < node->mNumChildren; i++) {
-        processNode(node->mChildren[i], scene);
+        processNode(node->mChildren[i], scene, transform, batchStatic);
     }
 }
 
-SceneRef<MeshContainer> SceneImporter::processMesh(aiMesh* mesh,
-                                                   const aiScene* scene,
-                                                   uint64_t& matId) {
-    std::vector<Vertex> vertices;
-    std::vector<uint32_t> indices;
+std::vector<Vertex> SceneImporter::toWorld(const std::vector<Vertex>& vertices,
+                                           const glm::mat4& transform) {
+    glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+    std::vector<Vertex> result = vertices;
+    for (Vertex& vertex : result) {
+        vertex.pos = glm::vec3(transform * glm::vec4(vertex.pos, 1.0f));
+        vertex.normal = glm::normalize(normalMatrix * vertex.normal);
+        vertex.tangent = glm::normalize(normalMatrix * vertex.tangent);
+    }
+    return result;
+}
+
+// Only reads the mesh, so several can be converted at the same time
+void SceneImporter::readMesh(const aiMesh* mesh, MeshData& data) {
+    std::vector<Vertex>& vertices = data.vertices;
+    std::vector<uint32_t>& indices = data.indices;
+    vertices.reserve(mesh->mNumVertices);
     for (uint32_t i = 0; i < mesh->mNumVertices; i++) {
         Vertex vertex;
         glm::vec3 vector;
@@ -78,27 +105,106 @@ SceneRef<MeshContainer> SceneImporter::processMesh(aiMesh* mesh,
             indices.push_back(face.mIndices[j]);
         }
     }
+}
 
-    if (mesh->mMaterialIndex >= 0) {
-        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-        uint64_t diffuse =
-            loadMaterialTextures(material, aiTextureType_DIFFUSE);
-        uint64_t normal = loadMaterialTextures(material, aiTextureType_NORMALS);
-
-        auto mat = sceneManager->AddMaterial(diffuse, normal);
-        matId = mat.id;
-    }
+SceneRef<MeshContainer> SceneImporter::processMesh(uint32_t meshIndex,
+                                                   const aiScene* scene,
+                                                   uint64_t& matId) {
+    const aiMesh* mesh = scene->mMeshes[meshIndex];
+    const MeshData& data = meshData[meshIndex];
+    matId = processMaterial(mesh->mMaterialIndex, scene);
 
-    if (vertices.size() > 0 && indices.size() > 0) {
+    if (data.vertices.size() > 0 && data.indices.size() > 0) {
+        // Copied, several nodes can use the same mesh
         auto meshRef = sceneManager->AddMeshContainer(
             MeshContainer(workingDirectory + "/" + mesh->mName.C_Str(),
-                          std::move(vertices), std::move(indices)));
+                          data.vertices, data.indices));
         return meshRef;
     }
     std::cerr << "ERROR: Mesh has no vertices or indices" << std::endl;
     return SceneRef<MeshContainer>();
 }
 
+// Every aiMaterial becomes one material, shared by the meshes that use it
+uint64_t SceneImporter::processMaterial(uint32_t materialIndex,
+                                        const aiScene* scene) {
+    if (materialIndex >= scene->mNumMaterials) {
+        return 0;
+    }
+    if (materialIds[materialIndex] != UINT64_MAX) {
+        return materialIds[materialIndex];
+    }
+    aiMaterial* material = scene->mMaterials[materialIndex];
+    uint64_t diffuse = loadMaterialTextures(material, aiTextureType_DIFFUSE);
+    uint64_t normal = loadMaterialTextures(material, aiTextureType_NORMALS);
+    auto mat = sceneManager->AddMaterial(diffuse, normal);
+    materialIds[materialIndex] = mat.id;
+    return mat.id;
+}
+
+void SceneImporter::addToBatch(uint32_t meshIndex, const glm::mat4& transform,
+                               const aiScene* scene) {
+    const MeshData& data = meshData[meshIndex];
+    if (data.vertices.empty() || data.indices.empty()) {
+        std::cerr << "ERROR: Mesh has no vertices or indices" << std::endl;
+        return;
+    }
+    uint64_t matId = processMaterial(scene->mMeshes[meshIndex]->mMaterialIndex,
+                                     scene);
+
+    // The batch has no transform of its own, so the vertices are moved into
+    // world space here
+    std::vector<Vertex> vertices = toWorld(data.vertices, transform);
+    glm::vec3 min(FLT_MAX);
+    glm::vec3 max(-FLT_MAX);
+    for (const Vertex& vertex : vertices) {
+        min = glm::min(min, vertex.pos);
+        max = glm::max(max, vertex.pos);
+    }
+
+    // The cell is picked by the center of the mesh, so a mesh is never split
+    glm::ivec3 cell = glm::ivec3(glm::floor((min + max) * 0.5f /
+                                            BATCH_CHUNK_SIZE));
+    MeshData& batch = batches[{matId, cell.x, cell.y, cell.z}];
+    uint32_t base = (uint32_t)batch.vertices.size();
+    batch.vertices.insert(batch.vertices.end(), vertices.begin(),
+                          vertices.end());
+    batch.indices.reserve(batch.indices.size() + data.indices.size());
+    for (uint32_t index : data.indices) {
+        batch.indices.push_back(base + index);
+    }
+    batchedMeshes++;
+}
+
+void SceneImporter::flushBatches() {
+    size_t count = 0;
+    for (auto& [key, batch] : batches) {
+        // The batches of a scene are only ever loaded with it
+        std::string path = scenePath + "#batch" + std::to_string(count++);
+        auto meshRef = sceneManager->AddMeshContainer(MeshContainer(
+            path, std::move(batch.vertices), std::move(batch.indices)));
+        if (!meshRef.data) {
+            continue;
+        }
+        auto colliderRef = sceneManager->AddCollider(
+            Collider(ColliderType::Mesh, glm::vec3(0.0f), glm::vec3(0.0f),
+                     glm::vec3(1.0f), meshRef.data->GetVertices(),
+                     meshRef.data->GetIndices()));
+        auto ref = sceneManager->AddEntity(meshRef.id, colliderRef.id,
+                                          RigidBodyType::Static,
+                                          std::get<0>(key));
+        if (ref.data) {
+            sceneRefs.push_back(std::move(ref));
+        } else {
+            std::cerr << "ERROR: Failed to add entity" << std::endl;
+        }
+    }
+    bx::debugPrintf("Merged %u static meshes into %zu batches\n",
+                    batchedMeshes, batches.size());
+    batches.clear();
+    batchedMeshes = 0;
+}
+
 uint64_t SceneImporter::loadMaterialTextures(aiMaterial* mat,
                                              aiTextureType type) {
     aiString str;
@@ -116,7 +222,8 @@ uint64_t SceneImporter::loadMaterialTextures(aiMaterial* mat,
     }
 }
 
-std::vector<SceneRef<Entity>> SceneImporter::ImportScene(const std::string& path) {
+std::vector<SceneRef<Entity>>
+SceneImporter::ImportScene(const std::string& path, bool batchStatic) {
     sceneRefs.clear();
     Assimp::Importer importer;
     const aiScene* scene =
@@ -128,8 +235,26 @@ std::vector<SceneRef<Entity>> SceneImporter::ImportScene(const std::string& path
                   << std::endl;
         return {};
     }
+    scenePath = path;
     workingDirectory = path.substr(0, path.find_last_of('/'));
+    materialIds.assign(scene->mNumMaterials, UINT64_MAX);
+
+    // Converting the meshes does not touch the scene manager, so it is spread
+    // over the task system before the nodes are walked
+    meshData.assign(scene->mNumMeshes, MeshData());
+    TaskSystem::Get().ParallelFor(scene->mNumMeshes, 1,
+                                  [&](size_t begin, size_t end) {
+                                      for (size_t i = begin; i < end; i++) {
+                                          readMesh(scene->mMeshes[i],
+                                                   meshData[i]);
+                                      }
+                                  });
 
-    processNode(scene->mRootNode, scene);
+    processNode(scene->mRootNode, scene, glm::mat4(1.0f), batchStatic);
+    if (batchStatic) {
+        flushBatches();
+    }
+    meshData.clear();
+    materialIds.clear();
     return sceneRefs;
 }
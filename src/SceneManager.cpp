@@ -1,6 +1,7 @@
 #include "SceneManager.hpp"
 #include "SceneImporter.hpp"
 #include <bgfx/bgfx.h>
+#include <memory>
 #include <utility>
 #include <vector>
 #include "Entity.hpp"
@@ -10,6 +11,8 @@
 #include "Texture.hpp"
 #include "bx/bx.h"
 #include "bx/debug.h"
+#include "utils.hpp"
+#include <glm/gtc/type_ptr.hpp>
 
 static SceneManager* instance = nullptr;
 
@@ -20,8 +23,11 @@ SceneManager::~SceneManager() {}
 void SceneManager::Initialize(PhysicsCore& physicsCore,
                               bgfx::VertexLayout& layout, Renderer& renderer,
                               SceneImporter& sceneImporter) {
-    if (instance == nullptr)
+    if (instance == nullptr) {
         instance = new SceneManager();
+        instance->arenas.push_back(std::make_unique<SceneArena>());
+        instance->currentArena = instance->arenas.front().get();
+    }
 
     instance->physicsCore = &physicsCore;
     instance->layout = &layout;
@@ -44,32 +50,18 @@ void SceneManager::Shutdown() {
     if (instance == nullptr)
         return;
 
-    // Clean up all entities, textures, and mesh containers
-    for (auto& entity : instance->entities) {
-        delete entity.second;
-        bx::debugPrintf("Entity removed with ID: %llu\n", entity.first);
-    }
-    for (auto& texture : instance->textures) {
-        delete texture.second;
-        bx::debugPrintf("Texture removed with ID: %llu\n", texture.first);
-    }
-    for (auto& material : instance->materials) {
-        delete material.second;
-        bx::debugPrintf("Material removed with ID: %llu\n", material.first);
-    }
-    for (auto& mesh : instance->meshes) {
-        delete mesh.second;
-        bx::debugPrintf("MeshContainer removed with ID: %llu\n", mesh.first);
-    }
-    for (auto& collider : instance->colliders) {
-        delete collider.second;
-        bx::debugPrintf("Collider removed with ID: %llu\n", collider.first);
+    // Free the scenes before the objects they may share with arena 0
+    bx::debugPrintf("Removing %zu entities\n", instance->entities.size());
+    while (!instance->arenas.empty()) {
+        instance->arenas.pop_back();
     }
+    instance->currentArena = nullptr;
     instance->entities.clear();
     instance->textures.clear();
     instance->materials.clear();
     instance->meshes.clear();
     instance->colliders.clear();
+    instance->cameras.clear();
 
     delete instance;
     instance = nullptr;
@@ -77,9 +69,11 @@ void SceneManager::Shutdown() {
 }
 
 SceneRef<Entity> SceneManager::AddEntity(Primitive primitive) {
-    uint64_t id = entities.size();
-    auto entity = new Primitive(std::move(primitive));
+    uint64_t id = nextEntityId++;
+    auto entity = currentArena->primitives.Create(std::move(primitive));
     entities.emplace(id, entity);
+    currentArena->entityIds.push_back(id);
+    indexEntity(id, entity);
     SceneRef<Entity> ref;
     ref.id = id;
     ref.data = entities.at(id);
@@ -93,11 +87,14 @@ SceneRef<Entity> SceneManager::AddEntity(PrimitiveType type,
                                          glm::vec3 position, glm::vec3 rotation,
                                          glm::vec3 size) {
     // Create a new primitive and add it to the map
-    uint64_t id = entities.size();
+    uint64_t id = nextEntityId++;
     auto material = GetMaterial(materialId);
-    auto entity = new Primitive(type, bodyType, *physicsCore, *layout,
-                                material.id, position, rotation, size);
+    auto entity =
+        currentArena->primitives.Create(type, bodyType, *physicsCore, *layout,
+                                        material.id, position, rotation, size);
     entities.emplace(id, entity);
+    currentArena->entityIds.push_back(id);
+    indexEntity(id, entity);
     SceneRef<Entity> ref;
     ref.id = id;
     ref.data = entities.at(id);
@@ -105,15 +102,39 @@ SceneRef<Entity> SceneManager::AddEntity(PrimitiveType type,
     return ref;
 }
 
+std::vector<SceneRef<Entity>>
+SceneManager::AddEntities(PrimitiveType type, RigidBodyType bodyType,
+                          uint64_t materialId,
+                          const std::vector<glm::vec3>& positions) {
+    std::vector<SceneRef<Entity>> refs;
+    refs.reserve(positions.size());
+    entities.reserve(entities.size() + positions.size());
+
+    auto material = GetMaterial(materialId);
+    physicsCore->BeginBatch();
+    for (const glm::vec3& position : positions) {
+        uint64_t id = nextEntityId++;
+        auto entity = currentArena->primitives.Create(
+            type, bodyType, *physicsCore, *layout, material.id, position);
+        entities.emplace(id, entity);
+        currentArena->entityIds.push_back(id);
+        indexEntity(id, entity);
+        refs.push_back({id, entity});
+    }
+    physicsCore->EndBatch();
+    bx::debugPrintf("%zu primitives added\n", refs.size());
+    return refs;
+}
+
 SceneRef<Entity> SceneManager::UpdateEntity(uint64_t id, PrimitiveType type) {
     // Check if the entity exists in the map
     auto it = entities.find(id);
     if (it != entities.end()) {
-        auto entity = dynamic_cast<Primitive*>(it->second);
-        if (entity == nullptr) {
+        if (it->second->GetKind() != EntityKind::Primitive) {
             bx::debugPrintf("Entity with ID: %llu is not a Primitive", id);
             return {0, nullptr};
         }
+        auto entity = static_cast<Primitive*>(it->second);
         entity->SetType(type);
         entity->UpdateMesh(*physicsCore, *layout);
         bx::debugPrintf("Entity updated with ID: %llu\n", id);
@@ -125,9 +146,11 @@ SceneRef<Entity> SceneManager::UpdateEntity(uint64_t id, PrimitiveType type) {
 
 SceneRef<Entity> SceneManager::AddEntity(MeshEntity meshEntity) {
     // Create a new entity and add it to the map
-    uint64_t id = entities.size();
-    auto entity = new MeshEntity(std::move(meshEntity));
+    uint64_t id = nextEntityId++;
+    auto entity = currentArena->meshEntities.Create(std::move(meshEntity));
     entities.emplace(id, entity);
+    currentArena->entityIds.push_back(id);
+    indexEntity(id, entity);
     SceneRef<Entity> ref;
     ref.id = id;
     ref.data = entities.at(id);
@@ -141,7 +164,7 @@ SceneRef<Entity> SceneManager::AddEntity(uint64_t meshId, uint64_t colliderId,
                                          glm::vec3 position, glm::vec3 rotation,
                                          glm::vec3 size) {
     // Create a new entity and add it to the map
-    uint64_t id = entities.size();
+    uint64_t id = nextEntityId++;
     auto mesh = GetMeshContainer(meshId);
     auto collider = GetCollider(colliderId);
     auto material = GetMaterial(materialId);
@@ -153,10 +176,12 @@ SceneRef<Entity> SceneManager::AddEntity(uint64_t meshId, uint64_t colliderId,
         bx::debugPrintf("Collider not found with ID: %llu\n", colliderId);
         return {0, nullptr};
     }
-    auto entity =
-        new MeshEntity(*mesh.data, collider.data, bodyType, *physicsCore,
-                       *layout, material.id, position, rotation, size);
+    auto entity = currentArena->meshEntities.Create(
+        *mesh.data, collider.data, bodyType, *physicsCore, *layout, material.id,
+        position, rotation, size);
     entities.emplace(id, entity);
+    currentArena->entityIds.push_back(id);
+    indexEntity(id, entity);
     SceneRef<Entity> ref;
     ref.id = id;
     ref.data = entities.at(id);
@@ -179,11 +204,11 @@ SceneRef<Entity> SceneManager::UpdateEntity(uint64_t id, uint64_t meshId,
             bx::debugPrintf("Collider not found with ID: %llu\n", colliderId);
             return {0, nullptr};
         }
-        auto entity = dynamic_cast<MeshEntity*>(it->second);
-        if (entity == nullptr) {
+        if (it->second->GetKind() != EntityKind::Mesh) {
             bx::debugPrintf("Entity with ID: %llu is not a MeshEntity", id);
             return {0, nullptr};
         }
+        auto entity = static_cast<MeshEntity*>(it->second);
         entity->UpdateMetaData(mesh.data, collider.data);
         entity->UpdateMesh(*physicsCore, *layout);
         bx::debugPrintf("Entity updated with ID: %llu\n", id);
@@ -211,7 +236,7 @@ void SceneManager::RemoveEntity(const uint64_t id) {
     // Check if the entity exists in the map
     auto it = entities.find(id);
     if (it != entities.end()) {
-        delete it->second;
+        destroyEntity(it->second);
         entities.erase(it);
         bx::debugPrintf("Entity removed with ID: %llu\n", id);
     } else {
@@ -219,32 +244,313 @@ void SceneManager::RemoveEntity(const uint64_t id) {
     }
 }
 
-std::vector<SceneRef<Entity>> SceneManager::AddScene(const std::string& path) {
-    // Import the scene using the SceneImporter
-    std::vector<SceneRef<Entity>> sceneRefs = sceneImporter->ImportScene(path);
+std::vector<SceneRef<Entity>> SceneManager::AddScene(const std::string& path,
+                                                     bool batchStatic) {
+    if (sceneArenas.find(path) != sceneArenas.end()) {
+        bx::debugPrintf("Scene already loaded from path: %s\n", path.c_str());
+        return {};
+    }
+
+    // Import the scene using the SceneImporter, into a new arena
+    size_t arenaIndex = arenas.size();
+    arenas.push_back(std::make_unique<SceneArena>());
+    SceneArena* previousArena = currentArena;
+    currentArena = arenas.back().get();
+    std::vector<SceneRef<Entity>> sceneRefs =
+        sceneImporter->ImportScene(path, batchStatic);
+    currentArena = previousArena;
+
+    sceneArenas.emplace(path, arenaIndex);
     if (sceneRefs.empty()) {
         bx::debugPrintf("Failed to import scene from path: %s\n", path.c_str());
+        UnloadScene(path);
         return {};
     }
     return sceneRefs;
 }
 
+bool SceneManager::UnloadScene(const std::string& path) {
+    auto it = sceneArenas.find(path);
+    if (it == sceneArenas.end()) {
+        bx::debugPrintf("Scene not loaded from path: %s\n", path.c_str());
+        return false;
+    }
+    if (arenas[it->second]->users > 0) {
+        bx::debugPrintf("Scene %s still has resources used by %u others\n",
+                        path.c_str(), arenas[it->second]->users);
+        return false;
+    }
+    std::unique_ptr<SceneArena> arena = std::move(arenas[it->second]);
+    sceneArenas.erase(it);
+    for (SceneArena* owner : arena->borrowed) {
+        owner->users--;
+    }
+
+    // Ids are never reused, so every id of the arena still in a map refers
+    // to an object in it
+    for (uint64_t id : arena->textureIds) {
+        auto entry = textures.find(id);
+        if (entry != textures.end()) {
+            loadedURIs.erase(entry->second->GetPath());
+            textures.erase(entry);
+        }
+    }
+    for (uint64_t id : arena->meshIds) {
+        auto entry = meshes.find(id);
+        if (entry != meshes.end()) {
+            loadedURIs.erase(entry->second->GetPath());
+            meshes.erase(entry);
+        }
+    }
+    for (uint64_t id : arena->entityIds) {
+        auto entry = entities.find(id);
+        if (entry != entities.end()) {
+            sceneIds[entry->second->GetEntityId()] = UINT64_MAX;
+            entities.erase(entry);
+        }
+    }
+    for (uint64_t id : arena->materialIds) {
+        materials.erase(id);
+    }
+    for (uint64_t id : arena->colliderIds) {
+        colliders.erase(id);
+    }
+    for (uint64_t id : arena->cameraIds) {
+        cameras.erase(id);
+    }
+
+    size_t count =
+        arena->primitives.GetCount() + arena->meshEntities.GetCount();
+    arena->Clear();
+    bx::debugPrintf("Scene unloaded from path: %s, %zu entities removed\n",
+                    path.c_str(), count);
+    return true;
+}
+
+uint64_t SceneManager::shareURI(const LoadedURI& uri) {
+    if (uri.arena != currentArena) {
+        uri.arena->users++;
+        currentArena->borrowed.push_back(uri.arena);
+    }
+    return uri.id;
+}
+
+void SceneManager::indexEntity(uint64_t id, Entity* entity) {
+    EntityId entityId = entity->GetEntityId();
+    if (entityId >= sceneIds.size()) {
+        sceneIds.resize((size_t)entityId + 1, UINT64_MAX);
+    }
+    sceneIds[entityId] = id;
+}
+
+SceneRef<Entity> SceneManager::findEntity(EntityId entity) {
+    if (entity >= sceneIds.size() || sceneIds[entity] == UINT64_MAX) {
+        return {0, nullptr};
+    }
+    auto it = entities.find(sceneIds[entity]);
+    if (it == entities.end()) {
+        return {0, nullptr};
+    }
+    return {it->first, it->second};
+}
+
+void SceneManager::destroyEntity(Entity* entity) {
+    sceneIds[entity->GetEntityId()] = UINT64_MAX;
+    switch (entity->GetKind()) {
+    case EntityKind::Primitive:
+        destroyObject(&SceneArena::primitives, static_cast<Primitive*>(entity));
+        break;
+    case EntityKind::Mesh:
+        destroyObject(&SceneArena::meshEntities,
+                      static_cast<MeshEntity*>(entity));
+        break;
+    }
+}
+
+template <typename T>
+void SceneManager::destroyObject(ObjectPool<T> SceneArena::*pool, T* object) {
+    for (auto& arena : arenas) {
+        if (arena && ((*arena).*pool).Owns(object)) {
+            ((*arena).*pool).Destroy(object);
+            return;
+        }
+    }
+}
+
+void SceneManager::SyncTransformsFromPhysics(bool activeOnly) {
+    World& world = World::Get();
+    const JPH::BodyInterface& bodyInterface = physicsCore->GetBodyInterface();
+    if (!activeOnly) {
+        // Only the moving bodies have a RigidBody component
+        world.Each<RigidBody, Transform>(
+            [&](EntityId entity, RigidBody& body, Transform& transform) {
+                transform.matrix =
+                    ToGLM(bodyInterface.GetWorldTransform(body.bodyID));
+                world.MarkChanged<Transform>(entity);
+            });
+        return;
+    }
+
+    // The user data of a body is the id of its entity
+    activeBodies.clear();
+    physicsCore->GetActiveBodies(activeBodies);
+    ComponentArray<RigidBody>& bodies = world.GetComponents<RigidBody>();
+    ComponentArray<Transform>& transforms = world.GetComponents<Transform>();
+    for (const JPH::BodyID& bodyID : activeBodies) {
+        EntityId entity = (EntityId)bodyInterface.GetUserData(bodyID);
+        if (!bodies.Has(entity) || bodies.Get(entity).bodyID != bodyID) {
+            continue;
+        }
+        transforms.Get(entity).matrix =
+            ToGLM(bodyInterface.GetWorldTransform(bodyID));
+        transforms.MarkChanged(entity);
+    }
+}
+
+void SceneManager::UpdateBvh() {
+    World& world = World::Get();
+    ComponentArray<Bounds>& bounds = world.GetComponents<Bounds>();
+
+    if (world.GetLayoutVersion() != bvhLayoutVersion) {
+        bvhLayoutVersion = world.GetLayoutVersion();
+        // Entities with a RigidBody move, everything else is scenery
+        std::vector<Bvh::Item> staticItems;
+        std::vector<Bvh::Item> dynamicItems;
+        bool staticChanged = false;
+        world.Each<Bounds>([&](EntityId entity, Bounds& box) {
+            if (world.Has<RigidBody>(entity)) {
+                dynamicItems.push_back({entity, box.min, box.max});
+            } else {
+                staticChanged = staticChanged || !staticBvh.Contains(entity);
+                staticItems.push_back({entity, box.min, box.max});
+            }
+        });
+        // A new dynamic entity should not cost a rebuild of the scenery
+        if (staticChanged || staticItems.size() != staticBvh.GetSize()) {
+            staticBvh.Build(std::move(staticItems));
+        }
+        dynamicBvh.Build(std::move(dynamicItems));
+    } else if (dynamicBvh.GetUpdateCount() > dynamicBvh.GetSize() * 8) {
+        // Refitting has stretched the nodes, start over from the current
+        // bounds
+        dynamicBvh.Rebuild();
+    }
+
+    for (EntityId entity : bounds.GetChanged()) {
+        if (!bounds.Has(entity)) {
+            continue;
+        }
+        const Bounds& box = bounds.Get(entity);
+        if (staticBvh.Contains(entity)) {
+            staticBvh.Update(entity, box.min, box.max);
+        } else if (dynamicBvh.Contains(entity)) {
+            dynamicBvh.Update(entity, box.min, box.max);
+        }
+    }
+}
+
+std::vector<SceneRef<Entity>> SceneManager::QueryBox(const glm::vec3& min,
+                                                     const glm::vec3& max) {
+    queryResults.clear();
+    staticBvh.QueryBox(min, max, queryResults);
+    dynamicBvh.QueryBox(min, max, queryResults);
+    std::vector<SceneRef<Entity>> refs;
+    refs.reserve(queryResults.size());
+    for (EntityId entity : queryResults) {
+        SceneRef<Entity> ref = findEntity(entity);
+        if (ref.data) {
+            refs.push_back(ref);
+        }
+    }
+    return refs;
+}
+
+SceneRef<Entity> SceneManager::Raycast(const glm::vec3& origin,
+                                       const glm::vec3& direction,
+                                       float maxDistance, float& distance) {
+    EntityId hit = INVALID_ENTITY;
+    distance = maxDistance;
+    EntityId candidate;
+    float candidateDistance;
+    if (staticBvh.Raycast(origin, direction, distance, candidate,
+                          candidateDistance)) {
+        hit = candidate;
+        distance = candidateDistance;
+    }
+    if (dynamicBvh.Raycast(origin, direction, distance, candidate,
+                           candidateDistance)) {
+        hit = candidate;
+        distance = candidateDistance;
+    }
+    return findEntity(hit);
+}
+
+void SceneManager::QueryFrustum(const glm::mat4& viewProjection,
+                                std::vector<EntityId>& out) const {
+    // Rows of the matrix combined into the six planes, pointing inwards
+    auto row = [&](int i) {
+        return glm::vec4(viewProjection[0][i], viewProjection[1][i],
+                         viewProjection[2][i], viewProjection[3][i]);
+    };
+    glm::vec4 planes[6] = {
+        row(3) + row(0), row(3) - row(0), row(3) + row(1), row(3) - row(1),
+        // Clip space depth starts at -1 with homogeneous depth, else at 0
+        bgfx::getCaps()->homogeneousDepth ? row(3) + row(2) : row(2),
+        row(3) - row(2)};
+    staticBvh.QueryFrustum(planes, out);
+    dynamicBvh.QueryFrustum(planes, out);
+}
+
+void SceneManager::CullSnapshot(FrameSnapshot& snapshot) {
+    glm::mat4 viewProjection =
+        glm::make_mat4(snapshot.projection) * glm::make_mat4(snapshot.view);
+    queryResults.clear();
+    QueryFrustum(viewProjection, queryResults);
+    const DepthPyramid& depth = renderer->GetDepthPyramid();
+    ComponentArray<Bounds>& bounds = World::Get().GetComponents<Bounds>();
+    snapshot.visible.clear();
+    for (EntityId entity : queryResults) {
+        if (entity >= snapshot.drawOf.size() ||
+            snapshot.drawOf[entity] == UINT32_MAX) {
+            continue;
+        }
+        if (!depth.IsEmpty()) {
+            const Bounds& box = bounds.Get(entity);
+            if (depth.IsOccluded(box.min, box.max)) {
+                continue;
+            }
+        }
+        snapshot.visible.push_back(snapshot.drawOf[entity]);
+    }
+}
+
+bool SceneManager::RestorePhysicsSnapshot(const PhysicsSnapshot& snapshot) {
+    if (!physicsCore->RestoreSnapshot(snapshot)) {
+        return false;
+    }
+    SyncTransformsFromPhysics(false);
+    bx::debugPrintf("Physics restored to step %llu\n", snapshot.step);
+    return true;
+}
+
 SceneRef<Texture> SceneManager::AddTexture(Texture texture) {
     // Check if the texture path already exists in the map
     auto it = loadedURIs.find(texture.GetPath());
     if (it != loadedURIs.end()) {
         bx::debugPrintf("Texture already loaded with path: %s\n",
                         texture.GetPath().c_str());
-        return {it->second, textures.at(it->second)};
+        uint64_t id = shareURI(it->second);
+        return {id, textures.at(id)};
     }
     // Create a new texture and add it to the map
-    uint64_t id = textures.size();
-    auto texturePtr = new Texture(std::move(texture));
+    uint64_t id = nextTextureId++;
+    auto texturePtr = currentArena->textures.Create(std::move(texture));
     textures.emplace(id, texturePtr);
+    currentArena->textureIds.push_back(id);
     SceneRef<Texture> ref;
     ref.id = id;
     ref.data = textures.at(id);
-    loadedURIs.emplace(texture.GetPath(), id);
+    loadedURIs.emplace(texturePtr->GetPath(), LoadedURI{id, currentArena});
     bx::debugPrintf("Texture added with ID: %llu\n", id);
     return ref;
 }
@@ -256,16 +562,18 @@ SceneRef<Texture> SceneManager::AddTexture(const std::string& filePath,
     if (it != loadedURIs.end()) {
         bx::debugPrintf("Texture already loaded with path: %s\n",
                         filePath.c_str());
-        return {it->second, textures.at(it->second)};
+        uint64_t id = shareURI(it->second);
+        return {id, textures.at(id)};
     }
     // Create a new texture and add it to the map
-    uint64_t id = textures.size();
-    auto texturePtr = new Texture(filePath, flags);
+    uint64_t id = nextTextureId++;
+    auto texturePtr = currentArena->textures.Create(filePath, flags);
     textures.emplace(id, texturePtr);
+    currentArena->textureIds.push_back(id);
     SceneRef<Texture> ref;
     ref.id = id;
     ref.data = textures.at(id);
-    loadedURIs.emplace(filePath, id);
+    loadedURIs.emplace(filePath, LoadedURI{id, currentArena});
     bx::debugPrintf("Texture added with ID: %llu\n", id);
     return ref;
 }
@@ -286,10 +594,12 @@ SceneRef<Texture> SceneManager::GetTexture(const uint64_t id) {
 void SceneManager::RemoveTexture(const uint64_t id) {
     auto it = textures.find(id);
     if (it != textures.end()) {
-        delete it->second;
-        textures.erase(it);
         // Remove the texture from the loadedURIs map
         loadedURIs.erase(it->second->GetPath());
+        destroyObject(&SceneArena::textures, it->second);
+        textures.erase(it);
+        // Captured frames may still point at the texture
+        World::Get().MarkLayoutChanged();
         bx::debugPrintf("Texture removed with ID: %llu\n", id);
     } else {
         bx::debugPrintf("Texture not found with ID: %llu\n", id);
@@ -298,9 +608,10 @@ void SceneManager::RemoveTexture(const uint64_t id) {
 
 SceneRef<Material> SceneManager::AddMaterial(Material material) {
     // Create a new material and add it to the map
-    uint64_t id = materials.size();
-    auto materialPtr = new Material(std::move(material));
+    uint64_t id = nextMaterialId++;
+    auto materialPtr = currentArena->materials.Create(std::move(material));
     materials.emplace(id, materialPtr);
+    currentArena->materialIds.push_back(id);
     SceneRef<Material> ref;
     ref.id = id;
     ref.data = materials.at(id);
@@ -323,9 +634,10 @@ SceneRef<Material> SceneManager::AddMaterial(uint64_t albedoId,
     }
 
     // Create a new material and add it to the map
-    uint64_t id = materials.size();
-    auto materialPtr = new Material(albedoId, normalId);
+    uint64_t id = nextMaterialId++;
+    auto materialPtr = currentArena->materials.Create(albedoId, normalId);
     materials.emplace(id, materialPtr);
+    currentArena->materialIds.push_back(id);
     SceneRef<Material> ref;
     ref.id = id;
     ref.data = materials.at(id);
@@ -340,9 +652,11 @@ SceneRef<Material> SceneManager::AddMaterial(std::string albedoPath,
     auto normalTexture = AddTexture(normalPath);
 
     // Create a new material and add it to the map
-    uint64_t id = materials.size();
-    auto materialPtr = new Material(albedoTexture.id, normalTexture.id);
+    uint64_t id = nextMaterialId++;
+    auto materialPtr =
+        currentArena->materials.Create(albedoTexture.id, normalTexture.id);
     materials.emplace(id, materialPtr);
+    currentArena->materialIds.push_back(id);
     SceneRef<Material> ref;
     ref.id = id;
     ref.data = materials.at(id);
@@ -366,8 +680,9 @@ SceneRef<Material> SceneManager::GetMaterial(const uint64_t id) {
 void SceneManager::RemoveMaterial(const uint64_t id) {
     auto it = materials.find(id);
     if (it != materials.end()) {
-        delete it->second;
+        destroyObject(&SceneArena::materials, it->second);
         materials.erase(it);
+        World::Get().MarkLayoutChanged();
         bx::debugPrintf("Material removed with ID: %llu\n", id);
     } else {
         bx::debugPrintf("Material not found with ID: %llu\n", id);
@@ -381,16 +696,18 @@ SceneManager::AddMeshContainer(MeshContainer meshContainer) {
     if (it != loadedURIs.end()) {
         bx::debugPrintf("MeshContainer already loaded with path: %s\n",
                         meshContainer.GetPath().c_str());
-        return {it->second, meshes.at(it->second)};
+        uint64_t id = shareURI(it->second);
+        return {id, meshes.at(id)};
     }
     // Create a new mesh container and add it to the map
-    uint64_t id = meshes.size();
-    auto meshPtr = new MeshContainer(std::move(meshContainer));
+    uint64_t id = nextMeshId++;
+    auto meshPtr = currentArena->meshes.Create(std::move(meshContainer));
     meshes.emplace(id, meshPtr);
+    currentArena->meshIds.push_back(id);
     SceneRef<MeshContainer> ref;
     ref.id = id;
     ref.data = meshes.at(id);
-    loadedURIs.emplace(meshContainer.GetPath(), id);
+    loadedURIs.emplace(meshPtr->GetPath(), LoadedURI{id, currentArena});
     bx::debugPrintf("MeshContainer added with ID: %llu\n", id);
     return ref;
 }
@@ -402,12 +719,14 @@ SceneManager::AddMeshContainer(const std::string& path) {
     if (it != loadedURIs.end()) {
         bx::debugPrintf("MeshContainer already loaded with path: %s\n",
                         path.c_str());
-        return {it->second, meshes.at(it->second)};
+        uint64_t id = shareURI(it->second);
+        return {id, meshes.at(id)};
     }
     // Create a new mesh container and add it to the map
-    uint64_t id = meshes.size();
-    auto meshPtr = new MeshContainer(path);
+    uint64_t id = nextMeshId++;
+    auto meshPtr = currentArena->meshes.Create(path);
     meshes.emplace(id, meshPtr);
+    currentArena->meshIds.push_back(id);
     SceneRef<MeshContainer> ref;
     ref.id = id;
     ref.data = meshes.at(id);
@@ -423,13 +742,15 @@ SceneManager::AddMeshContainer(std::string path, std::vector<Vertex> vertices,
     if (it != loadedURIs.end()) {
         bx::debugPrintf("MeshContainer already loaded with path: %s\n",
                         path.c_str());
-        return {it->second, meshes.at(it->second)};
+        uint64_t id = shareURI(it->second);
+        return {id, meshes.at(id)};
     }
     // Create a new mesh container and add it to the map
-    uint64_t id = meshes.size();
-    auto meshPtr = new MeshContainer(std::move(path), std::move(vertices),
-                                     std::move(indices));
+    uint64_t id = nextMeshId++;
+    auto meshPtr = currentArena->meshes.Create(
+        std::move(path), std::move(vertices), std::move(indices));
     meshes.emplace(id, meshPtr);
+    currentArena->meshIds.push_back(id);
     SceneRef<MeshContainer> ref;
     ref.id = id;
     ref.data = meshes.at(id);
@@ -454,7 +775,7 @@ void SceneManager::RemoveMeshContainer(const uint64_t id) {
     auto it = meshes.find(id);
     if (it != meshes.end()) {
         loadedURIs.erase(it->second->GetPath());
-        delete it->second;
+        destroyObject(&SceneArena::meshes, it->second);
         meshes.erase(it);
         bx::debugPrintf("MeshContainer removed with ID: %llu\n", id);
     } else {
@@ -464,9 +785,10 @@ void SceneManager::RemoveMeshContainer(const uint64_t id) {
 
 SceneRef<Collider> SceneManager::AddCollider(Collider collider) {
     // Create a new collider and add it to the map
-    uint64_t id = colliders.size();
-    auto colliderPtr = new Collider(std::move(collider));
+    uint64_t id = nextColliderId++;
+    auto colliderPtr = currentArena->colliders.Create(std::move(collider));
     colliders.emplace(id, colliderPtr);
+    currentArena->colliderIds.push_back(id);
     SceneRef<Collider> ref;
     ref.id = id;
     ref.data = colliders.at(id);
@@ -479,9 +801,11 @@ SceneRef<Collider> SceneManager::AddCollider(ColliderType type,
                                              const glm::vec3& rotation,
                                              const glm::vec3& size) {
     // Create a new collider and add it to the map
-    uint64_t id = colliders.size();
-    auto colliderPtr = new Collider(type, position, rotation, size);
+    uint64_t id = nextColliderId++;
+    auto colliderPtr =
+        currentArena->colliders.Create(type, position, rotation, size);
     colliders.emplace(id, colliderPtr);
+    currentArena->colliderIds.push_back(id);
     SceneRef<Collider> ref;
     ref.id = id;
     ref.data = colliders.at(id);
@@ -505,7 +829,7 @@ SceneRef<Collider> SceneManager::GetCollider(const uint64_t id) {
 void SceneManager::RemoveCollider(const uint64_t id) {
     auto it = colliders.find(id);
     if (it != colliders.end()) {
-        delete it->second;
+        destroyObject(&SceneArena::colliders, it->second);
         colliders.erase(id);
         bx::debugPrintf("Collider removed with ID: %llu\n", id);
     } else {
@@ -515,9 +839,10 @@ void SceneManager::RemoveCollider(const uint64_t id) {
 
 SceneRef<Camera> SceneManager::AddCamera(Camera camera) {
     // Create a new camera and add it to the map
-    uint64_t id = cameras.size();
-    auto cameraPtr = new Camera(std::move(camera));
+    uint64_t id = nextCameraId++;
+    auto cameraPtr = currentArena->cameras.Create(std::move(camera));
     cameras.emplace(id, cameraPtr);
+    currentArena->cameraIds.push_back(id);
     SceneRef<Camera> ref;
     ref.id = id;
     ref.data = cameras.at(id);
@@ -530,10 +855,11 @@ SceneRef<Camera> SceneManager::AddCamera(const glm::vec3& position,
                                          const float nearPlane,
                                          const float farPlane) {
     // Create a new camera and add it to the map
-    uint64_t id = cameras.size();
-    auto cameraPtr =
-        new Camera(*renderer, position, up, fov, nearPlane, farPlane);
+    uint64_t id = nextCameraId++;
+    auto cameraPtr = currentArena->cameras.Create(*renderer, position, up, fov,
+                                                  nearPlane, farPlane);
     cameras.emplace(id, cameraPtr);
+    currentArena->cameraIds.push_back(id);
     SceneRef<Camera> ref;
     ref.id = id;
     ref.data = cameras.at(id);
@@ -558,7 +884,7 @@ void SceneManager::RemoveCamera(const uint64_t id) {
     // Check if the camera exists in the map
     auto it = cameras.find(id);
     if (it != cameras.end()) {
-        delete it->second;
+        destroyObject(&SceneArena::cameras, it->second);
         cameras.erase(it);
         bx::debugPrintf("Camera removed with ID: %llu\n", id);
     } else {
@@ -578,3 +904,28 @@ SceneRef<Camera> SceneManager::GetActiveCamera() {
     // Return an empty reference if not found
     return {0, nullptr};
 }
+
+EntityId SceneManager::AddLight(const Light& light) {
+    World& world = World::Get();
+    EntityId entity = world.Create();
+    world.Add<Light>(entity, light);
+    bx::debugPrintf("Light added with entity ID: %u\n", entity);
+    return entity;
+}
+
+Light* SceneManager::GetLight(EntityId light) {
+    World& world = World::Get();
+    if (!world.IsAlive(light) || !world.Has<Light>(light)) {
+        return nullptr;
+    }
+    return &world.Get<Light>(light);
+}
+
+void SceneManager::RemoveLight(EntityId light) {
+    if (!GetLight(light)) {
+        bx::debugPrintf("Light not found with entity ID: %u\n", light);
+        return;
+    }
+    World::Get().Destroy(light);
+    bx::debugPrintf("Light removed with entity ID: %u\n", light);
+}
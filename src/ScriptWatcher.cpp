@@ -0,0 +1,161 @@
+#include "ScriptWatcher.hpp"
+#include "bx/debug.h"
+#include "bx/timer.h"
+#include <algorithm>
+#include <system_error>
+
+#ifdef __linux__
+#include <cerrno>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+ScriptWatcher::ScriptWatcher() {
+#ifdef __linux__
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0) {
+        bx::debugPrintf("inotify unavailable, polling scripts instead\n");
+    }
+#endif
+}
+
+ScriptWatcher::~ScriptWatcher() {
+#ifdef __linux__
+    if (inotifyFd >= 0) {
+        close(inotifyFd);
+    }
+#endif
+}
+
+std::string ScriptWatcher::key(const std::filesystem::path& path) {
+    return path.lexically_normal().string();
+}
+
+void ScriptWatcher::addDir(const std::string& path, bool allScripts) {
+    for (auto& dir : dirs) {
+        if (key(dir.path) == key(path)) {
+            dir.allScripts = dir.allScripts || allScripts;
+            return;
+        }
+    }
+    dirs.push_back({path, allScripts});
+
+#ifdef __linux__
+    if (inotifyFd >= 0) {
+        // Editors often save by writing a new file and renaming it over the
+        // old one, so watch for moves as well as writes
+        int wd = inotify_add_watch(inotifyFd, path.c_str(),
+                                   IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd < 0) {
+            bx::debugPrintf("Failed to watch %s\n", path.c_str());
+            return;
+        }
+        watchDescriptors[wd] = dirs.size() - 1;
+    }
+#endif
+}
+
+bool ScriptWatcher::Watch(const std::string& path) {
+    std::error_code ec;
+    if (std::filesystem::is_directory(path, ec)) {
+        for (const auto& entry : std::filesystem::directory_iterator(path, ec)) {
+            if (entry.path().extension() == ".lua") {
+                files[key(entry.path())] = entry.path().string();
+                mtimes[entry.path().string()] =
+                    std::filesystem::last_write_time(entry.path(), ec);
+            }
+        }
+        addDir(path, true);
+        return true;
+    }
+    if (!std::filesystem::is_regular_file(path, ec)) {
+        return false;
+    }
+
+    std::filesystem::path file(path);
+    std::string parent = file.parent_path().string();
+    files[key(file)] = path;
+    mtimes[path] = std::filesystem::last_write_time(file, ec);
+    addDir(parent.empty() ? "." : parent, false);
+    return true;
+}
+
+void ScriptWatcher::pollMTimes(std::vector<std::string>& changed) {
+    // Stat'ing every script each frame is wasteful, twice a second is enough
+    int64_t now = bx::getHPCounter();
+    if (now - lastPoll < bx::getHPFrequency() / 2) {
+        return;
+    }
+    lastPoll = now;
+
+    std::error_code ec;
+    for (const auto& dir : dirs) {
+        if (!dir.allScripts) {
+            continue;
+        }
+        for (const auto& entry :
+             std::filesystem::directory_iterator(dir.path, ec)) {
+            if (entry.path().extension() == ".lua" &&
+                files.find(key(entry.path())) == files.end()) {
+                files[key(entry.path())] = entry.path().string();
+            }
+        }
+    }
+    for (const auto& [normalized, path] : files) {
+        auto mtime = std::filesystem::last_write_time(path, ec);
+        if (ec) {
+            continue;
+        }
+        auto it = mtimes.find(path);
+        if (it == mtimes.end() || it->second != mtime) {
+            mtimes[path] = mtime;
+            changed.push_back(path);
+        }
+    }
+}
+
+std::vector<std::string> ScriptWatcher::Poll() {
+    std::vector<std::string> changed;
+    if (inotifyFd < 0) {
+        pollMTimes(changed);
+        return changed;
+    }
+
+#ifdef __linux__
+    alignas(inotify_event) char buffer[4096];
+    while (true) {
+        ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break;
+        }
+        for (char* ptr = buffer; ptr < buffer + length;) {
+            auto* event = reinterpret_cast<inotify_event*>(ptr);
+            ptr += sizeof(inotify_event) + event->len;
+
+            auto wd = watchDescriptors.find(event->wd);
+            if (wd == watchDescriptors.end() || event->len == 0) {
+                continue;
+            }
+            const WatchedDir& dir = dirs[wd->second];
+            std::filesystem::path path =
+                std::filesystem::path(dir.path) / event->name;
+            if (path.extension() != ".lua") {
+                continue;
+            }
+
+            auto file = files.find(key(path));
+            if (file == files.end()) {
+                if (!dir.allScripts) {
+                    continue;
+                }
+                file = files.emplace(key(path), path.string()).first;
+            }
+            if (std::find(changed.begin(), changed.end(), file->second) ==
+                changed.end()) {
+                changed.push_back(file->second);
+            }
+        }
+    }
+#endif
+    return changed;
+}
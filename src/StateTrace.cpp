@@ -0,0 +1,74 @@
+#include "StateTrace.hpp"
+#include "bx/debug.h"
+
+StateTrace::~StateTrace() { Close(); }
+
+bool StateTrace::Open(const std::string& path, Mode mode) {
+    Close();
+    if (mode == Mode::Off) {
+        return true;
+    }
+
+    auto flags = std::ios::binary |
+                 (mode == Mode::Record ? std::ios::out | std::ios::trunc
+                                       : std::ios::in);
+    file.open(path, flags);
+    if (!file.is_open()) {
+        bx::debugPrintf("Failed to open state trace: %s\n", path.c_str());
+        return false;
+    }
+
+    this->mode = mode;
+    checkedSteps = 0;
+    desynced = false;
+    bx::debugPrintf("%s state trace: %s\n",
+                    mode == Mode::Record ? "Recording" : "Comparing against",
+                    path.c_str());
+    return true;
+}
+
+void StateTrace::Close() {
+    if (file.is_open()) {
+        if (mode == Mode::Compare && !desynced) {
+            bx::debugPrintf("State trace matched for %llu steps\n",
+                            (unsigned long long)checkedSteps);
+        }
+        file.close();
+    }
+    mode = Mode::Off;
+}
+
+bool StateTrace::Step(uint64_t step, uint64_t hash) {
+    if (mode == Mode::Record) {
+        // Entries are fixed size pairs of step and hash
+        file.write(reinterpret_cast<const char*>(&step), sizeof(step));
+        file.write(reinterpret_cast<const char*>(&hash), sizeof(hash));
+        checkedSteps++;
+        return true;
+    }
+    if (mode != Mode::Compare || desynced) {
+        return !desynced;
+    }
+
+    uint64_t expectedStep = 0;
+    uint64_t expectedHash = 0;
+    file.read(reinterpret_cast<char*>(&expectedStep), sizeof(expectedStep));
+    file.read(reinterpret_cast<char*>(&expectedHash), sizeof(expectedHash));
+    if (!file) {
+        // Ran past the end of the recording, nothing left to compare
+        return true;
+    }
+
+    if (expectedStep != step || expectedHash != hash) {
+        desynced = true;
+        bx::debugPrintf("Desync at step %llu: expected %016llx (step %llu), "
+                        "got %016llx\n",
+                        (unsigned long long)step,
+                        (unsigned long long)expectedHash,
+                        (unsigned long long)expectedStep,
+                        (unsigned long long)hash);
+        return false;
+    }
+    checkedSteps++;
+    return true;
+}
@@ -0,0 +1,86 @@
+#include "SystemScheduler.hpp"
+#include <algorithm>
+#include "TaskSystem.hpp"
+#include <bx/debug.h>
+
+SystemScheduler::SystemScheduler(World& world) : world(world) {}
+
+bool SystemScheduler::conflicts(const SystemAccess& a, const SystemAccess& b) {
+    auto overlaps = [](const std::vector<ComponentTypeId>& x,
+                       const std::vector<ComponentTypeId>& y) {
+        for (ComponentTypeId id : x) {
+            if (std::find(y.begin(), y.end(), id) != y.end()) {
+                return true;
+            }
+        }
+        return false;
+    };
+    return overlaps(a.writes, b.reads) || overlaps(a.writes, b.writes) ||
+           overlaps(b.writes, a.reads);
+}
+
+void SystemScheduler::AddSystem(std::string name, SystemAccess access,
+                                System system) {
+    systems.push_back({std::move(name), std::move(access), std::move(system)});
+    dirty = true;
+}
+
+void SystemScheduler::buildStages() {
+    stages.clear();
+    std::vector<size_t> stageOf(systems.size());
+    for (size_t i = 0; i < systems.size(); i++) {
+        size_t stage = 0;
+        for (size_t j = 0; j < i; j++) {
+            if (conflicts(systems[i].access, systems[j].access)) {
+                stage = std::max(stage, stageOf[j] + 1);
+            }
+        }
+        stageOf[i] = stage;
+        if (stage >= stages.size()) {
+            stages.resize(stage + 1);
+        }
+        stages[stage].push_back(i);
+    }
+    dirty = false;
+}
+
+void SystemScheduler::Run(double deltaTime) {
+    if (dirty) {
+        buildStages();
+    }
+    TaskSystem& taskSystem = TaskSystem::Get();
+    std::vector<TaskHandle> tasks;
+    for (const std::vector<size_t>& stage : stages) {
+        // Everything but the main thread systems goes to the task system,
+        // the calling thread runs the rest and then helps with the stage
+        std::vector<const Entry*> local;
+        for (size_t index : stage) {
+            const Entry& entry = systems[index];
+            if (entry.access.mainThread || stage.size() == 1) {
+                local.push_back(&entry);
+            } else {
+                tasks.push_back(taskSystem.Submit([this, &entry, deltaTime] {
+                    entry.system(world, deltaTime);
+                }));
+            }
+        }
+        for (const Entry* entry : local) {
+            entry->system(world, deltaTime);
+        }
+        taskSystem.Wait(tasks);
+        tasks.clear();
+    }
+}
+
+void SystemScheduler::PrintStages() {
+    if (dirty) {
+        buildStages();
+    }
+    for (size_t i = 0; i < stages.size(); i++) {
+        bx::debugPrintf("Stage %zu:", i);
+        for (size_t index : stages[i]) {
+            bx::debugPrintf(" %s", systems[index].name.c_str());
+        }
+        bx::debugPrintf("\n");
+    }
+}
@@ -0,0 +1,253 @@
+#include "TaskSystem.hpp"
+#include <algorithm>
+#include <cstdint>
+#include "bx/debug.h"
+
+namespace {
+// Index of the worker running on this thread, SIZE_MAX outside the pool
+thread_local size_t currentWorker = SIZE_MAX;
+} // namespace
+
+void TaskSystem::Init(size_t count) {
+    mainThread = std::this_thread::get_id();
+    // There is always one queue, with no workers the waiting threads take
+    // the tasks from it
+    size_t queues = std::max<size_t>(count, 1);
+    for (size_t i = 0; i < queues; i++) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < count; i++) {
+        workers[i]->thread = std::thread(&TaskSystem::workerLoop, this, i);
+    }
+    threadCount = count;
+    bx::debugPrintf("Task system started with %zu workers\n", count);
+}
+
+void TaskSystem::Shutdown() {
+    {
+        std::lock_guard lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+    workers.clear();
+    threadCount = 0;
+    queued = 0;
+    {
+        std::lock_guard lock(mainMutex);
+        mainQueue.clear();
+    }
+    stopping = false;
+}
+
+void TaskSystem::workerLoop(size_t index) {
+    currentWorker = index;
+    while (true) {
+        if (TaskHandle task = pop(index, true)) {
+            execute(task);
+            continue;
+        }
+        std::unique_lock lock(sleepMutex);
+        wake.wait(lock, [&] { return stopping || queued > 0; });
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+void TaskSystem::schedule(const TaskHandle& task) {
+    if (task->mainThread) {
+        std::lock_guard lock(mainMutex);
+        mainQueue.push_back(task);
+        return;
+    }
+    if (workers.empty()) {
+        execute(task); // Not started, run in place
+        return;
+    }
+
+    // Workers keep their own tasks, others are spread round robin
+    size_t index = currentWorker < workers.size()
+                       ? currentWorker
+                       : nextWorker++ % workers.size();
+    Worker& worker = *workers[index];
+    {
+        std::lock_guard lock(worker.mutex);
+        worker.queues[(size_t)task->priority].push_back(task);
+    }
+    queued++;
+    {
+        // Taking the lock makes sure a worker about to sleep sees the task
+        std::lock_guard lock(sleepMutex);
+    }
+    wake.notify_one();
+}
+
+TaskHandle TaskSystem::pop(size_t index, bool takeLow) {
+    if (queued == 0) {
+        return nullptr;
+    }
+    size_t count = workers.size();
+    size_t priorities = takeLow ? (size_t)TaskPriority::Count
+                                : (size_t)TaskPriority::Low;
+    for (size_t priority = 0; priority < priorities; priority++) {
+        // The newest task of our own queue is the most likely to be in cache
+        if (index < count) {
+            Worker& worker = *workers[index];
+            std::lock_guard lock(worker.mutex);
+            auto& queue = worker.queues[priority];
+            if (!queue.empty()) {
+                TaskHandle task = std::move(queue.back());
+                queue.pop_back();
+                queued--;
+                return task;
+            }
+        }
+        // Steal the oldest task of another worker
+        size_t start = index < count ? index + 1 : 0;
+        for (size_t i = 0; i < count; i++) {
+            size_t victim = (start + i) % count;
+            if (victim == index) {
+                continue;
+            }
+            Worker& worker = *workers[victim];
+            std::lock_guard lock(worker.mutex);
+            auto& queue = worker.queues[priority];
+            if (!queue.empty()) {
+                TaskHandle task = std::move(queue.front());
+                queue.pop_front();
+                queued--;
+                return task;
+            }
+        }
+    }
+    return nullptr;
+}
+
+void TaskSystem::execute(const TaskHandle& task) {
+    task->function();
+    task->function = nullptr; // Release the captures now
+
+    std::vector<TaskHandle> dependents;
+    {
+        std::lock_guard lock(task->mutex);
+        task->done.store(true, std::memory_order_release);
+        dependents.swap(task->dependents);
+    }
+    for (const TaskHandle& dependent : dependents) {
+        if (dependent->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            schedule(dependent);
+        }
+    }
+}
+
+bool TaskSystem::runMainThreadTask() {
+    TaskHandle task;
+    {
+        std::lock_guard lock(mainMutex);
+        if (mainQueue.empty()) {
+            return false;
+        }
+        task = std::move(mainQueue.front());
+        mainQueue.pop_front();
+    }
+    execute(task);
+    return true;
+}
+
+TaskHandle TaskSystem::Submit(std::function<void()> function,
+                              TaskPriority priority) {
+    return Submit(std::move(function), {}, priority);
+}
+
+TaskHandle TaskSystem::Submit(std::function<void()> function,
+                              const std::vector<TaskHandle>& dependencies,
+                              TaskPriority priority) {
+    auto task = std::make_shared<Task>();
+    task->function = std::move(function);
+    task->priority = priority;
+    return submit(std::move(task), dependencies);
+}
+
+TaskHandle
+TaskSystem::SubmitMainThread(std::function<void()> function,
+                             const std::vector<TaskHandle>& dependencies) {
+    auto task = std::make_shared<Task>();
+    task->function = std::move(function);
+    task->mainThread = true;
+    return submit(std::move(task), dependencies);
+}
+
+TaskHandle TaskSystem::submit(TaskHandle task,
+                              const std::vector<TaskHandle>& dependencies) {
+    for (const TaskHandle& dependency : dependencies) {
+        if (!dependency) {
+            continue;
+        }
+        std::lock_guard lock(dependency->mutex);
+        if (!dependency->IsDone()) {
+            dependency->dependents.push_back(task);
+            task->pending++;
+        }
+    }
+    // Drop the submission count, schedules the task if nothing is left
+    if (task->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        schedule(task);
+    }
+    return task;
+}
+
+void TaskSystem::Wait(const TaskHandle& task) {
+    if (!task) {
+        return;
+    }
+    bool onMainThread = IsMainThread();
+    while (!task->IsDone()) {
+        if (onMainThread && runMainThreadTask()) {
+            continue;
+        }
+        // Low priority tasks can run for a long time, leave them to the
+        // workers so the waiting thread is not held up
+        if (TaskHandle other = pop(currentWorker, threadCount == 0)) {
+            execute(other);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void TaskSystem::Wait(const std::vector<TaskHandle>& tasks) {
+    for (const TaskHandle& task : tasks) {
+        Wait(task);
+    }
+}
+
+void TaskSystem::ParallelFor(
+    size_t count, size_t grain,
+    const std::function<void(size_t, size_t)>& function,
+    TaskPriority priority) {
+    if (count == 0) {
+        return;
+    }
+    grain = std::max<size_t>(grain, 1);
+    std::vector<TaskHandle> tasks;
+    tasks.reserve(count / grain);
+    // The first range is run here, the rest go to the pool
+    for (size_t begin = grain; begin < count; begin += grain) {
+        size_t end = std::min(begin + grain, count);
+        tasks.push_back(
+            Submit([&function, begin, end] { function(begin, end); },
+                   priority));
+    }
+    function(0, std::min(grain, count));
+    Wait(tasks);
+}
+
+void TaskSystem::RunMainThreadTasks() {
+    while (runMainThreadTask()) {
+    }
+}
@@ -6,14 +6,27 @@
 #include <functional>
 #include <glm/glm.hpp>
 #include <filesystem>
+#include <cstdlib>
+#include <algorithm>
+#include <thread>
 
 #include "Enums.hpp"
 #include "Entity.hpp"
 #include "Core.hpp"
 #include "Renderer.hpp"
 #include "Primitive.hpp"
+#include "PrimitiveDefinitions.hpp"
 #include "LuaCore.hpp"
 #include "PhysicsCore.hpp"
+#include "PhysicsHistory.hpp"
+#include "StateTrace.hpp"
+#include "InputRecorder.hpp"
+#include "FrameTimings.hpp"
+#include "EventBus.hpp"
+#include "ScriptWatcher.hpp"
+#include "LuaWorkerPool.hpp"
+#include "SystemScheduler.hpp"
+#include "TaskSystem.hpp"
 #include "utils.hpp"
 #include "MeshContainer.hpp"
 #include "MeshEntity.hpp"
@@ -41,19 +54,98 @@ int main(int argc, char** argv) {
     double accumulator = 0;
     bx::debugPrintf("Starting application\n");
 
+    // --deterministic, --record-trace <file>, --compare-trace <file>,
+    // --record-input <file>, --play-input <file>, --no-bytecode-cache,
+    // --lua-profile <seconds>, --lua-gc <incremental|generational>,
+    // --lua-workers <count>, --lua-worker <script>, --workers <count>,
+    // --pipelined, --no-static-batching, --no-occlusion, --light-gizmos and
+    // --rollback
+    bool deterministic = false;
+    bool useBytecodeCache = true;
+    bool pipelined = false;
+    bool staticBatching = true;
+    bool occlusionCulling = true;
+    bool lightGizmos = false;
+    bool rollback = false;
+    double luaProfileInterval = 0.0;
+    std::string luaGCMode;
+    size_t luaWorkerCount = 0;
+    std::vector<std::string> luaWorkerScripts;
+    size_t cores = std::thread::hardware_concurrency();
+    size_t workerCount = cores > 1 ? cores - 1 : 0;
+    StateTrace trace;
+    InputRecorder inputRecorder;
+    FrameTimings frameTimings;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--deterministic") {
+            deterministic = true;
+        } else if (arg == "--record-trace" && i + 1 < argc) {
+            deterministic = true;
+            trace.Open(argv[++i], StateTrace::Mode::Record);
+        } else if (arg == "--compare-trace" && i + 1 < argc) {
+            deterministic = true;
+            trace.Open(argv[++i], StateTrace::Mode::Compare);
+        } else if (arg == "--no-bytecode-cache") {
+            useBytecodeCache = false;
+        } else if (arg == "--record-input" && i + 1 < argc) {
+            // A recording only replays the same on a deterministic run
+            deterministic = true;
+            inputRecorder.Open(argv[++i], InputRecorder::Mode::Record);
+        } else if (arg == "--play-input" && i + 1 < argc) {
+            deterministic = true;
+            inputRecorder.Open(argv[++i], InputRecorder::Mode::Playback);
+        } else if (arg == "--lua-profile" && i + 1 < argc) {
+            luaProfileInterval = std::atof(argv[++i]);
+        } else if (arg == "--lua-gc" && i + 1 < argc) {
+            luaGCMode = argv[++i];
+        } else if (arg == "--lua-workers" && i + 1 < argc) {
+            luaWorkerCount = (size_t)std::atoi(argv[++i]);
+        } else if (arg == "--lua-worker" && i + 1 < argc) {
+            luaWorkerScripts.push_back(argv[++i]);
+        } else if (arg == "--pipelined") {
+            pipelined = true;
+        } else if (arg == "--no-static-batching") {
+            staticBatching = false;
+        } else if (arg == "--no-occlusion") {
+            occlusionCulling = false;
+        } else if (arg == "--light-gizmos") {
+            lightGizmos = true;
+        } else if (arg == "--rollback") {
+            rollback = true;
+        } else if (arg == "--workers" && i + 1 < argc) {
+            workerCount = (size_t)std::atoi(argv[++i]);
+        }
+    }
+
+    // One pool of workers for physics, systems, loading and the Lua workers,
+    // the main thread makes up the last core
+    TaskSystem::Get().Init(workerCount);
+
     LuaCore lua;
     lua.Init();
+    lua.GetBytecodeCache().SetEnabled(useBytecodeCache);
+    LuaProfiler::Get().SetReportInterval(luaProfileInterval);
+    if (luaGCMode == "generational") {
+        lua.SetGenerationalGC();
+    } else if (luaGCMode == "incremental") {
+        // Smaller steps every frame instead of longer pauses
+        lua.SetIncrementalGC();
+        lua.SetGCStepPerFrame(16);
+    }
 
     PhysicsCore physicsCore = PhysicsCore();
-    physicsCore.Init();
+    physicsCore.Init(deterministic);
 
     Core core = Core();
     core.Init();
+    core.SetInputRecorder(&inputRecorder);
     core.SetWindowMinimizedCallback(
         [&]() { lua.FireSignal(lua.WindowService.Minimized); });
 
     Renderer renderer = Renderer("Hello World", 1280, 720);
-    renderer.Init();
+    renderer.Init(pipelined);
+    renderer.SetOcclusionCulling(occlusionCulling);
     core.SetRenderer(&renderer);
     SceneImporter sceneImporter;
 
@@ -83,17 +175,37 @@ int main(int argc, char** argv) {
             scene.AddEntity(PrimitiveType::Plane, RigidBodyType::Static,
                             materialRef.id, glm::vec3{0.0f});
 
-            scene.AddScene("assets/test/loonar-test-scene.gltf");
+            scene.AddScene("assets/test/loonar-test-scene.gltf",
+                           staticBatching);
 
-            core.SetKeyEventCallback(std::bind(KeyEvent, std::placeholders::_1,
-                                               std::placeholders::_2,
-                                               scene.GetEntities()));
+            Light sun;
+            sun.type = LightType::Directional;
+            sun.direction = glm::vec3(-0.5f, -0.3f, 0.5f);
+            sun.color = glm::vec3(1.0f, 0.9f, 0.8f);
+            scene.AddLight(sun);
+            // A ring of colored point lights around the origin
+            for (int i = 0; i < 16; i++) {
+                float angle = glm::radians(i * 360.0f / 16.0f);
+                Light light;
+                light.position = glm::vec3(6.0f * glm::cos(angle), 1.0f,
+                                           6.0f * glm::sin(angle));
+                light.color = glm::vec3(0.5f + 0.5f * glm::cos(angle),
+                                        0.5f + 0.5f * glm::sin(angle), 0.6f);
+                light.intensity = 2.0f;
+                light.range = 4.0f;
+                scene.AddLight(light);
+            }
         }
 
-        // Run lua Scripts
+        // Run lua Scripts, and watch them so changes are reloaded in place
+        ScriptWatcher scriptWatcher;
         for (int i = 0; i < argc; i++) {
+            if (i > 0 && std::string(argv[i - 1]) == "--lua-worker") {
+                continue; // Runs in a worker state below
+            }
 
             if (std::filesystem::is_directory(argv[i])) {
+                scriptWatcher.Watch(argv[i]);
                 for (const auto& entry :
                      std::filesystem::directory_iterator(argv[i])) {
                     if (entry.path().extension() == ".lua") {
@@ -102,39 +214,242 @@ int main(int argc, char** argv) {
                 }
             } else if (std::filesystem::is_regular_file(argv[i]) &&
                        std::filesystem::path(argv[i]).extension() == ".lua") {
+                scriptWatcher.Watch(argv[i]);
                 lua.Run(argv[i]);
             }
         }
 
+        // Scripts that do not share state with the others run in their own
+        // Lua states on worker threads
+        LuaWorkerPool luaWorkers;
+        if (!luaWorkerScripts.empty()) {
+            if (luaWorkerCount == 0) {
+                luaWorkerCount = std::min(luaWorkerScripts.size(),
+                                          std::max<size_t>(workerCount, 1));
+            }
+            luaWorkers.Init(luaWorkerCount);
+            for (const std::string& script : luaWorkerScripts) {
+                luaWorkers.AddScript(script);
+            }
+        }
+
         auto& scene = SceneManager::Get();
+
+        // Snapshot of the freshly loaded level, R resets to it. With
+        // --rollback every step is recorded and B rewinds the simulation by
+        // one second.
+        PhysicsSnapshot levelStart = physicsCore.SaveSnapshot();
+        PhysicsHistory history(120, 30);
+        core.SetKeyEventCallback([&](Keycode key, KeyState state) {
+            KeyEvent(key, state, scene.GetEntities());
+            if (state != KeyState::Release) {
+                return;
+            }
+            if (key == Keycode::R) {
+                // Only resets what existed at level start. Entities spawned
+                // since keep their place, scripts may still hold them, so
+                // they are not removed here.
+                scene.RestorePhysicsSnapshot(levelStart);
+                history.Clear();
+            } else if (key == Keycode::B) {
+                uint64_t step = physicsCore.GetStepCount();
+                uint64_t target = step > 60 ? step - 60 : 0;
+                if (target < history.GetOldestStep()) {
+                    target = history.GetOldestStep();
+                }
+                if (history.Rewind(physicsCore, target)) {
+                    scene.SyncTransformsFromPhysics(false);
+                }
+            }
+        });
+
+        // Per frame systems over the entity components, systems that do not
+        // touch the same components run at the same time
+        World& world = World::Get();
+        SystemScheduler systems(world);
+        // Moves the world bounds of the entities whose transform changed
+        systems.AddSystem(
+            "UpdateBounds",
+            {Components<Transform>(world), Components<Bounds>(world)},
+            [](World& world, double) {
+                ComponentArray<Transform>& transforms =
+                    world.GetComponents<Transform>();
+                ComponentArray<Bounds>& bounds = world.GetComponents<Bounds>();
+                for (EntityId entity : transforms.GetChanged()) {
+                    if (transforms.Has(entity) && bounds.Has(entity)) {
+                        bounds.Get(entity).Update(
+                            transforms.Get(entity).matrix);
+                        // Only writer of Bounds, so this is safe here
+                        bounds.MarkChanged(entity);
+                    }
+                }
+            });
+        // Copies what the renderer needs into the capture snapshot, so the
+        // scene can change again while the snapshot is drawn. The draws are
+        // only rebuilt when entities, meshes or materials changed, otherwise
+        // just the transforms that moved are copied.
+        systems.AddSystem(
+            "CaptureFrame",
+            {Components<Transform, RenderMesh, MaterialRef>(world), {}},
+            [&](World& world, double) {
+                FrameSnapshot& snapshot = renderer.GetCaptureSnapshot();
+                FrameSnapshot& next = renderer.GetNextCaptureSnapshot();
+                ComponentArray<Transform>& transforms =
+                    world.GetComponents<Transform>();
+                const std::vector<EntityId>& changed = transforms.GetChanged();
+                if (&next != &snapshot) {
+                    next.pending.insert(next.pending.end(), changed.begin(),
+                                        changed.end());
+                }
+
+                if (snapshot.layoutVersion != world.GetLayoutVersion()) {
+                    snapshot.layoutVersion = world.GetLayoutVersion();
+                    snapshot.pending.clear();
+                    snapshot.draws.clear();
+                    snapshot.drawOf.assign(world.GetIdCount(), UINT32_MAX);
+                    world.Each<RenderMesh, Transform, MaterialRef>(
+                        [&](EntityId entity, RenderMesh& mesh,
+                            Transform& transform, MaterialRef& material) {
+                            auto mat = scene.GetMaterial(material.materialId);
+                            auto albedo =
+                                scene.GetTexture(mat.data->GetAlbedoId());
+                            auto normal =
+                                scene.GetTexture(mat.data->GetNormalId());
+                            snapshot.drawOf[entity] =
+                                (uint32_t)snapshot.draws.size();
+                            snapshot.draws.push_back(
+                                {transform.matrix, mesh.staticVbh, mesh.vbh,
+                                 mesh.ibh, albedo.data->GetTextureHandle(),
+                                 normal.data->GetTextureHandle(),
+                                 glm::vec4(mat.data->GetRoughness(),
+                                           mat.data->GetSpecular(), 0.0f,
+                                           0.0f)});
+                        });
+                    return;
+                }
+
+                auto refresh = [&](EntityId entity) {
+                    if (entity < snapshot.drawOf.size() &&
+                        snapshot.drawOf[entity] != UINT32_MAX) {
+                        snapshot.draws[snapshot.drawOf[entity]].transform =
+                            transforms.Get(entity).matrix;
+                    }
+                };
+                for (EntityId entity : snapshot.pending) {
+                    refresh(entity);
+                }
+                snapshot.pending.clear();
+                for (EntityId entity : changed) {
+                    refresh(entity);
+                }
+            });
+
+        // A small cube drawn at every point and spot light, streamed as
+        // procedural geometry with the default material
+        ProceduralDraw lightGizmo;
+        if (lightGizmos) {
+            PrimitiveCube cube;
+            lightGizmo.vertices.assign(std::begin(cube.vertices),
+                                       std::end(cube.vertices));
+            lightGizmo.indices.assign(std::begin(cube.indices),
+                                      std::end(cube.indices));
+            auto material = scene.GetMaterial(0);
+            lightGizmo.albedo = scene.GetTexture(material.data->GetAlbedoId())
+                                    .data->GetTextureHandle();
+            lightGizmo.normal = scene.GetTexture(material.data->GetNormalId())
+                                    .data->GetTextureHandle();
+        }
+
+        // Lights are few enough to copy every frame. The first directional
+        // light is the sun, the others go to the clustered lighting.
+        systems.AddSystem(
+            "CaptureLights", {Components<Light>(world), {}},
+            [&](World& world, double) {
+                FrameSnapshot& snapshot = renderer.GetCaptureSnapshot();
+                snapshot.lights.clear();
+                snapshot.sunColor = glm::vec3(0.0f);
+                bool sun = false;
+                world.Each<Light>([&](EntityId, Light& light) {
+                    glm::vec3 color = light.color * light.intensity;
+                    glm::vec3 direction = glm::normalize(light.direction);
+                    if (light.type == LightType::Directional) {
+                        if (!sun) {
+                            snapshot.sunDirection = -direction;
+                            snapshot.sunColor = color;
+                            sun = true;
+                        }
+                        return;
+                    }
+                    // A cone wider than everything for point lights
+                    float cosInner = -1.5f;
+                    float cosOuter = -2.0f;
+                    if (light.type == LightType::Spot) {
+                        cosInner = glm::cos(glm::radians(light.innerAngle));
+                        cosOuter = glm::cos(glm::radians(light.outerAngle));
+                    }
+                    snapshot.lights.push_back(
+                        {glm::vec4(light.position, light.range),
+                         glm::vec4(color, cosInner),
+                         glm::vec4(direction, cosOuter)});
+                    if (lightGizmos) {
+                        lightGizmo.transform = glm::scale(
+                            glm::translate(glm::mat4(1.0f), light.position),
+                            glm::vec3(0.1f));
+                        snapshot.procedural.push_back(lightGizmo);
+                    }
+                });
+            });
+
+        // Lua tasks are resumed once per frame within their time budget
+        core.SetUpdateCallback(
+            [&](double deltaTime) { lua.Update(deltaTime); });
+
         bx::debugPrintf("Main loop started\n");
         while (!core.IsQuit()) {
+            frameTimings.BeginFrame();
             core.EventLoop();
+            core.BeginFrame();
+            // Every consumer this frame gets the same time step
+            const double deltaTime = core.GetDeltaTime();
             core.CallKeyboardEvent();
+            for (const std::string& script : scriptWatcher.Poll()) {
+                lua.Reload(script);
+            }
+            TaskSystem::Get().RunMainThreadTasks();
+            EventBus::Get().Flush(FramePhase::PrePhysics);
 
-            accumulator += core.GetDeltaTime();
+            accumulator += deltaTime;
 
             while (accumulator >= FIXED_TIMESTEP) {
                 physicsCore.Update(FIXED_TIMESTEP);
-                for (auto& entity : scene.GetEntities()) {
-                    if (entity.second->GetBodyType() == RigidBodyType::Static) {
-                        continue;
-                    }
-                    // Update the position of the primitive based on the
-                    // physics simulation
-                    auto transform =
-                        physicsCore.GetBodyInterface().GetWorldTransform(
-                            entity.second->GetBodyID());
-                    entity.second->SetTransform(ToGLM(transform));
+                if (rollback) {
+                    history.Record(physicsCore);
+                }
+                if (trace.GetMode() != StateTrace::Mode::Off) {
+                    trace.Step(physicsCore.GetStepCount(),
+                               physicsCore.ComputeStateHash());
+                } else if (deterministic &&
+                           physicsCore.GetStepCount() % 60 == 0) {
+                    bx::debugPrintf("Step %llu hash %016llx\n",
+                                    (unsigned long long)
+                                        physicsCore.GetStepCount(),
+                                    (unsigned long long)
+                                        physicsCore.ComputeStateHash());
                 }
+                // Update the position of the entities based on the physics
+                // simulation
+                scene.SyncTransformsFromPhysics();
                 core.CallPhysicsStep(FIXED_TIMESTEP);
                 accumulator -= FIXED_TIMESTEP;
             }
-            core.CallUpdate(core.GetDeltaTime());
-
-            // This dummy draw call is here to make sure that view 0 is
-            // cleared if no other draw calls are submitted to view 0.
-            bgfx::touch(0);
+            EventBus::Get().Flush(FramePhase::PostPhysics);
+            // The workers ran alongside the last frame, apply their commands
+            // and start them on this one
+            luaWorkers.Sync();
+            luaWorkers.Kick(deltaTime);
+            // Advances the task scheduler clock and the profiler interval
+            core.CallUpdate(deltaTime);
+            EventBus::Get().Flush(FramePhase::PreRender);
 
             // Update the camera position to follow a cricle around {0, 0,
             // 0}
@@ -143,40 +458,37 @@ int main(int argc, char** argv) {
                                             4.5f + 2.0f * sin(frame * 0.008f),
                                             10.0f * sin(frame * 0.003f)));
             cam.data->SetProjection();
+            cam.data->Capture(renderer.GetCaptureSnapshot());
 
-            for (auto& entity : scene.GetEntities()) {
-                // Start a rendering pass for every entity
-                renderer.BeginPass(0);
-                cam.data->SetViewTransform(0);
-                entity.second->SetVertexBuffer();
-                entity.second->SetIndexBuffer();
-                entity.second->ApplyTransform();
-                auto matId = entity.second->GetMaterialId();
-                auto mat = scene.GetMaterial(matId);
-                auto albedo = scene.GetTexture(mat.data->GetAlbedoId());
-                auto normal = scene.GetTexture(mat.data->GetNormalId());
-                renderer.SetTextureUniforms(albedo.data->GetTextureHandle(),
-                                            normal.data->GetTextureHandle());
-                renderer.EndPass();
-            }
-
-            // Start the lighting pass
-            renderer.BeginPass(1);
-            renderer.EndPass();
+            systems.Run(deltaTime);
+            // The trees need the bounds of this frame, culling needs the
+            // trees
+            scene.UpdateBvh();
+            scene.CullSnapshot(renderer.GetCaptureSnapshot());
+            // Every stage has seen this frame's changes
+            world.EndFrame();
 
-            // Start the combine pass
-            renderer.BeginPass(2);
-            renderer.EndPass();
-
-            // Advance to next frame. Process submitted rendering
-            // primitives.
-            frame = bgfx::frame();
+            // Draw the captured frame and advance bgfx. In pipelined mode
+            // this returns as soon as the last frame is handed over, and
+            // the snapshot is encoded while the next frame is simulated.
+            frame = renderer.Present();
+            inputRecorder.EndFrame();
+            frameTimings.EndFrame();
         }
     }
 
+    if (inputRecorder.IsPlaying()) {
+        frameTimings.Report();
+    }
+    inputRecorder.Close();
+    trace.Close();
+    // The last snapshot may still be encoding with the scene's meshes
+    renderer.WaitForEncoding();
     SceneManager::Shutdown();
     physicsCore.Shutdown();
     renderer.Shutdown();
     core.Shutdown();
+    // Last, everything above may still be waiting on its tasks
+    TaskSystem::Get().Shutdown();
     return 0;
 }